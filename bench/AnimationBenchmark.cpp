@@ -0,0 +1,89 @@
+//
+// Created by cleme on 2020-03-03.
+//
+
+#include "Benchmark.hpp"
+#include "LegacyAnimation.hpp"
+#include "../src/Animation.hpp"
+#include "../src/CompressedAnimation.hpp"
+#include "../src/Skeleton.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+
+//Frames of playback simulated by every run, ten seconds at 60 frames per second
+const uint32_t ANIMATION_FRAME_COUNT = 600;
+const float ANIMATION_FRAME_TIME = 1.0f / 60.0f;
+const uint32_t ANIMATION_RUN_COUNT = 10;
+
+void benchmarkAnimation(){
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(BENCHMARK_MODEL_PATH, aiProcess_Triangulate|aiProcess_FlipUVs);
+    if(!scene || !scene->mRootNode || scene->mNumAnimations == 0){
+        throw std::runtime_error("failed to load the animated model " + BENCHMARK_MODEL_PATH);
+    }
+
+    //Same clip as the models of the application
+    uint32_t animationIndex = scene->mNumAnimations > 1 ? 1 : 0;
+
+    LegacyAnimation legacy(scene, animationIndex);
+    Skeleton skeleton(scene, legacy.getBoneMapping(), legacy.getBoneOffsetMatrices());
+    AnimationClip clip(scene->mAnimations[animationIndex], skeleton);
+    CompressedAnimationClip compressedClip(clip, skeleton, ClipCompressionSettings());
+
+    uint32_t boneCount = skeleton.getBoneCount();
+    printf("%s: %u nodes, %u bones, clip %s of %zu channels\n", BENCHMARK_MODEL_PATH.c_str(),
+           skeleton.getNodeCount(), boneCount, clip.getName().c_str(), clip.getChannels().size());
+
+    Pose pose;
+    AnimationCursor cursor;
+    std::vector<AffineTransform> palette(boneCount);
+
+    //Largest difference of the palettes over the playback, the legacy evaluation uses a slerp and the engine a nlerp
+    float maximumDifference = 0.0f;
+    for(uint32_t frame = 0 ; frame < ANIMATION_FRAME_COUNT ; frame++){
+        float time = frame * ANIMATION_FRAME_TIME;
+        const std::vector<aiMatrix4x4> &legacyPalette = legacy.getBoneTransforms(legacy.getAnimationTime(time));
+        skeleton.resetPose(pose);
+        clip.sample(clip.getAnimationTime(time), pose, cursor);
+        skeleton.computeBonePalette(pose, palette.data());
+        for(uint32_t bone = 0 ; bone < boneCount ; bone++){
+            for(uint32_t row = 0 ; row < 3 ; row++){
+                for(uint32_t column = 0 ; column < 4 ; column++){
+                    maximumDifference = std::max(maximumDifference, std::abs(palette[bone].rows[row][column] - legacyPalette[bone][row][column]));
+                }
+            }
+        }
+    }
+    printf("Largest palette difference with the legacy evaluation: %.6f\n", maximumDifference);
+
+    double legacyTime = measure(ANIMATION_RUN_COUNT, [&](){
+        for(uint32_t frame = 0 ; frame < ANIMATION_FRAME_COUNT ; frame++){
+            legacy.getBoneTransforms(legacy.getAnimationTime(frame * ANIMATION_FRAME_TIME));
+        }
+    });
+
+    double clipTime = measure(ANIMATION_RUN_COUNT, [&](){
+        for(uint32_t frame = 0 ; frame < ANIMATION_FRAME_COUNT ; frame++){
+            skeleton.resetPose(pose);
+            clip.sample(clip.getAnimationTime(frame * ANIMATION_FRAME_TIME), pose, cursor);
+            skeleton.computeBonePalette(pose, palette.data());
+        }
+    });
+
+    double compressedTime = measure(ANIMATION_RUN_COUNT, [&](){
+        for(uint32_t frame = 0 ; frame < ANIMATION_FRAME_COUNT ; frame++){
+            skeleton.resetPose(pose);
+            compressedClip.sample(compressedClip.getAnimationTime(frame * ANIMATION_FRAME_TIME), pose, cursor);
+            skeleton.computeBonePalette(pose, palette.data());
+        }
+    });
+
+    double frameToMicroseconds = 1000.0 / ANIMATION_FRAME_COUNT;
+    printf("%-40s %10.2f us per evaluation\n", "Legacy recursive evaluation", legacyTime * frameToMicroseconds);
+    printf("%-40s %10.2f us per evaluation, %.2fx\n", "Skeleton and raw clip", clipTime * frameToMicroseconds, legacyTime / clipTime);
+    printf("%-40s %10.2f us per evaluation, %.2fx\n", "Skeleton and compressed clip", compressedTime * frameToMicroseconds, legacyTime / compressedTime);
+}
@@ -0,0 +1,42 @@
+//
+// Created by cleme on 2020-03-03.
+//
+
+#ifndef GAME_ENGINE_BENCHMARK_HPP
+#define GAME_ENGINE_BENCHMARK_HPP
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+//Model loaded by the application, used by the benchmarks of a single character
+const std::string BENCHMARK_MODEL_PATH = std::string(MODELS_PATH) + "man/BaseMesh_Anim.fbx";
+
+/**
+ * Run the function several times and keep the fastest run, the first runs also warm up the caches
+ * @return the time of the fastest run in milliseconds
+ */
+template<typename Function>
+double measure(uint32_t runCount, Function &&function){
+    double bestTime = DBL_MAX;
+    for(uint32_t run = 0 ; run < runCount ; run++){
+        auto startTime = std::chrono::steady_clock::now();
+        function();
+        bestTime = std::min(bestTime, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+    }
+
+    return bestTime;
+}
+
+void benchmarkAnimation();
+void benchmarkKeySearch();
+void benchmarkLoad();
+void benchmarkScene();
+void benchmarkThreads();
+void benchmarkMeshes();
+void benchmarkPipelines();
+
+
+#endif //GAME_ENGINE_BENCHMARK_HPP
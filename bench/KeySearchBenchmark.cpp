@@ -0,0 +1,65 @@
+//
+// Created by cleme on 2020-03-03.
+//
+
+#include "Benchmark.hpp"
+#include "../src/Animation.hpp"
+
+#include <cstdio>
+#include <vector>
+
+//Synthetic clips keyed at 30 keys per second and played at 60 frames per second
+const float KEY_SEARCH_KEY_RATE = 30.0f;
+const float KEY_SEARCH_FRAME_RATE = 60.0f;
+const uint32_t KEY_SEARCH_CHANNEL_COUNT = 64;
+const uint32_t KEY_SEARCH_RUN_COUNT = 5;
+
+/**
+ * Play every channel of the clip from the start to the end, the keys found are summed so that the searches are kept
+ * @return the sum of the keys
+ */
+uint64_t playKeys(const std::vector<std::vector<float>> &channels, uint32_t frameCount, bool cursor){
+    uint32_t keyCount = static_cast<uint32_t>(channels[0].size());
+    std::vector<uint32_t> keys(channels.size(), 0);
+    uint64_t keySum = 0;
+
+    for(uint32_t frame = 0 ; frame < frameCount ; frame++){
+        float animationTime = frame / KEY_SEARCH_FRAME_RATE;
+        for(size_t channel = 0 ; channel < channels.size() ; channel++){
+            keySum += findKey(channels[channel].data(), keyCount, animationTime, keys[channel], cursor && frame > 0);
+        }
+    }
+
+    return keySum;
+}
+
+void benchmarkKeySearch(){
+    printf("%10s %10s %22s %22s\n", "keys", "frames", "cursor ns per channel", "seek ns per channel");
+
+    for(uint32_t keyCount = 16 ; keyCount <= 65536 ; keyCount *= 4){
+        //Every channel has its own keys, shifted a little so that they are not identical
+        std::vector<std::vector<float>> channels(KEY_SEARCH_CHANNEL_COUNT, std::vector<float>(keyCount));
+        for(uint32_t channel = 0 ; channel < KEY_SEARCH_CHANNEL_COUNT ; channel++){
+            for(uint32_t key = 0 ; key < keyCount ; key++){
+                channels[channel][key] = (key + (key > 0 ? channel * 0.001f : 0.0f)) / KEY_SEARCH_KEY_RATE;
+            }
+        }
+
+        uint32_t frameCount = static_cast<uint32_t>((keyCount - 1) / KEY_SEARCH_KEY_RATE * KEY_SEARCH_FRAME_RATE);
+        uint64_t cursorSum = 0;
+        uint64_t seekSum = 0;
+        double cursorTime = measure(KEY_SEARCH_RUN_COUNT, [&](){
+            cursorSum = playKeys(channels, frameCount, true);
+        });
+        double seekTime = measure(KEY_SEARCH_RUN_COUNT, [&](){
+            seekSum = playKeys(channels, frameCount, false);
+        });
+
+        if(cursorSum != seekSum){
+            printf("Warning: the cursor and the binary search found different keys for %u keys\n", keyCount);
+        }
+
+        double searchCount = static_cast<double>(frameCount) * KEY_SEARCH_CHANNEL_COUNT;
+        printf("%10u %10u %22.2f %22.2f\n", keyCount, frameCount, cursorTime * 1e6 / searchCount, seekTime * 1e6 / searchCount);
+    }
+}
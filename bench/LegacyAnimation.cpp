@@ -0,0 +1,159 @@
+//
+// Created by cleme on 2020-03-03.
+//
+
+#include "LegacyAnimation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/type_ptr.hpp>
+
+const aiNodeAnim* findNodeAnim(const aiAnimation *animation, std::string nodeName){
+    for(uint32_t i = 0 ; i < animation->mNumChannels ; i++){
+        const aiNodeAnim* pNodeAnim = animation->mChannels[i];
+        if(std::string(pNodeAnim->mNodeName.data) == nodeName){
+            return pNodeAnim;
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * Linear search of the key starting the interval containing animationTime, from the first key
+ * @return the index of the key and the interpolation factor towards the next key
+ */
+template<typename Key>
+uint32_t findLegacyKey(float animationTime, const Key *keys, uint32_t count, float &factor){
+    uint32_t index = count - 2;
+    for(uint32_t i = 0 ; i + 1 < count ; i++){
+        if(animationTime < (float)keys[i + 1].mTime){
+            index = i;
+            break;
+        }
+    }
+
+    float deltaTime = (float)keys[index + 1].mTime - (float)keys[index].mTime;
+    factor = deltaTime > 0.0f ? std::clamp((animationTime - (float)keys[index].mTime) / deltaTime, 0.0f, 1.0f) : 0.0f;
+    return index;
+}
+
+aiVector3D calcInterpolatedVector(float animationTime, const aiVectorKey *keys, uint32_t count){
+    if(count == 1){
+        return keys[0].mValue;
+    }
+
+    float factor;
+    uint32_t index = findLegacyKey(animationTime, keys, count, factor);
+    const aiVector3D &start = keys[index].mValue;
+    const aiVector3D &end = keys[index + 1].mValue;
+    return start + factor * (end - start);
+}
+
+aiQuaternion calcInterpolatedRotation(float animationTime, const aiQuatKey *keys, uint32_t count){
+    if(count == 1){
+        return keys[0].mValue;
+    }
+
+    float factor;
+    uint32_t index = findLegacyKey(animationTime, keys, count, factor);
+    aiQuaternion rotationQ;
+    aiQuaternion::Interpolate(rotationQ, keys[index].mValue, keys[index + 1].mValue, factor);
+    return rotationQ.Normalize();
+}
+
+LegacyAnimation::LegacyAnimation(const aiScene *scene, uint32_t animationIndex){
+    this->scene = scene;
+    this->animation = scene->mAnimations[animationIndex];
+
+    for(size_t meshIndex = 0 ; meshIndex < scene->mNumMeshes ; meshIndex++){
+        const aiMesh *mesh = scene->mMeshes[meshIndex];
+        for(size_t i = 0 ; i < mesh->mNumBones ; i++){
+            std::string nodeName(mesh->mBones[i]->mName.data);
+            if(this->boneMapping.find(nodeName) == this->boneMapping.end()){
+                this->boneMapping[nodeName] = static_cast<uint32_t>(this->boneOffsets.size());
+                this->boneOffsets.push_back(mesh->mBones[i]->mOffsetMatrix);
+            }
+        }
+    }
+    this->finalTransforms.resize(this->boneOffsets.size());
+}
+
+const std::map<std::string, uint32_t>& LegacyAnimation::getBoneMapping() const {
+    return this->boneMapping;
+}
+
+/**
+ * @return the offset matrices of the bones, converted the same way as the assets do
+ */
+std::vector<glm::mat4> LegacyAnimation::getBoneOffsetMatrices() const {
+    std::vector<glm::mat4> offsets;
+    for(const aiMatrix4x4 &offset : this->boneOffsets){
+        offsets.push_back(glm::transpose(glm::make_mat4(&offset.a1)));
+    }
+    return offsets;
+}
+
+uint32_t LegacyAnimation::getBoneCount() const {
+    return static_cast<uint32_t>(this->boneOffsets.size());
+}
+
+float LegacyAnimation::getAnimationTime(float timeInSeconds) const {
+    float ticksPerSecond = this->animation->mTicksPerSecond != 0 ? this->animation->mTicksPerSecond : 25.0f;
+    return fmod(timeInSeconds * ticksPerSecond, this->animation->mDuration);
+}
+
+/**
+ * @return the final transformation of every bone, rows first
+ */
+const std::vector<aiMatrix4x4>& LegacyAnimation::getBoneTransforms(float animationTime){
+    aiMatrix4x4 identity;
+    this->readNodeHierarchy(animationTime, this->scene->mRootNode, identity);
+    return this->finalTransforms;
+}
+
+void LegacyAnimation::readNodeHierarchy(float animationTime, const aiNode *pNode, const aiMatrix4x4 &parentTransform){
+    std::string nodeName(pNode->mName.data);
+
+    aiMatrix4x4 nodeTransformation(pNode->mTransformation);
+
+    const aiNodeAnim *nodeanim = findNodeAnim(this->animation, nodeName);
+
+    if(nodeanim){
+        //A channel without keys for a component keeps the component of the node
+        aiVector3D scaling;
+        aiQuaternion rotation;
+        aiVector3D position;
+        if(nodeanim->mNumScalingKeys == 0 || nodeanim->mNumRotationKeys == 0 || nodeanim->mNumPositionKeys == 0){
+            pNode->mTransformation.Decompose(scaling, rotation, position);
+        }
+        if(nodeanim->mNumScalingKeys > 0){
+            scaling = calcInterpolatedVector(animationTime, nodeanim->mScalingKeys, nodeanim->mNumScalingKeys);
+        }
+        if(nodeanim->mNumRotationKeys > 0){
+            rotation = calcInterpolatedRotation(animationTime, nodeanim->mRotationKeys, nodeanim->mNumRotationKeys);
+        }
+        if(nodeanim->mNumPositionKeys > 0){
+            position = calcInterpolatedVector(animationTime, nodeanim->mPositionKeys, nodeanim->mNumPositionKeys);
+        }
+
+        aiMatrix4x4 scalingM;
+        aiMatrix4x4::Scaling(scaling, scalingM);
+        aiMatrix4x4 rotationM(rotation.GetMatrix());
+        aiMatrix4x4 translationM;
+        aiMatrix4x4::Translation(position, translationM);
+
+        nodeTransformation = translationM * rotationM * scalingM;
+    }
+
+    aiMatrix4x4 globalTransformation = parentTransform * nodeTransformation;
+
+    if(this->boneMapping.find(nodeName) != this->boneMapping.end()){
+        uint32_t boneIndex = this->boneMapping[nodeName];
+        this->finalTransforms[boneIndex] = globalTransformation * this->boneOffsets[boneIndex];
+    }
+
+    for(uint32_t i = 0 ; i < pNode->mNumChildren ; i++){
+        this->readNodeHierarchy(animationTime, pNode->mChildren[i], globalTransformation);
+    }
+}
@@ -0,0 +1,46 @@
+//
+// Created by cleme on 2020-03-03.
+//
+
+#ifndef GAME_ENGINE_LEGACYANIMATION_HPP
+#define GAME_ENGINE_LEGACYANIMATION_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <assimp/scene.h>
+
+/**
+ * Bone palette evaluation as done before the skeleton was flattened: a recursive walk of the
+ * Assimp node hierarchy, the channel of every node found by name, rotations interpolated with
+ * a slerp and transforms concatenated with 4x4 matrices.
+ * The key search and the interpolation factor of the original code are fixed so that it can be
+ * used as a reference for the engine evaluation.
+ */
+class LegacyAnimation {
+private:
+    const aiScene *scene;
+    const aiAnimation *animation;
+
+    //Same bone indices as the assets, in the order of the bones of the meshes
+    std::map<std::string, uint32_t> boneMapping;
+    std::vector<aiMatrix4x4> boneOffsets;
+    std::vector<aiMatrix4x4> finalTransforms;
+
+    void readNodeHierarchy(float animationTime, const aiNode *pNode, const aiMatrix4x4 &parentTransform);
+
+public:
+    LegacyAnimation(const aiScene *scene, uint32_t animationIndex);
+
+    const std::map<std::string, uint32_t>& getBoneMapping() const;
+    std::vector<glm::mat4> getBoneOffsetMatrices() const;
+    uint32_t getBoneCount() const;
+
+    float getAnimationTime(float timeInSeconds) const;
+    const std::vector<aiMatrix4x4>& getBoneTransforms(float animationTime);
+};
+
+
+#endif //GAME_ENGINE_LEGACYANIMATION_HPP
@@ -0,0 +1,55 @@
+//
+// Created by cleme on 2020-03-04.
+//
+
+#include "Benchmark.hpp"
+#include "../src/ModelAsset.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <assimp/Importer.hpp>
+
+const uint32_t LOAD_RUN_COUNT = 3;
+
+/**
+ * Load every model of the models directory that Assimp can import, once without its
+ * cache file (import, optimization and cache write) and once from the cache written by the first load
+ */
+void benchmarkLoad(){
+    Assimp::Importer importer;
+    std::vector<std::string> paths;
+    for(const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(MODELS_PATH)){
+        std::string extension = entry.path().extension().string();
+        if(entry.is_regular_file() && extension != ".meshcache" && importer.IsExtensionSupported(extension)){
+            paths.push_back(entry.path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    //Loading only uses the CPU, the assets are never initialized
+    VkDevice device = VK_NULL_HANDLE;
+
+    printf("%-60s %14s %14s %10s\n", "model", "import ms", "cached ms", "speedup");
+    for(const std::string &path : paths){
+        std::string cachePath = path + ".meshcache";
+        try {
+            double importTime = measure(LOAD_RUN_COUNT, [&](){
+                std::filesystem::remove(cachePath);
+                ModelAsset asset(nullptr, device, path);
+                asset.load();
+            });
+            if(!std::filesystem::exists(cachePath)){
+                printf("%-60s %14.2f %14s\n", path.c_str(), importTime, "no cache");
+                continue;
+            }
+
+            double cachedTime = measure(LOAD_RUN_COUNT, [&](){
+                ModelAsset asset(nullptr, device, path);
+                asset.load();
+            });
+            printf("%-60s %14.2f %14.2f %9.1fx\n", path.c_str(), importTime, cachedTime, importTime / cachedTime);
+        } catch (const std::exception &e) {
+            printf("%-60s failed: %s\n", path.c_str(), e.what());
+        }
+    }
+}
@@ -0,0 +1,36 @@
+//
+// Created by cleme on 2020-03-05.
+//
+
+#include "Benchmark.hpp"
+#include "../src/Application.hpp"
+
+#include <cstdio>
+
+//Enough instances for the vertex work to dominate the GPU time of the frame
+const uint32_t MESH_INSTANCE_COUNT = 100;
+const uint32_t MESH_FRAME_COUNT = 600;
+
+/**
+ * GPU time of the frames of the application with the geometry imported as is and with the welded and reordered geometry.
+ * The draws need the render pass of the swap chain, this opens a window like the scene benchmark.
+ */
+void benchmarkMeshes(){
+    printf("%u instances\n", MESH_INSTANCE_COUNT);
+    printf("%14s %12s %12s\n", "optimization", "frame ms", "GPU ms");
+
+    for(bool meshOptimization : {false, true}){
+        ApplicationSettings settings;
+        settings.instanceCount = MESH_INSTANCE_COUNT;
+        settings.frameCount = MESH_FRAME_COUNT;
+        settings.meshOptimization = meshOptimization;
+
+        Application application(settings);
+        application.run();
+
+        const RunStats &stats = application.getRunStats();
+        printf("%14s %12.3f %12.3f\n", meshOptimization ? "on" : "off",
+               stats.frameTime * 1000.0 / std::max(stats.frameCount, 1u),
+               stats.gpuTime * 1000.0 / std::max(stats.gpuFrameCount, 1u));
+    }
+}
@@ -0,0 +1,50 @@
+//
+// Created by cleme on 2020-03-05.
+//
+
+#include "Benchmark.hpp"
+#include "../src/Application.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+//Separate file so that the cache of the application is left untouched
+const std::string BENCHMARK_PIPELINE_CACHE_PATH = "./shaders/build/pipelines_benchmark.cache";
+
+/**
+ * Turn off the shader caches of the drivers on the disk, the first run would be warm otherwise
+ */
+void disableDriverShaderCaches(){
+#ifdef _WIN32
+    _putenv_s("MESA_SHADER_CACHE_DISABLE", "true");
+    _putenv_s("__GL_SHADER_DISK_CACHE", "0");
+#else
+    setenv("MESA_SHADER_CACHE_DISABLE", "true", 1);
+    setenv("__GL_SHADER_DISK_CACHE", "0", 1);
+#endif
+}
+
+/**
+ * Creation of the graphics and compute pipelines from an empty pipeline cache, then from the cache saved by the first run.
+ * No window is opened, the paths of the application are relative to the build directory.
+ */
+void benchmarkPipelines(){
+    disableDriverShaderCaches();
+    std::remove(BENCHMARK_PIPELINE_CACHE_PATH.c_str());
+
+    printf("%8s %16s %10s\n", "cache", "creation ms", "speedup");
+    double emptyCacheTime = 0.0;
+    for(uint32_t run = 0 ; run < 2 ; run++){
+        Application application;
+        application.createPipelinesHeadless(BENCHMARK_PIPELINE_CACHE_PATH);
+
+        const RunStats &stats = application.getRunStats();
+        double time = stats.pipelineCreationTime * 1000.0;
+        if(run == 0){
+            emptyCacheTime = time;
+        }else if(!stats.pipelineCacheLoaded){
+            printf("The cache saved by the first run was rejected by the driver\n");
+        }
+        printf("%8s %16.3f %9.2fx\n", stats.pipelineCacheLoaded ? "loaded" : "empty", time, emptyCacheTime / time);
+    }
+}
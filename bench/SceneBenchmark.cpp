@@ -0,0 +1,46 @@
+//
+// Created by cleme on 2020-03-05.
+//
+
+#include "Benchmark.hpp"
+#include "../src/Application.hpp"
+
+#include <array>
+#include <cstdio>
+
+//Frames drawn by every run, the first ones are not measured
+const uint32_t SCENE_FRAME_COUNT = 600;
+const std::array<uint32_t, 3> SCENE_INSTANCE_COUNTS = {1, 100, 10000};
+
+/**
+ * Run the application with a growing number of instances of the character, with and without the
+ * occlusion culling against the depth pyramid. The culled instances are neither skinned nor drawn,
+ * the GPU time covers both. The times and the instances are per frame.
+ * Opens a window, the paths of the application are relative to the build directory.
+ */
+void benchmarkScene(){
+    printf("%10s %10s %12s %14s %12s %12s %12s\n", "instances", "occlusion", "frame ms", "animation ms", "GPU ms", "drawn", "occluded");
+
+    for(uint32_t instanceCount : SCENE_INSTANCE_COUNTS){
+        for(bool occlusionCulling : {true, false}){
+            ApplicationSettings settings;
+            settings.instanceCount = instanceCount;
+            settings.frameCount = SCENE_FRAME_COUNT;
+            settings.occlusionCulling = occlusionCulling;
+
+            Application application(settings);
+            application.run();
+
+            const RunStats &stats = application.getRunStats();
+            double frames = std::max(stats.frameCount, 1u);
+            double gpuFrames = std::max(stats.gpuFrameCount, 1u);
+            double cullingFrames = std::max(stats.cullingFrameCount, 1u);
+            printf("%10u %10s %12.3f %14.3f %12.3f %12.1f %12.1f\n", instanceCount, occlusionCulling ? "on" : "off",
+                   stats.frameTime * 1000.0 / frames,
+                   stats.animationTime * 1000.0 / frames,
+                   stats.gpuTime * 1000.0 / gpuFrames,
+                   (stats.culling.firstPhaseDrawn + stats.culling.secondPhaseDrawn) / cullingFrames,
+                   stats.culling.occlusionCulled / cullingFrames);
+        }
+    }
+}
@@ -0,0 +1,67 @@
+//
+// Created by cleme on 2020-03-05.
+//
+
+#include "Benchmark.hpp"
+#include "../src/Model.hpp"
+#include "../src/ModelAsset.hpp"
+#include "../src/ThreadPool.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+//Same grid as the instances of the application, seen from its origin so that every animation LOD is used
+const uint32_t THREAD_INSTANCE_COUNT = 1000;
+const float THREAD_INSTANCE_SPACING = 50.0f;
+const uint32_t THREAD_FRAME_COUNT = 300;
+const uint32_t THREAD_RUN_COUNT = 3;
+
+/**
+ * Evaluate the animations of the instances of the character with 1, 2, 4 and one worker thread per core,
+ * the same way as the application does every frame
+ */
+void benchmarkThreads(){
+    VkDevice device = VK_NULL_HANDLE;
+    std::shared_ptr<ModelAsset> asset = std::make_shared<ModelAsset>(nullptr, device, BENCHMARK_MODEL_PATH);
+    asset->load();
+
+    uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(THREAD_INSTANCE_COUNT))));
+    std::vector<std::unique_ptr<Model>> models;
+    for(uint32_t i = 0 ; i < THREAD_INSTANCE_COUNT ; i++){
+        models.push_back(std::make_unique<Model>(asset, glm::vec3((i % gridSize) * THREAD_INSTANCE_SPACING, 0.0f, (i / gridSize) * THREAD_INSTANCE_SPACING)));
+    }
+    uint32_t boneCount = asset->getSkeleton().getBoneCount();
+    std::vector<AffineTransform> palettes(static_cast<size_t>(boneCount) * THREAD_INSTANCE_COUNT);
+    glm::vec3 cameraPosition(0.0f);
+
+    printf("%u instances of %u bones, %u hardware threads\n", THREAD_INSTANCE_COUNT, boneCount, std::thread::hardware_concurrency());
+    printf("%10s %20s %10s\n", "threads", "ms per frame", "speedup");
+
+    std::vector<uint32_t> threadCounts = {1, 2, 4};
+    if(std::thread::hardware_concurrency() > 4){
+        threadCounts.push_back(std::thread::hardware_concurrency());
+    }
+
+    double singleThreadTime = 0.0;
+    for(uint32_t threadCount : threadCounts){
+        ThreadPool threadPool(threadCount);
+        uint64_t frame = 0;
+        double time = measure(THREAD_RUN_COUNT, [&](){
+            for(uint32_t i = 0 ; i < THREAD_FRAME_COUNT ; i++, frame++){
+                float timeInSeconds = frame / 60.0f;
+                threadPool.parallelFor(THREAD_INSTANCE_COUNT, [&](uint32_t begin, uint32_t end){
+                    for(uint32_t model = begin ; model < end ; model++){
+                        models[model]->getBoneTransforms(timeInSeconds, cameraPosition, frame + model, &palettes[static_cast<size_t>(model) * boneCount]);
+                    }
+                });
+            }
+        }) / THREAD_FRAME_COUNT;
+
+        if(threadCount == 1){
+            singleThreadTime = time;
+        }
+        printf("%10u %20.3f %9.2fx\n", threadPool.getThreadCount(), time, singleThreadTime / time);
+    }
+}
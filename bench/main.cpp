@@ -0,0 +1,66 @@
+#include "Benchmark.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <vector>
+
+struct BenchmarkSuite {
+    const char *name;
+    const char *description;
+    void (*run)();
+};
+
+const std::vector<BenchmarkSuite> BENCHMARK_SUITES = {
+        {"animation", "bone palette of the character, legacy recursive evaluation against the skeleton and its clips", benchmarkAnimation},
+        {"keys", "key search of synthetic clips of growing length, cursor playback against a binary search every frame", benchmarkKeySearch},
+        {"load", "every model of the models directory, Assimp import against the mesh cache", benchmarkLoad},
+        {"scene", "frames of the application with 1, 100 and 10000 instances, with and without occlusion culling, opens a window", benchmarkScene},
+        {"threads", "animation evaluation of 1000 instances with 1 to N worker threads", benchmarkThreads},
+        {"meshes", "GPU time of 100 instances with and without the mesh optimizations of the import, opens a window", benchmarkMeshes},
+        {"pipelines", "creation of the graphics and compute pipelines with an empty and a loaded pipeline cache, without a window", benchmarkPipelines}
+};
+
+/**
+ * Run the suites given on the command line, or every suite without argument
+ */
+int main(int argc, char **argv) {
+    std::vector<const BenchmarkSuite*> suites;
+    for(int i = 1 ; i < argc ; i++){
+        const BenchmarkSuite *selected = nullptr;
+        for(const BenchmarkSuite &suite : BENCHMARK_SUITES){
+            if(strcmp(argv[i], suite.name) == 0){
+                selected = &suite;
+            }
+        }
+
+        if(selected == nullptr){
+            printf("Unknown suite %s, the suites are:\n", argv[i]);
+            for(const BenchmarkSuite &suite : BENCHMARK_SUITES){
+                printf("    %s: %s\n", suite.name, suite.description);
+            }
+            return EXIT_FAILURE;
+        }
+        suites.push_back(selected);
+    }
+
+    if(suites.empty()){
+        for(const BenchmarkSuite &suite : BENCHMARK_SUITES){
+            suites.push_back(&suite);
+        }
+    }
+
+    try {
+        for(const BenchmarkSuite *suite : suites){
+            printf("== %s: %s\n", suite->name, suite->description);
+            suite->run();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
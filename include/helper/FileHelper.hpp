@@ -13,7 +13,7 @@
  * @param filename the path of the file
  * @return a vector of bytes containing the data of the file
  */
-std::vector<char> readFile(const std::string& filename){
+inline std::vector<char> readFile(const std::string& filename){
     std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
     if(!file.is_open()){
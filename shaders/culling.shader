@@ -0,0 +1,210 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#pragma shader_stage(compute)
+
+layout(local_size_x = 64) in;
+
+layout(binding = 0) uniform ViewMat{
+    mat4 view;
+    mat4 projection;
+} viewMats;
+
+struct Instance {
+    mat4 model;
+    //Center and radius in model space
+    vec4 boundingSphere;
+    uint firstSkinnedVertex;
+    uint firstDraw;
+    uint drawCount;
+    uint batch;
+    uint firstBone;
+};
+
+layout(std430, binding = 1) readonly buffer Instances{
+    Instance instances[];
+};
+
+//Same layout as VkDrawIndexedIndirectCommand
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(std430, binding = 2) buffer DrawCommands{
+    DrawCommand draws[];
+};
+
+//Number of draws of every batch, zero when the batch has no visible instance
+layout(std430, binding = 3) buffer DrawCounts{
+    uint drawCounts[];
+};
+
+layout(std430, binding = 4) writeonly buffer VisibleInstances{
+    uint visibleInstances[];
+};
+
+//Farthest depth of the last depth pyramid and the camera it was rendered with
+layout(binding = 5) uniform sampler2D depthPyramid;
+
+layout(binding = 6) uniform PyramidViewMat{
+    mat4 view;
+    mat4 projection;
+} pyramidViewMats;
+
+//Whether each instance was drawn by the first phase
+layout(std430, binding = 7) buffer InstanceVisibility{
+    uint drawnInFirstPhase[];
+};
+
+layout(std430, binding = 8) buffer CullingStats{
+    uint frustumCulled;
+    uint occlusionCulled;
+    uint firstPhaseDrawn;
+    uint secondPhaseDrawn;
+} stats;
+
+//Instances to skin for each phase, counted in the workgroups along y of the skinning dispatch of the phase
+struct DispatchCommand {
+    uint x;
+    uint y;
+    uint z;
+};
+
+layout(std430, binding = 9) buffer SkinningDispatches{
+    DispatchCommand skinningDispatches[];
+};
+
+layout(std430, binding = 10) writeonly buffer SkinningInstances{
+    uint skinningInstances[];
+};
+
+layout(push_constant) uniform CullingParameters{
+    uint instanceCount;
+    uint drawCount;
+    uint batchCount;
+    uint phase;
+    uint occlusionCulling;
+} parameters;
+
+bool isInFrustum(vec3 center, float radius){
+    //Frustum planes from the rows of the view projection matrix, the depth range is [0, 1]
+    mat4 rows = transpose(viewMats.projection * viewMats.view);
+    vec4 planes[6] = vec4[6](
+        rows[3] + rows[0],
+        rows[3] - rows[0],
+        rows[3] + rows[1],
+        rows[3] - rows[1],
+        rows[2],
+        rows[3] - rows[2]
+    );
+    for(int i = 0 ; i < 6 ; i++){
+        vec4 plane = planes[i] / length(planes[i].xyz);
+        if(dot(plane.xyz, center) + plane.w < -radius){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * The box around the sphere is projected with the camera of the pyramid, the instance is occluded
+ * when its nearest depth is behind the farthest depth of the pyramid texels covering the box.
+ * The level is chosen so that the box covers at most two texels in each direction.
+ */
+bool isOccluded(vec3 center, float radius){
+    mat4 viewProjection = pyramidViewMats.projection * pyramidViewMats.view;
+    vec2 minimum = vec2(1.0);
+    vec2 maximum = vec2(-1.0);
+    float nearestDepth = 1.0;
+    for(int i = 0 ; i < 8 ; i++){
+        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+        //The box crosses the camera plane, or the pyramid has not been built yet
+        if(clip.w <= 0.0){
+            return false;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        minimum = min(minimum, ndc.xy);
+        maximum = max(maximum, ndc.xy);
+        nearestDepth = min(nearestDepth, ndc.z);
+    }
+
+    ivec2 size = textureSize(depthPyramid, 0);
+    vec2 firstPixel = clamp(minimum * 0.5 + 0.5, 0.0, 1.0) * vec2(size);
+    vec2 lastPixel = clamp(maximum * 0.5 + 0.5, 0.0, 1.0) * vec2(size);
+    vec2 extent = lastPixel - firstPixel;
+    int level = min(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), textureQueryLevels(depthPyramid) - 1);
+
+    ivec2 levelSize = textureSize(depthPyramid, level);
+    ivec2 first = min(ivec2(firstPixel) >> level, levelSize - 1);
+    ivec2 last = min(ivec2(lastPixel) >> level, levelSize - 1);
+    float farthestDepth = max(max(texelFetch(depthPyramid, first, level).r, texelFetch(depthPyramid, ivec2(last.x, first.y), level).r),
+                              max(texelFetch(depthPyramid, ivec2(first.x, last.y), level).r, texelFetch(depthPyramid, last, level).r));
+
+    return nearestDepth > farthestDepth;
+}
+
+/**
+ * Add the instance to the draws of its batch for the given phase
+ */
+void drawInstance(uint index, Instance instance, uint phase){
+    //Every draw of the batch gets the instance, the slot of the first draw compacts the visible instances
+    uint firstDraw = phase * parameters.drawCount + instance.firstDraw;
+    uint slot = atomicAdd(draws[firstDraw].instanceCount, 1);
+    for(uint i = 1 ; i < instance.drawCount ; i++){
+        atomicAdd(draws[firstDraw + i].instanceCount, 1);
+    }
+    visibleInstances[draws[firstDraw].firstInstance + slot] = index;
+
+    //Only the instances drawn by the phase are skinned
+    uint skinningSlot = atomicAdd(skinningDispatches[phase].y, 1);
+    skinningInstances[phase * parameters.instanceCount + skinningSlot] = index;
+
+    if(slot == 0){
+        drawCounts[phase * parameters.batchCount + instance.batch] = instance.drawCount;
+    }
+}
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if(index >= parameters.instanceCount){
+        return;
+    }
+
+    Instance instance = instances[index];
+    vec3 center = (instance.model * vec4(instance.boundingSphere.xyz, 1.0)).xyz;
+    float scale = max(length(instance.model[0].xyz), max(length(instance.model[1].xyz), length(instance.model[2].xyz)));
+    float radius = instance.boundingSphere.w * scale;
+
+    //First phase: test against the pyramid of the previous frame and draw the instances that pass
+    if(parameters.phase == 0){
+        drawnInFirstPhase[index] = 0;
+        if(!isInFrustum(center, radius)){
+            atomicAdd(stats.frustumCulled, 1);
+            return;
+        }
+        if(parameters.occlusionCulling != 0 && isOccluded(center, radius)){
+            return;
+        }
+
+        drawnInFirstPhase[index] = 1;
+        atomicAdd(stats.firstPhaseDrawn, 1);
+        drawInstance(index, instance, 0);
+        return;
+    }
+
+    //Second phase: the instances rejected by the first phase are tested against the pyramid of this frame
+    if(drawnInFirstPhase[index] != 0 || !isInFrustum(center, radius)){
+        return;
+    }
+    if(isOccluded(center, radius)){
+        atomicAdd(stats.occlusionCulled, 1);
+        return;
+    }
+
+    atomicAdd(stats.secondPhaseDrawn, 1);
+    drawInstance(index, instance, 1);
+}
@@ -0,0 +1,52 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#pragma shader_stage(compute)
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+//Compiled a second time with MULTISAMPLED defined for a multisampled depth attachment
+#ifdef MULTISAMPLED
+layout(binding = 0) uniform sampler2DMS depthBuffer;
+#else
+layout(binding = 0) uniform sampler2D depthBuffer;
+#endif
+
+layout(binding = 1, r32f) uniform readonly image2D sourceLevel;
+layout(binding = 2, r32f) uniform writeonly image2D destinationLevel;
+
+layout(push_constant) uniform HiZParameters{
+    uint level;
+    uint sampleCount;
+} parameters;
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(destinationLevel);
+    if(any(greaterThanEqual(texel, size))){
+        return;
+    }
+
+    //Farthest depth of the pixels covered by the texel
+    float depth = 0.0;
+    if(parameters.level == 0){
+#ifdef MULTISAMPLED
+        for(int i = 0 ; i < int(parameters.sampleCount) ; i++){
+            depth = max(depth, texelFetch(depthBuffer, texel, i).r);
+        }
+#else
+        depth = texelFetch(depthBuffer, texel, 0).r;
+#endif
+    }else{
+        //The last texel of a level also covers the last row or column of an odd sized source level
+        ivec2 sourceSize = imageSize(sourceLevel);
+        ivec2 first = texel * 2;
+        ivec2 last = min(first + 1 + ivec2(equal(texel, size - 1)) * (sourceSize & 1), sourceSize - 1);
+        for(int y = first.y ; y <= last.y ; y++){
+            for(int x = first.x ; x <= last.x ; x++){
+                depth = max(depth, imageLoad(sourceLevel, ivec2(x, y)).r);
+            }
+        }
+    }
+
+    imageStore(destinationLevel, texel, vec4(depth));
+}
@@ -0,0 +1,139 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#pragma shader_stage(compute)
+
+layout(local_size_x = 64) in;
+
+//Vertices of the assets, read as words because the vertex layout is defined on the CPU side
+layout(std430, binding = 0) readonly buffer SourceVertices{
+    uint words[];
+} source;
+
+//Rows of the 3x4 bone matrices of every model
+layout(std430, binding = 1) readonly buffer Bones{
+    mat3x4 matrices[];
+} bones;
+
+struct SkinnedVertex {
+    vec3 position;
+    //Bone ids of the asset for the debug colour, two 16 bit ids per word
+    uint boneIds01;
+    vec3 normal;
+    uint boneIds23;
+};
+
+layout(std430, binding = 2) writeonly buffer SkinnedVertices{
+    SkinnedVertex vertices[];
+} skinned;
+
+struct Instance {
+    mat4 model;
+    vec4 boundingSphere;
+    uint firstSkinnedVertex;
+    uint firstDraw;
+    uint drawCount;
+    uint batch;
+    uint firstBone;
+};
+
+layout(std430, binding = 3) readonly buffer Instances{
+    Instance instances[];
+};
+
+//Layout of the vertices of the asset of every batch, the offsets are in words
+struct Batch {
+    uint firstSourceWord;
+    uint vertexCount;
+    uint vertexStride;
+    uint positionOffset;
+    uint normalOffset;
+    uint boneIdsOffset;
+    uint boneWeightsOffset;
+    uint vertexFormat;
+};
+
+layout(std430, binding = 4) readonly buffer Batches{
+    Batch batches[];
+};
+
+//Instances drawn by each culling phase, the list of the second phase follows the one of the first phase
+layout(std430, binding = 5) readonly buffer InstanceList{
+    uint listedInstances[];
+};
+
+layout(push_constant) uniform SkinningParameters{
+    uint instanceCount;
+    uint phase;
+} parameters;
+
+//Packed vertices store the normal in octahedral snorm16, the bone ids in uint8 and the weights in unorm8
+const uint VERTEX_FORMAT_PACKED = 1;
+
+vec4 readVec4(uint word){
+    return uintBitsToFloat(uvec4(source.words[word], source.words[word + 1], source.words[word + 2], source.words[word + 3]));
+}
+
+vec3 readVec3(uint word){
+    return uintBitsToFloat(uvec3(source.words[word], source.words[word + 1], source.words[word + 2]));
+}
+
+vec3 decodeOctahedral(vec2 encoded){
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if(normal.z < 0.0){
+        normal.xy = (1.0 - abs(encoded.yx)) * vec2(encoded.x >= 0.0 ? 1.0 : -1.0, encoded.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(normal);
+}
+
+void main() {
+    //One row of workgroups per listed instance, wide enough for the largest asset
+    Instance instance = instances[listedInstances[parameters.phase * parameters.instanceCount + gl_WorkGroupID.y]];
+    Batch batch = batches[instance.batch];
+    uint index = gl_GlobalInvocationID.x;
+    if(index >= batch.vertexCount){
+        return;
+    }
+
+    uint vertex = batch.firstSourceWord + index * batch.vertexStride;
+    vec3 position = readVec3(vertex + batch.positionOffset);
+    vec3 normal;
+    uvec4 boneIds;
+    vec4 weights;
+    if(batch.vertexFormat == VERTEX_FORMAT_PACKED){
+        normal = decodeOctahedral(unpackSnorm2x16(source.words[vertex + batch.normalOffset]));
+        boneIds = (uvec4(source.words[vertex + batch.boneIdsOffset]) >> uvec4(0, 8, 16, 24)) & 0xFFu;
+        weights = unpackUnorm4x8(source.words[vertex + batch.boneWeightsOffset]);
+    }else{
+        normal = readVec3(vertex + batch.normalOffset);
+        boneIds = uvec4(source.words[vertex + batch.boneIdsOffset],
+                        source.words[vertex + batch.boneIdsOffset + 1],
+                        source.words[vertex + batch.boneIdsOffset + 2],
+                        source.words[vertex + batch.boneIdsOffset + 3]);
+        weights = readVec4(vertex + batch.boneWeightsOffset);
+    }
+    //The ids in the asset are kept for the debug colour of the vertex shader in 16 bits each,
+    //the Full format can hold larger ids but the rigs have far fewer bones
+    uvec4 debugBoneIds = min(boneIds, uvec4(0xFFFFu));
+    boneIds += instance.firstBone;
+
+    vec3 skinnedPosition = position;
+    vec3 skinnedNormal = normal;
+
+    //Vertices without weights are not attached to the skeleton
+    if(weights.x + weights.y + weights.z + weights.w > 0.0){
+        mat3x4 boneTransform = bones.matrices[boneIds.x] * weights.x;
+        boneTransform += bones.matrices[boneIds.y] * weights.y;
+        boneTransform += bones.matrices[boneIds.z] * weights.z;
+        boneTransform += bones.matrices[boneIds.w] * weights.w;
+
+        //The columns of boneTransform are the rows of the bone matrix
+        skinnedPosition = vec4(position, 1.0) * boneTransform;
+        skinnedNormal = vec4(normal, 0.0) * boneTransform;
+    }
+
+    uint skinnedIndex = instance.firstSkinnedVertex + index;
+    skinned.vertices[skinnedIndex].position = skinnedPosition;
+    skinned.vertices[skinnedIndex].boneIds01 = debugBoneIds.x | (debugBoneIds.y << 16);
+    skinned.vertices[skinnedIndex].normal = normalize(skinnedNormal);
+    skinned.vertices[skinnedIndex].boneIds23 = debugBoneIds.z | (debugBoneIds.w << 16);
+}
@@ -2,40 +2,60 @@
 #extension GL_ARB_separate_shader_objects : enable
 #pragma shader_stage(vertex)
 
-layout(binding = 0) uniform ModelMat{
+struct Instance {
     mat4 model;
-} modelMat;
+    vec4 boundingSphere;
+    uint firstSkinnedVertex;
+    uint firstDraw;
+    uint drawCount;
+    uint batch;
+    uint firstBone;
+};
+
+//Positions and normals are skinned by the skinning compute pass, followed by the bone ids of the asset
+//in 16 bits each, the ids above 0xFFFF are clamped
+struct SkinnedVertex {
+    vec3 position;
+    uint boneIds01;
+    vec3 normal;
+    uint boneIds23;
+};
+
+layout(std430, binding = 0) readonly buffer Instances{
+    Instance instances[];
+};
 
 layout(binding = 1) uniform ViewMat{
     mat4 view;
     mat4 projection;
 } viewMats;
 
-layout(binding = 2) uniform Bones{
-    mat4 matrices[100];
-} bones;
+//Each instance has its own skinned vertices, they are fetched from the first vertex of the instance
+layout(std430, binding = 3) readonly buffer SkinnedVertices{
+    SkinnedVertex skinnedVertices[];
+};
 
+//Visible instances compacted by the culling pass from the first instance of each batch
+layout(std430, binding = 4) readonly buffer VisibleInstances{
+    uint visibleInstances[];
+};
 
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inNormal;
-layout(location = 2) in int inTexId;
-layout(location = 3) in vec2 inTexCoord;
-layout(location = 4) in ivec4 boneIds;
-layout(location = 5) in vec4 weights;
+layout(location = 0) in int inTexId;
+layout(location = 1) in vec2 inTexCoord;
 
 layout(location = 0) out vec2 fragTexCoord;
 layout(location = 1) flat out int texId;
 layout(location = 2) out vec4 outColor;
 
 void main() {
-    mat4 boneTransform = bones.matrices[boneIds[0]] * weights[0];
-    boneTransform += bones.matrices[boneIds[1]] * weights[1];
-    boneTransform += bones.matrices[boneIds[2]] * weights[2];
-    boneTransform += bones.matrices[boneIds[3]] * weights[3];
+    Instance instance = instances[visibleInstances[gl_InstanceIndex]];
+    //gl_VertexIndex includes the vertex offset of the submesh, it is the vertex of the asset
+    SkinnedVertex vertex = skinnedVertices[instance.firstSkinnedVertex + gl_VertexIndex];
 
-    gl_Position = viewMats.projection * viewMats.view * modelMat.model * boneTransform * vec4(inPosition, 1.0);
+    gl_Position = viewMats.projection * viewMats.view * instance.model * vec4(vertex.position, 1.0);
     fragTexCoord = inTexCoord;
     texId = inTexId;
 
+    uvec3 boneIds = uvec3(vertex.boneIds01 & 0xFFFFu, vertex.boneIds01 >> 16, vertex.boneIds23 & 0xFFFFu);
     outColor = vec4(boneIds[0]/46.0f, boneIds[1]/46.0f, boneIds[2]/46.0f, 1.0f);
-}
\ No newline at end of file
+}
@@ -0,0 +1,240 @@
+//
+// Created by cleme on 2020-02-12.
+//
+
+#include <algorithm>
+#include <cmath>
+#include "Animation.hpp"
+
+/**
+ * Binary search of the key that starts the interval containing animationTime.
+ * Used for random seeks, O(log(keys)).
+ */
+uint32_t seekKey(const float *times, uint32_t count, float animationTime){
+    const float *next = std::upper_bound(times + 1, times + count - 1, animationTime);
+    return static_cast<uint32_t>(next - times) - 1;
+}
+
+/**
+ * Move the key forward until its interval contains animationTime.
+ * Used for forward playback, usually zero or one step per frame.
+ */
+uint32_t advanceKey(const float *times, uint32_t count, float animationTime, uint32_t key){
+    while(key + 2 < count && animationTime >= times[key + 1]){
+        key++;
+    }
+
+    return key;
+}
+
+/**
+ * @return the interpolation factor between the key at index and the next one
+ */
+float keyFactor(const float *times, uint32_t index, float animationTime){
+    float deltaTime = times[index + 1] - times[index];
+    if(deltaTime <= 0.0f){
+        return 0.0f;
+    }
+
+    return glm::clamp((animationTime - times[index]) / deltaTime, 0.0f, 1.0f);
+}
+
+/**
+ * Queue the interpolation of a translation or scale track
+ */
+void gatherVector(float animationTime, const std::vector<float> &times, const std::vector<glm::vec3> &values, uint32_t index, uint32_t node, PoseBlend &blend){
+    if(values.size() == 1){
+        float value[3] = {values[0].x, values[0].y, values[0].z};
+        blend.add(node, 0.0f, value, value, 3);
+        return;
+    }
+
+    float from[3] = {values[index].x, values[index].y, values[index].z};
+    float to[3] = {values[index + 1].x, values[index + 1].y, values[index + 1].z};
+    blend.add(node, keyFactor(times.data(), index, animationTime), from, to, 3);
+}
+
+/**
+ * Queue the interpolation of a rotation track, blended with a normalized lerp
+ */
+void gatherRotation(float animationTime, const std::vector<float> &times, const std::vector<glm::quat> &values, uint32_t index, uint32_t node, PoseBlend &blend){
+    if(values.size() == 1){
+        float value[4] = {values[0].x, values[0].y, values[0].z, values[0].w};
+        blend.add(node, 0.0f, value, value, 4);
+        return;
+    }
+
+    float from[4] = {values[index].x, values[index].y, values[index].z, values[index].w};
+    float to[4] = {values[index + 1].x, values[index + 1].y, values[index + 1].z, values[index + 1].w};
+    blend.add(node, keyFactor(times.data(), index, animationTime), from, to, 4);
+}
+
+/**
+ * Blend every track gathered in the pose and write them to its local transforms
+ */
+void blendPose(Pose &pose){
+    blendVectors(pose.translationKeys, pose.translations);
+    blendRotations(pose.rotationKeys, pose.rotations);
+    blendVectors(pose.scaleKeys, pose.scales);
+}
+
+void clearKeys(Pose &pose){
+    pose.translationKeys.clear();
+    pose.rotationKeys.clear();
+    pose.scaleKeys.clear();
+}
+
+/**
+ * Find the key of a track, reusing the key of the previous sample when the time moved forward.
+ */
+uint32_t findKey(const float *times, uint32_t count, float animationTime, uint32_t &key, bool forward){
+    if(count < 2){
+        return 0;
+    }
+
+    key = forward ? advanceKey(times, count, animationTime, key) : seekKey(times, count, animationTime);
+    return key;
+}
+
+/**
+ * Copy the keyframes of an Assimp animation and bind its channels to the nodes of the skeleton
+ */
+AnimationClip::AnimationClip(const aiAnimation *animation, const Skeleton &skeleton){
+    this->name = animation->mName.data;
+    this->duration = static_cast<float>(animation->mDuration);
+    this->ticksPerSecond = animation->mTicksPerSecond != 0 ? static_cast<float>(animation->mTicksPerSecond) : 25.0f;
+
+    for(uint32_t channelIndex = 0 ; channelIndex < animation->mNumChannels ; channelIndex++){
+        const aiNodeAnim *nodeAnim = animation->mChannels[channelIndex];
+
+        int32_t nodeIndex = skeleton.findNode(nodeAnim->mNodeName.data);
+        if(nodeIndex < 0){
+            continue;
+        }
+
+        AnimationChannel channel;
+        channel.nodeIndex = static_cast<uint32_t>(nodeIndex);
+
+        for(uint32_t i = 0 ; i < nodeAnim->mNumPositionKeys ; i++){
+            const aiVectorKey &key = nodeAnim->mPositionKeys[i];
+            channel.positionTimes.push_back(static_cast<float>(key.mTime));
+            channel.positions.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+        }
+
+        for(uint32_t i = 0 ; i < nodeAnim->mNumRotationKeys ; i++){
+            const aiQuatKey &key = nodeAnim->mRotationKeys[i];
+            channel.rotationTimes.push_back(static_cast<float>(key.mTime));
+            channel.rotations.push_back(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+        }
+
+        for(uint32_t i = 0 ; i < nodeAnim->mNumScalingKeys ; i++){
+            const aiVectorKey &key = nodeAnim->mScalingKeys[i];
+            channel.scaleTimes.push_back(static_cast<float>(key.mTime));
+            channel.scales.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+        }
+
+        this->channels.push_back(channel);
+    }
+}
+
+const std::string& AnimationClip::getName() const {
+    return this->name;
+}
+
+float AnimationClip::getDuration() const {
+    return this->duration;
+}
+
+float AnimationClip::getTicksPerSecond() const {
+    return this->ticksPerSecond;
+}
+
+const std::vector<AnimationChannel>& AnimationClip::getChannels() const {
+    return this->channels;
+}
+
+/**
+ * @return the number of bytes used by the keys of the clip
+ */
+size_t AnimationClip::getMemorySize() const {
+    size_t size = sizeof(AnimationClip) + this->channels.size() * sizeof(AnimationChannel);
+    for(const AnimationChannel &channel : this->channels){
+        size += (channel.positionTimes.size() + channel.rotationTimes.size() + channel.scaleTimes.size()) * sizeof(float);
+        size += channel.positions.size() * sizeof(glm::vec3);
+        size += channel.rotations.size() * sizeof(glm::quat);
+        size += channel.scales.size() * sizeof(glm::vec3);
+    }
+
+    return size;
+}
+
+/**
+ * @return the time in ticks inside the clip, the clip is looped
+ */
+float AnimationClip::getAnimationTime(float timeInSeconds) const {
+    return fmod(timeInSeconds * this->ticksPerSecond, this->duration);
+}
+
+/**
+ * Overwrite the local transforms of the animated nodes of the pose.
+ * The keys are found with a binary search, use this for random seeks.
+ */
+void AnimationClip::sample(float animationTime, Pose &pose) const {
+    clearKeys(pose);
+
+    for(const AnimationChannel &channel : this->channels){
+        if(!channel.positions.empty()){
+            uint32_t key = channel.positionTimes.size() < 2 ? 0 : seekKey(channel.positionTimes.data(), static_cast<uint32_t>(channel.positionTimes.size()), animationTime);
+            gatherVector(animationTime, channel.positionTimes, channel.positions, key, channel.nodeIndex, pose.translationKeys);
+        }
+        if(!channel.rotations.empty()){
+            uint32_t key = channel.rotationTimes.size() < 2 ? 0 : seekKey(channel.rotationTimes.data(), static_cast<uint32_t>(channel.rotationTimes.size()), animationTime);
+            gatherRotation(animationTime, channel.rotationTimes, channel.rotations, key, channel.nodeIndex, pose.rotationKeys);
+        }
+        if(!channel.scales.empty()){
+            uint32_t key = channel.scaleTimes.size() < 2 ? 0 : seekKey(channel.scaleTimes.data(), static_cast<uint32_t>(channel.scaleTimes.size()), animationTime);
+            gatherVector(animationTime, channel.scaleTimes, channel.scales, key, channel.nodeIndex, pose.scaleKeys);
+        }
+    }
+
+    blendPose(pose);
+}
+
+/**
+ * Overwrite the local transforms of the animated nodes of the pose.
+ * When the time moved forward since the previous sample with the same cursor
+ * the keys are advanced from where they were, otherwise (first sample, loop
+ * or seek backward) they are found with a binary search.
+ */
+void AnimationClip::sample(float animationTime, Pose &pose, AnimationCursor &cursor) const {
+    bool forward = cursor.clip == this && animationTime >= cursor.lastTime;
+
+    if(cursor.clip != this){
+        cursor.clip = this;
+        cursor.positionKeys.assign(this->channels.size(), 0);
+        cursor.rotationKeys.assign(this->channels.size(), 0);
+        cursor.scaleKeys.assign(this->channels.size(), 0);
+    }
+    cursor.lastTime = animationTime;
+
+    clearKeys(pose);
+
+    for(size_t i = 0 ; i < this->channels.size() ; i++){
+        const AnimationChannel &channel = this->channels[i];
+
+        if(!channel.positions.empty()){
+            uint32_t key = findKey(channel.positionTimes.data(), static_cast<uint32_t>(channel.positionTimes.size()), animationTime, cursor.positionKeys[i], forward);
+            gatherVector(animationTime, channel.positionTimes, channel.positions, key, channel.nodeIndex, pose.translationKeys);
+        }
+        if(!channel.rotations.empty()){
+            uint32_t key = findKey(channel.rotationTimes.data(), static_cast<uint32_t>(channel.rotationTimes.size()), animationTime, cursor.rotationKeys[i], forward);
+            gatherRotation(animationTime, channel.rotationTimes, channel.rotations, key, channel.nodeIndex, pose.rotationKeys);
+        }
+        if(!channel.scales.empty()){
+            uint32_t key = findKey(channel.scaleTimes.data(), static_cast<uint32_t>(channel.scaleTimes.size()), animationTime, cursor.scaleKeys[i], forward);
+            gatherVector(animationTime, channel.scaleTimes, channel.scales, key, channel.nodeIndex, pose.scaleKeys);
+        }
+    }
+
+    blendPose(pose);
+}
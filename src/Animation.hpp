@@ -0,0 +1,77 @@
+//
+// Created by cleme on 2020-02-12.
+//
+
+#ifndef GAME_ENGINE_ANIMATION_HPP
+#define GAME_ENGINE_ANIMATION_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <assimp/anim.h>
+#include "Skeleton.hpp"
+
+/**
+ * Keyframes of one animated node. Times are in ticks.
+ */
+struct AnimationChannel {
+    uint32_t nodeIndex = 0;
+
+    std::vector<float> positionTimes;
+    std::vector<glm::vec3> positions;
+
+    std::vector<float> rotationTimes;
+    std::vector<glm::quat> rotations;
+
+    std::vector<float> scaleTimes;
+    std::vector<glm::vec3> scales;
+};
+
+/**
+ * Keys used by the previous sample of every track of a clip.
+ * Kept by each model so that forward playback only advances the keys
+ * instead of searching them again every frame.
+ */
+struct AnimationCursor {
+    //Clip that was sampled with the cursor, raw or compressed
+    const void *clip = nullptr;
+    float lastTime = 0.0f;
+    //Skipped channels of the previous sample, their keys are not up to date
+    uint32_t minimumHeight = 0;
+    std::vector<uint32_t> positionKeys;
+    std::vector<uint32_t> rotationKeys;
+    std::vector<uint32_t> scaleKeys;
+};
+
+class AnimationClip {
+private:
+    std::string name;
+    float duration;
+    float ticksPerSecond;
+    std::vector<AnimationChannel> channels;
+
+public:
+    AnimationClip(const aiAnimation *animation, const Skeleton &skeleton);
+
+    const std::string& getName() const;
+    float getDuration() const;
+    float getTicksPerSecond() const;
+    const std::vector<AnimationChannel>& getChannels() const;
+    size_t getMemorySize() const;
+
+    float getAnimationTime(float timeInSeconds) const;
+    void sample(float animationTime, Pose &pose) const;
+    void sample(float animationTime, Pose &pose, AnimationCursor &cursor) const;
+};
+
+//Key search and blending shared by the clip samplers
+uint32_t seekKey(const float *times, uint32_t count, float animationTime);
+uint32_t findKey(const float *times, uint32_t count, float animationTime, uint32_t &key, bool forward);
+float keyFactor(const float *times, uint32_t index, float animationTime);
+void clearKeys(Pose &pose);
+void blendPose(Pose &pose);
+
+
+#endif //GAME_ENGINE_ANIMATION_HPP
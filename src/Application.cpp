@@ -2,38 +2,33 @@
 // Created by cleme on 2020-02-03.
 //
 #include <vector>
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <cmath>
+#include <exception>
 #include <zconf.h>
 #include "../include/helper/FileHelper.hpp"
 #include "Application.hpp"
+#include "ModelAsset.hpp"
 #include "glm/ext.hpp"
 #include <unistd.h>
 
 const int WIDTH = 1600;
 const int HEIGHT = 1200;
-const int MAX_FRAMES_IN_FLIGHT = 2;
 const int MAX_FRAME_RATE = 300;
-
-void* alignedAlloc(size_t size, size_t alignment)
-{
-    void *data = nullptr;
-#if defined(_MSC_VER) || defined(__MINGW32__)
-    data = _aligned_malloc(size, alignment);
-#else
-    int res = posix_memalign(&data, alignment, size);
-	if (res != 0)
-		data = nullptr;
-#endif
-    return data;
-}
-
-void alignedFree(void* data)
-{
-#if	defined(_MSC_VER) || defined(__MINGW32__)
-    _aligned_free(data);
-#else
-    free(data);
-#endif
-}
+//Frames drawn before the run stats are measured, while the caches and the GPU clocks warm up
+const uint32_t RUN_WARMUP_FRAMES = 60;
+//Distance between two instances of the grid
+const float INSTANCE_SPACING = 50.0f;
+//Pipelines of the skinning, culling and depth pyramid passes, created with the graphics pipelines
+const uint32_t COMPUTE_PIPELINE_COUNT = 3;
+//Bytes of every frame of the ring buffer left for the data allocated during the frame
+const VkDeviceSize FRAME_STREAMING_SIZE = 64 * 1024;
+//Bytes of the staging ring of the uploads, the larger uploads get their own staging buffer
+const VkDeviceSize UPLOAD_STAGING_SIZE = 64 * 1024 * 1024;
+//Pipeline cache written at shutdown, next to the shaders it was built from
+const std::string PIPELINE_CACHE_PATH = "./shaders/build/pipelines.cache";
 
 
 const std::vector<const char*> validationLayers = {
@@ -56,7 +51,8 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
     return VK_FALSE;
 }
 
-VkSurfaceKHR surface;
+//No surface when the pipelines are created without a window
+VkSurfaceKHR surface = VK_NULL_HANDLE;
 const std::vector<const char*> deviceExtensionsRequired = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
@@ -91,10 +87,22 @@ VkShaderModule createShaderModule(VkDevice *device, const std::vector<char>& cod
     return shaderModule;
 }
 
+Application::Application(const ApplicationSettings &settings){
+    this->settings = settings;
+    this->occlusionCulling = settings.occlusionCulling;
+}
+
 double Application::clockToMilliseconds(clock_t ticks){
     return (ticks / (double)CLOCKS_PER_SEC) * 1000.0;
 }
 
+/**
+ * @return true when the frame being drawn counts in the run stats
+ */
+bool Application::isMeasuring() const {
+    return this->settings.frameCount > 0 && this->frameIndex >= RUN_WARMUP_FRAMES;
+}
+
 void Application::initWindow(){
     glfwInit();
 
@@ -114,20 +122,79 @@ void Application::initWindow(){
 }
 
 void Application::mainLoop() {
-    while(!glfwWindowShouldClose(this->window)){
+    while(!glfwWindowShouldClose(this->window) && (this->settings.frameCount == 0 || this->frameIndex < this->settings.frameCount)){
         glfwPollEvents();
 
         if(glfwGetKey(this->window, GLFW_KEY_ESCAPE) == GLFW_PRESS){
             glfwSetWindowShouldClose(this->window, GLFW_TRUE);
         }
 
+        //The second culling phase is recorded in the command buffers, they are recorded again when toggled
+        bool occlusionKeyPressed = glfwGetKey(this->window, GLFW_KEY_O) == GLFW_PRESS;
+        if(occlusionKeyPressed && !this->occlusionKeyPressed){
+            this->occlusionCulling = !this->occlusionCulling;
+            vkDeviceWaitIdle(this->device);
+            vkFreeCommandBuffers(this->device, this->commandPool, static_cast<uint32_t>(this->commandBuffers.size()), this->commandBuffers.data());
+            this->createCommandBuffers();
+        }
+        this->occlusionKeyPressed = occlusionKeyPressed;
+
         double startTime = glfwGetTime();
         this->drawFrame();
         double deltaTime = glfwGetTime() - startTime;
 
-        float shouldWaitTime = (1.0/(double)MAX_FRAME_RATE) - deltaTime;
+        if(this->isMeasuring()){
+            this->runStats.frameCount++;
+            this->runStats.frameTime += deltaTime;
+        }
+        this->frameIndex++;
+
+        this->nbFrames++;
+        if(startTime - this->lastTime >= 1.0){
+            printf("%d fps, animation update %.3f ms (%u threads, %zu models)\n",
+                   this->nbFrames,
+                   this->animationTime * 1000.0 / this->nbFrames,
+                   this->threadPool->getThreadCount(),
+                   this->models.size());
+            for(uint32_t lod = 0 ; lod < ANIMATION_LOD_COUNT ; lod++){
+                const AnimationLodStats &stats = this->animationLodStats[lod];
+                printf("    LOD %u: %.1f models, %.1f evaluations, %.3f ms per frame\n",
+                       lod,
+                       (double)stats.models / this->nbFrames,
+                       (double)stats.evaluations / this->nbFrames,
+                       stats.evaluationTime * 1000.0 / this->nbFrames);
+            }
+            if(this->nbGpuFrames > 0){
+                printf("    GPU %.3f ms, occlusion culling %s: %.1f drawn in the first phase, %.1f in the second phase, "
+                       "%.1f frustum culled, %.1f occlusion culled\n",
+                       this->gpuTime / this->nbGpuFrames,
+                       this->occlusionCulling ? "on" : "off",
+                       (double)this->cullingStats.firstPhaseDrawn / this->nbGpuFrames,
+                       (double)this->cullingStats.secondPhaseDrawn / this->nbGpuFrames,
+                       (double)this->cullingStats.frustumCulled / this->nbGpuFrames,
+                       (double)this->cullingStats.occlusionCulled / this->nbGpuFrames);
+            }
+            if(this->modeGpuFrames[0] > 0 && this->modeGpuFrames[1] > 0){
+                printf("    GPU since the start with %zu instances: %.3f ms with occlusion culling, %.3f ms without\n",
+                       this->models.size(),
+                       this->modeGpuTime[1] / this->modeGpuFrames[1],
+                       this->modeGpuTime[0] / this->modeGpuFrames[0]);
+            }
+            this->animationLodStats = {};
+            this->cullingStats = {};
+            this->gpuTime = 0.0;
+            this->nbGpuFrames = 0;
+            this->nbFrames = 0;
+            this->animationTime = 0.0;
+            this->lastTime = startTime;
+        }
+
+        //The runs with a frame count measure the frames, they are not capped
+        if(this->settings.frameCount == 0){
+            float shouldWaitTime = (1.0/(double)MAX_FRAME_RATE) - deltaTime;
 
-        std::this_thread::sleep_for(std::chrono::milliseconds((int)(shouldWaitTime * 1000)));
+            std::this_thread::sleep_for(std::chrono::milliseconds((int)(shouldWaitTime * 1000)));
+        }
     }
 
     vkDeviceWaitIdle(this->device);
@@ -150,10 +217,12 @@ void Application::drawFrame(){
     //Check if a previous frame is using this image
     if(this->imagesInFlight[imageIndex] != VK_NULL_HANDLE){
         vkWaitForFences(this->device, 1, &this->imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+        this->readFrameStats(imageIndex);
     }
 
     //Mark the image as being use by the frame
     this->imagesInFlight[imageIndex] = this->inFlightFences[this->currentFrame];
+    this->imageOcclusionCulling[imageIndex] = this->occlusionCulling;
 
     this->updateUniformBuffer(imageIndex);
 
@@ -173,6 +242,10 @@ void Application::drawFrame(){
 
     vkResetFences(this->device, 1, &this->inFlightFences[this->currentFrame]);
 
+    //The uploads recorded since the last frame are submitted before it, and the finished ones retired
+    this->uploadManager.flush();
+    this->uploadManager.poll();
+
     if(vkQueueSubmit(this->graphicsQueue, 1, &submitInfo, this->inFlightFences[currentFrame]) != VK_SUCCESS){
         throw std::runtime_error("Failed to submit draw command buffer.");
     }
@@ -197,6 +270,42 @@ void Application::drawFrame(){
     this->currentFrame = (this->currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
+/**
+ * Accumulate the culling stats and the GPU time of the last frame rendered with the image, must be called once its fence is signaled
+ */
+void Application::readFrameStats(uint32_t imageIndex){
+    CullingStats stats = this->cullingPass.getStats(imageIndex);
+    this->cullingStats.frustumCulled += stats.frustumCulled;
+    this->cullingStats.occlusionCulled += stats.occlusionCulled;
+    this->cullingStats.firstPhaseDrawn += stats.firstPhaseDrawn;
+    this->cullingStats.secondPhaseDrawn += stats.secondPhaseDrawn;
+    if(this->isMeasuring()){
+        this->runStats.cullingFrameCount++;
+        this->runStats.culling.frustumCulled += stats.frustumCulled;
+        this->runStats.culling.occlusionCulled += stats.occlusionCulled;
+        this->runStats.culling.firstPhaseDrawn += stats.firstPhaseDrawn;
+        this->runStats.culling.secondPhaseDrawn += stats.secondPhaseDrawn;
+    }
+
+    if(this->timestampsSupported){
+        std::array<uint64_t, 2> timestamps = {};
+        if(vkGetQueryPoolResults(this->device, this->timestampQueryPool, imageIndex * 2, 2,
+                                 sizeof(uint64_t) * timestamps.size(), timestamps.data(), sizeof(uint64_t),
+                                 VK_QUERY_RESULT_64_BIT) == VK_SUCCESS){
+            double frameGpuTime = (double)(timestamps[1] - timestamps[0]) * this->timestampPeriod / 1000000000.0;
+            this->gpuTime += frameGpuTime * 1000.0;
+            uint32_t mode = this->imageOcclusionCulling[imageIndex] ? 1 : 0;
+            this->modeGpuTime[mode] += frameGpuTime * 1000.0;
+            this->modeGpuFrames[mode]++;
+            if(this->isMeasuring()){
+                this->runStats.gpuFrameCount++;
+                this->runStats.gpuTime += frameGpuTime;
+            }
+        }
+    }
+    this->nbGpuFrames++;
+}
+
 void Application::updateUniformBuffer(uint32_t currentImage) {
     static auto startTime = std::chrono::high_resolution_clock::now();
 
@@ -209,48 +318,54 @@ void Application::updateUniformBuffer(uint32_t currentImage) {
     projview.proj[1][1] *= -1;
 
 
-    //Send the model matrix as uniform
-    for(size_t i = 0 ; i < this->models.size() ; i++){
-        Model *model = this->models[i];
-        glm::mat4 *modelMat = (glm::mat4*)(((uint64_t)uboInstance.model + (i * this->uniformDynamicAlignment)));
-        glm::mat4 *boneMatrix = (glm::mat4*)(((uint64_t)this->boneMatrices.transforms) + (i * 100 * this->uniformDynamicAlignment));
-
-        *modelMat = model->getModelMatrix();
-
-        std::vector<glm::mat4> boneTransforms(100);
-        model->getBoneTransforms(time, boneTransforms);
-
-        for(size_t boneIndex = 0 ; boneIndex < 100 ; boneIndex++){
-            if(boneIndex < boneTransforms.size()) {
-                boneMatrix[boneIndex] = boneTransforms[boneIndex];
-            }else{
-                boneMatrix[boneIndex] = glm::mat4(1.0f);
-            }
+    //The frame of the image is written in place, the GPU is done with it
+    this->frameRingBuffer.beginFrame(currentImage);
+
+    //Instance data, in the order of the instance batches
+    InstanceData *instances = (InstanceData*)this->frameRingBuffer.getData(this->instanceSlice);
+    for(uint32_t batchIndex = 0 ; batchIndex < this->instanceBatches.size() ; batchIndex++){
+        const InstanceBatch &batch = this->instanceBatches[batchIndex];
+        glm::vec4 boundingSphere = batch.asset->getBoundingSphere();
+        for(uint32_t i = batch.firstInstance ; i < batch.firstInstance + batch.instanceCount ; i++){
+            uint32_t modelIndex = this->instanceModels[i];
+            instances[i].model = this->models[modelIndex]->getModelMatrix();
+            instances[i].boundingSphere = boundingSphere;
+            instances[i].firstSkinnedVertex = this->skinningPass.getSkinnedVertexOffset(modelIndex, static_cast<uint32_t>(this->currentFrame));
+            instances[i].firstDraw = batch.firstDraw;
+            instances[i].drawCount = batch.drawCount;
+            instances[i].batch = batchIndex;
+            instances[i].firstBone = this->bonePaletteOffsets[modelIndex];
         }
     }
 
-    //Copy data to buffer
-    void *data;
-    size_t boneMatricesBufferSize = this->models.size() * 100 * this->uniformDynamicAlignment;
-    size_t modelMatrixBuffersize = this->models.size() * this->uniformDynamicAlignment;
-    size_t viewMatricesBufferSize = sizeof(CameraMatrices);
+    //Evaluate the animations on the worker threads, straight into the bone palette buffer
+    double animationStartTime = glfwGetTime();
 
-    //Camera matrices data
-    vkMapMemory(this->device, this->cameraUniformBufferMemory[currentImage], 0, viewMatricesBufferSize, 0, &data);
-    memcpy(data, &projview, viewMatricesBufferSize);
-    vkUnmapMemory(this->device, this->cameraUniformBufferMemory[currentImage]);
+    void *boneData = this->frameRingBuffer.getData(this->bonePaletteSlice);
+    glm::vec3 cameraPosition = this->camera.getPosition();
+    this->threadPool->parallelFor(static_cast<uint32_t>(this->models.size()), [&](uint32_t begin, uint32_t end){
+        for(uint32_t i = begin ; i < end ; i++){
+            AffineTransform *palette = (AffineTransform*)boneData + this->bonePaletteOffsets[i];
+            this->models[i]->getBoneTransforms(time, cameraPosition, this->animationFrame + i, palette);
+        }
+    });
+    this->animationFrame++;
 
+    for(Model *model : this->models){
+        AnimationLodStats &stats = this->animationLodStats[model->getLodLevel()];
+        stats.models++;
+        stats.evaluations += model->wasEvaluated() ? 1 : 0;
+        stats.evaluationTime += model->getEvaluationTime();
+    }
 
-    void *data2;
-    //Model matrices data
-    vkMapMemory(this->device, this->modelUniformBufferMemory[currentImage], 0, modelMatrixBuffersize, 0, &data2);
-    memcpy(data2, &this->uboInstance.model[0], modelMatrixBuffersize);
-    vkUnmapMemory(this->device, modelUniformBufferMemory[currentImage]);
+    double animationUpdateTime = glfwGetTime() - animationStartTime;
+    this->animationTime += animationUpdateTime;
+    if(this->isMeasuring()){
+        this->runStats.animationTime += animationUpdateTime;
+    }
 
-    //Bone matrices data
-    vkMapMemory(this->device, this->boneUniformBufferMemory[currentImage], 0, boneMatricesBufferSize, 0, &data2);
-    memcpy(data2, &this->boneMatrices.transforms[0], boneMatricesBufferSize);
-    vkUnmapMemory(this->device, boneUniformBufferMemory[currentImage]);
+    //Camera matrices data
+    memcpy(this->frameRingBuffer.getData(this->cameraSlice), &projview, sizeof(CameraMatrices));
 }
 
 
@@ -260,36 +375,94 @@ void Application::initVulkan() {
     this->createSurface();
     this->pickPhysicalDevice();
     this->createLogicalDevice();
+    this->memoryAllocator = MemoryAllocator(this->physicalDevice, this->device);
+    this->pipelineCache = PipelineCache(this->physicalDevice, this->device);
+    this->pipelineCache.load(PIPELINE_CACHE_PATH);
     this->createSwapChain();
     this->createImageViews();
     this->createRenderPass();
     this->createDescriptorSetLayout();
     this->createCommandPool();
+    this->createUploadManager();
+    this->threadPool = std::make_unique<ThreadPool>(this->settings.workerThreadCount);
     printf("1\n");
-    this->models = {
-            new Model(this, this->device),
-//            new Model(this, this->device, glm::vec3(0.0f, 0.0f, 50.0f)),
-//            new Model(this, this->device, glm::vec3(50.0f, 0.0f, 0.0f)),
-//            new Model(this, this->device, glm::vec3(50.0f, 0.0f, 50.0f))
-    };
+    this->assetManager = AssetManager(this, this->device);
+    std::shared_ptr<ModelAsset> man = this->assetManager.loadModel("../models/man/BaseMesh_Anim.fbx", VertexFormat::Packed, this->settings.meshOptimization);
+//    std::shared_ptr<ModelAsset> elf = this->assetManager.loadModel("../models/elf/Elf01_Stand.obj");
+    this->assetManager.importModels(*this->threadPool);
+    //The instances fill a square grid, the first one at the origin
+    uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(this->settings.instanceCount))));
+    for(uint32_t i = 0 ; i < this->settings.instanceCount ; i++){
+        this->models.push_back(new Model(man, glm::vec3((i % gridSize) * INSTANCE_SPACING, 0.0f, (i / gridSize) * INSTANCE_SPACING)));
+    }
 
     this->createVertexBuffers();
+    this->createInstanceBatches();
     this->createUniformBuffers();
-    this->createGraphicsPipeline();
+    this->skinningPass = SkinningPass(this, this->device);
+    this->hiZPass = HiZPass(this, this->device);
+    this->cullingPass = CullingPass(this, this->device);
+    this->createPipelines();
+    this->skinningPass.init(this->models, this->instanceBatches, this->vertexBuffer);
     this->createColorResources();
     this->createDepthResources();
     this->createFrameBuffers();
+    //The depth pyramid is built from the depth attachment, the culling pass tests the instances against it
+    this->hiZPass.init(this->depthImageView, this->swapChainExtent);
+    this->cullingPass.init(this->batchDraws, static_cast<uint32_t>(this->instanceBatches.size()), static_cast<uint32_t>(this->instanceModels.size()), this->skinningPass, this->hiZPass);
+    this->createTimestampQueryPool();
 
     //Init the models
-    for(Model *model : this->models){
-        model->init();
-    }
+    this->assetManager.init();
+    this->memoryAllocator.printStats();
 
 
     this->createCommandBuffers();
     this->createSyncObjects();
 }
 
+/**
+ * Create the device and the pipelines without a window, with the pipeline cache of the given file.
+ * The creation time is reported in the run stats and the cache is saved back to the file.
+ */
+void Application::createPipelinesHeadless(const std::string &cachePath){
+    this->createInstance();
+    this->setupDebugMessenger();
+    this->pickPhysicalDevice();
+    this->createLogicalDevice();
+    this->pipelineCache = PipelineCache(this->physicalDevice, this->device);
+    this->pipelineCache.load(cachePath);
+    //Usual format of the swap chain, the render pass only has to be compatible with the pipelines
+    this->swapChainImageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+    this->createRenderPass();
+    this->createDescriptorSetLayout();
+    this->threadPool = std::make_unique<ThreadPool>(this->settings.workerThreadCount);
+    this->skinningPass = SkinningPass(this, this->device);
+    this->hiZPass = HiZPass(this, this->device);
+    this->cullingPass = CullingPass(this, this->device);
+    this->createPipelines();
+
+    this->skinningPass.cleanupPipeline();
+    this->cullingPass.cleanupPipeline();
+    this->hiZPass.cleanupPipeline();
+    for(VkPipeline pipeline : this->graphicsPipelines){
+        vkDestroyPipeline(this->device, pipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(this->device, this->pipelineLayout, nullptr);
+    vkDestroyRenderPass(this->device, this->renderPass, nullptr);
+    vkDestroyRenderPass(this->device, this->secondPhaseRenderPass, nullptr);
+    vkDestroyDescriptorSetLayout(this->device, this->descriptorSetLayout, nullptr);
+    this->threadPool.reset();
+
+    this->pipelineCache.save(cachePath);
+    this->pipelineCache.cleanup();
+    vkDestroyDevice(this->device, nullptr);
+    if(enableValidationLayers) {
+        DestroyDebugUtilsMessengerEXT(this->instance, this->debugMessenger, nullptr);
+    }
+    vkDestroyInstance(this->instance, nullptr);
+}
+
 void Application::createInstance(){
     if(enableValidationLayers && !this->checkValidationLayerSupport()){
         throw std::runtime_error("Validation layers requested, but not available !");
@@ -352,23 +525,27 @@ void Application::pickPhysicalDevice(){
     }
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(this->instance, &deviceCount, devices.data());
+
+    //Prefer a discrete GPU, but any suitable device works (integrated GPUs, lavapipe...)
     for(const auto& device : devices){
-        if(this->isDeviceSuitable(device)){
+        if(!this->isDeviceSuitable(device)){
+            continue;
+        }
+
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(device, &deviceProperties);
+        if(this->physicalDevice == VK_NULL_HANDLE || deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU){
             this->physicalDevice = device;
-            this->msaaSamples = this->getMaxUsableSampleCount();
-            break;
         }
     }
 
     if(this->physicalDevice == VK_NULL_HANDLE){
         throw std::runtime_error("Failed to find a suitable GPU.");
     }
+    this->msaaSamples = this->getMaxUsableSampleCount();
 }
 
 bool Application::isDeviceSuitable(VkPhysicalDevice device){
-
-    VkPhysicalDeviceProperties deviceProperties;
-    vkGetPhysicalDeviceProperties(device, &deviceProperties);
     VkPhysicalDeviceFeatures deviceFeatures;
     vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
 
@@ -376,18 +553,17 @@ bool Application::isDeviceSuitable(VkPhysicalDevice device){
 
     bool extensionsSupported = this->checkDeviceExtensionSupport(device);
 
-    bool swapChainAdequate = false;
-    if(extensionsSupported){
+    bool swapChainAdequate = surface == VK_NULL_HANDLE;
+    if(extensionsSupported && surface != VK_NULL_HANDLE){
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
 
-    return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU
-           && deviceFeatures.geometryShader
-           && indices.isComplete()
+    return indices.isComplete()
            && extensionsSupported
            && swapChainAdequate
-           && deviceFeatures.samplerAnisotropy;
+           && deviceFeatures.samplerAnisotropy
+           && deviceFeatures.drawIndirectFirstInstance;
 }
 
 SwapChainSupportDetails Application::querySwapChainSupport(VkPhysicalDevice device){
@@ -442,26 +618,35 @@ QueueFamilyIndices Application::findQueueFamilies(VkPhysicalDevice device){
         if((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT)
            && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)){
             //Transfer queue
-            indices.transferFamily = i;
+            if(!indices.transferFamily.has_value()){
+                indices.transferFamily = i;
+            }
         } else{
-            if(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT){
+            //The skinning pass is dispatched on the graphics queue
+            if((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+               && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)
+               && !indices.graphicsFamiliy.has_value()){
                 indices.graphicsFamiliy = i;
             }
-            VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-            if(presentSupport){
+            //Without a surface nothing is presented, the graphics queue stands for the present queue
+            VkBool32 presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+            if(surface != VK_NULL_HANDLE){
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+            }
+            if(presentSupport && !indices.presentFamily.has_value()){
                 indices.presentFamily = i;
             }
         }
 
 
-        if(indices.isComplete()){
-            break;
-        }
-
         i++;
     }
 
+    //Devices without a dedicated transfer queue transfer on the graphics queue
+    if(!indices.transferFamily.has_value()){
+        indices.transferFamily = indices.graphicsFamiliy;
+    }
+
     return indices;
 }
 
@@ -481,17 +666,39 @@ void Application::createLogicalDevice(){
     }
 
 
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(this->physicalDevice, &supportedFeatures);
+
     VkPhysicalDeviceFeatures  deviceFeatures = {};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
     deviceFeatures.sampleRateShading = VK_TRUE;
+    //The draws of a batch start at the first instance of the batch
+    deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    this->multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect == VK_TRUE;
+
+    //The draw count of the batches is read from the culling output when the device supports it
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(this->physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(this->physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+    std::vector<const char*> deviceExtensions(deviceExtensionsRequired.begin(), deviceExtensionsRequired.end());
+    bool drawIndirectCountSupported = false;
+    for(const auto& extension : availableExtensions){
+        if(strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0){
+            deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+            drawIndirectCountSupported = true;
+        }
+    }
 
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensionsRequired.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensionsRequired.data();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
     if(enableValidationLayers){
         createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -504,6 +711,10 @@ void Application::createLogicalDevice(){
         throw std::runtime_error("Failed to create logical device.");
     }
 
+    if(drawIndirectCountSupported){
+        this->cmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR) vkGetDeviceProcAddr(this->device, "vkCmdDrawIndexedIndirectCountKHR");
+    }
+
     vkGetDeviceQueue(this->device, indices.graphicsFamiliy.value(), 0, &this->graphicsQueue);
     vkGetDeviceQueue(this->device, indices.presentFamily.value(), 0, &this->presentQueue);
     vkGetDeviceQueue(this->device, indices.transferFamily.value(), 0, &this->transferQueue);
@@ -511,14 +722,16 @@ void Application::createLogicalDevice(){
 
 /**
  * Get the list of required extensions
- * @return the list of required extensions by GLFW
+ * @return the list of required extensions by GLFW, none without a window
  */
 std::vector<const char*> Application::getRequiredExtensions() {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    std::vector<const char*> extensions;
+    if(this->window != nullptr){
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (enableValidationLayers) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -564,11 +777,16 @@ void Application::createSwapChain() {
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    //The previous swap chain is retired on resize, the presentation engine can reuse its resources
+    VkSwapchainKHR oldSwapChain = this->swapChain;
+    createInfo.oldSwapchain = oldSwapChain;
 
     if(vkCreateSwapchainKHR(device, &createInfo, nullptr, &this->swapChain) != VK_SUCCESS){
         throw std::runtime_error("Failed to create swap chain.");
     }
+    if(oldSwapChain != VK_NULL_HANDLE){
+        vkDestroySwapchainKHR(this->device, oldSwapChain, nullptr);
+    }
 
     vkGetSwapchainImagesKHR(device, this->swapChain, &imageCount, nullptr);
     this->swapChainImages.resize(imageCount);
@@ -652,7 +870,8 @@ bool Application::checkValidationLayerSupport(){
 }
 
 /**
- * Create the render pass
+ * Create the render pass and the render pass of the second culling phase, which loads the attachments
+ * drawn by the first one. The depth is left readable by the depth pyramid build between them.
  */
 void Application::createRenderPass(){
     VkAttachmentDescription colorAttachment = {};
@@ -679,11 +898,11 @@ void Application::createRenderPass(){
     depthAttachment.format = this->findDepthFormat();
     depthAttachment.samples = this->msaaSamples;
     depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
     VkAttachmentReference colorAttachmentRef = {};
     colorAttachmentRef.attachment = 0;
@@ -704,13 +923,22 @@ void Application::createRenderPass(){
     subpass.pDepthStencilAttachment = &depthAttachmentRef;
     subpass.pResolveAttachments = &colorAttachmentResolveRef;
 
-    VkSubpassDependency dependency = {};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    //The attachments are written by the previous pass and the depth is read by the depth pyramid build
+    std::array<VkSubpassDependency, 2> dependencies = {};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
     std::array<VkAttachmentDescription, 3> attachments = {colorAttachment, depthAttachment, colorAttachmentResolve};
 
@@ -720,23 +948,33 @@ void Application::createRenderPass(){
     renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
 
 
     if(vkCreateRenderPass(this->device, &renderPassInfo, nullptr, &this->renderPass) != VK_SUCCESS){
         throw std::runtime_error("Failed to create render pass.");
     }
+
+    //The second phase draws over the color and depth of the first one
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    if(vkCreateRenderPass(this->device, &renderPassInfo, nullptr, &this->secondPhaseRenderPass) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create second phase render pass.");
+    }
 }
 
 void Application::createDescriptorSetLayout(){
-    VkDescriptorSetLayoutBinding modelLayoutBinding = {};
-    //Model matrix
-    modelLayoutBinding.binding = 0;
-    modelLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-    modelLayoutBinding.descriptorCount = 1;
-    modelLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    modelLayoutBinding.pImmutableSamplers = nullptr;
+    VkDescriptorSetLayoutBinding instanceLayoutBinding = {};
+    //Instance data, indexed by gl_InstanceIndex
+    instanceLayoutBinding.binding = 0;
+    instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    instanceLayoutBinding.descriptorCount = 1;
+    instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    instanceLayoutBinding.pImmutableSamplers = nullptr;
 
     //Camera matrices
     VkDescriptorSetLayoutBinding viewMatricesBinding = {};
@@ -746,22 +984,30 @@ void Application::createDescriptorSetLayout(){
     viewMatricesBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     viewMatricesBinding.pImmutableSamplers = nullptr;
 
-    VkDescriptorSetLayoutBinding bonesLayoutBinding = {};
-    bonesLayoutBinding.binding = 2;
-    bonesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    bonesLayoutBinding.descriptorCount = 1;
-    bonesLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    bonesLayoutBinding.pImmutableSamplers = nullptr;
-
     VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
-    samplerLayoutBinding.binding = 3;
+    samplerLayoutBinding.binding = 2;
     samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    samplerLayoutBinding.descriptorCount = 8;
+    samplerLayoutBinding.descriptorCount = MAX_MODEL_TEXTURES;
     samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     samplerLayoutBinding.pImmutableSamplers = nullptr;
 
+    //Skinned vertices of every instance, fetched by the vertex shader
+    VkDescriptorSetLayoutBinding skinnedVerticesBinding = {};
+    skinnedVerticesBinding.binding = 3;
+    skinnedVerticesBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    skinnedVerticesBinding.descriptorCount = 1;
+    skinnedVerticesBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    skinnedVerticesBinding.pImmutableSamplers = nullptr;
+
+    //Indices of the visible instances, written by the culling pass
+    VkDescriptorSetLayoutBinding visibleInstancesBinding = {};
+    visibleInstancesBinding.binding = 4;
+    visibleInstancesBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    visibleInstancesBinding.descriptorCount = 1;
+    visibleInstancesBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    visibleInstancesBinding.pImmutableSamplers = nullptr;
 
-    std::array<VkDescriptorSetLayoutBinding, 4> bindings = {modelLayoutBinding, viewMatricesBinding, bonesLayoutBinding, samplerLayoutBinding};
+    std::array<VkDescriptorSetLayoutBinding, 5> bindings = {instanceLayoutBinding, viewMatricesBinding, samplerLayoutBinding, skinnedVerticesBinding, visibleInstancesBinding};
 
     VkDescriptorSetLayoutCreateInfo layoutInfo = {};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -774,106 +1020,134 @@ void Application::createDescriptorSetLayout(){
 }
 
 void Application::createVertexBuffers() {
-    for(Model *model : this->models){
-        for(Vertex vertex : model->getVertices()){
-            vertices.push_back(vertex);
-        }
-        for(uint32_t index : model->getIndices()){
-            indices.push_back(index);
-        }
+    //The geometry of an asset is uploaded once, whatever its number of instances
+    //The assets can use different vertex formats, their vertices are placed by byte offset
+    std::vector<ModelAsset*> assets = this->assetManager.getModelAssets();
+    VkDeviceSize vertexBufferSize = 0;
+    this->nbIndices = 0;
+    for(ModelAsset *asset : assets){
+        asset->setGeometryOffsets(vertexBufferSize, this->nbIndices);
+        vertexBufferSize += static_cast<VkDeviceSize>(asset->getVertexSize()) * asset->getVertexCount();
+        this->nbIndices += asset->getIndexCount();
     }
+    this->indexBufferOffset = vertexBufferSize;
 
-    VkDeviceSize vertexBufferSize = sizeof(vertices[0]) * vertices.size();
-    VkDeviceSize indexBufferSize = sizeof(uint32_t) * indices.size();
-
-    this->nbVertices = vertices.size();
-    this->nbIndices = indices.size();
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-
+    VkDeviceSize indexBufferSize = sizeof(uint32_t) * this->nbIndices;
 
     //To CPU
-    this->createBuffer(vertexBufferSize + indexBufferSize,
-                              VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                              stagingBuffer,
-                              stagingBufferMemory);
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, vertexBufferSize, 0, &data);
-    memcpy(data, vertices.data(), (size_t)vertexBufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
-
-    //Add the index data after vertex data
-    vkMapMemory(device, stagingBufferMemory, vertexBufferSize, indexBufferSize, 0, &data);
-    memcpy(data, indices.data(), (size_t)indexBufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    StagingRange staging = this->uploadManager.stage(vertexBufferSize + indexBufferSize);
+
+    //The data of the assets is copied as is, straight from the mapped cache file for cached assets.
+    //The index data is added after the vertex data
+    char *vertexData = static_cast<char*>(staging.data);
+    char *indexData = vertexData + vertexBufferSize;
+    for(ModelAsset *asset : assets){
+        memcpy(vertexData + asset->getVertexOffset(), asset->getVertexData(), static_cast<size_t>(asset->getVertexSize()) * asset->getVertexCount());
+        memcpy(indexData + sizeof(uint32_t) * asset->getFirstIndex(), asset->getIndexData(), sizeof(uint32_t) * asset->getIndexCount());
+    }
 
     //To GPU
     this->createBuffer(vertexBufferSize + indexBufferSize,
-                              VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                              VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                               this->vertexBuffer,
                               this->vertexBufferMemory);
 
-    this->copyBuffer(stagingBuffer, this->vertexBuffer, vertexBufferSize + indexBufferSize);
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = staging.offset;
+    copyRegion.dstOffset = 0;
+    copyRegion.size = vertexBufferSize + indexBufferSize;
+    vkCmdCopyBuffer(this->uploadManager.getTransferCommandBuffer(), staging.buffer, this->vertexBuffer, 1, &copyRegion);
+    //Read as vertex and index data by the draws and as storage data by the skinning pass
+    this->uploadManager.releaseBuffer(this->vertexBuffer,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+}
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+/**
+ * Group the models by asset, the instances of an asset are consecutive in the instance buffer
+ * and drawn with one instanced draw per submesh. The batches are sorted by vertex format so
+ * that each graphics pipeline is bound once.
+ */
+void Application::createInstanceBatches(){
+    this->instanceModels.resize(this->models.size());
+    std::iota(this->instanceModels.begin(), this->instanceModels.end(), 0);
+    std::stable_sort(this->instanceModels.begin(), this->instanceModels.end(), [this](uint32_t a, uint32_t b){
+        ModelAsset *assetA = this->models[a]->getAsset();
+        ModelAsset *assetB = this->models[b]->getAsset();
+        if(assetA->getVertexFormat() != assetB->getVertexFormat()){
+            return assetA->getVertexFormat() < assetB->getVertexFormat();
+        }
+        return assetA->getFirstIndex() < assetB->getFirstIndex();
+    });
+
+    this->instanceBatches.clear();
+    for(uint32_t i = 0 ; i < this->instanceModels.size() ; i++){
+        ModelAsset *asset = this->models[this->instanceModels[i]]->getAsset();
+        if(this->instanceBatches.empty() || this->instanceBatches.back().asset != asset){
+            this->instanceBatches.push_back({asset, i, 0, 0, 0});
+        }
+        this->instanceBatches.back().instanceCount++;
+    }
+
+    //One draw per submesh, the culling pass sets the number of visible instances
+    this->batchDraws.clear();
+    for(InstanceBatch &batch : this->instanceBatches){
+        batch.firstDraw = static_cast<uint32_t>(this->batchDraws.size());
+        for(const Submesh &submesh : batch.asset->getSubmeshes()){
+            VkDrawIndexedIndirectCommand draw = {};
+            draw.indexCount = submesh.indexCount;
+            draw.instanceCount = 0;
+            draw.firstIndex = batch.asset->getFirstIndex() + submesh.firstIndex;
+            draw.vertexOffset = static_cast<int32_t>(submesh.vertexOffset);
+            draw.firstInstance = batch.firstInstance;
+            this->batchDraws.push_back(draw);
+        }
+        batch.drawCount = static_cast<uint32_t>(this->batchDraws.size()) - batch.firstDraw;
+    }
+    printf("%zu instances drawn with %zu indirect draws\n", this->instanceModels.size(), this->batchDraws.size());
 }
 
+/**
+ * Reserve the data written at every frame in the frame ring buffer
+ */
 void Application::createUniformBuffers(){
     VkPhysicalDeviceProperties physicalDeviceProperties;
     vkGetPhysicalDeviceProperties(this->physicalDevice, &physicalDeviceProperties);
 
-    size_t minUboAlignment = physicalDeviceProperties.limits.minUniformBufferOffsetAlignment;
-    this->uniformDynamicAlignment = sizeof(glm::mat4);
-    if(minUboAlignment > 0){
-        this->uniformDynamicAlignment = (this->uniformDynamicAlignment + minUboAlignment - 1) & ~(minUboAlignment - 1);
-    }
-
-    size_t modelMatrixBufferSize = this->models.size() * this->uniformDynamicAlignment;
-    size_t viewMatricesBufferSize = sizeof(CameraMatrices);
-    size_t boneMatricesBufferSize = this->models.size() * 100 * this->uniformDynamicAlignment;
+    size_t instanceBufferSize = sizeof(InstanceData) * std::max<size_t>(this->models.size(), 1);
 
-    this->uboInstance.model = (glm::mat4*)alignedAlloc(modelMatrixBufferSize, this->uniformDynamicAlignment);
-    this->boneMatrices.transforms = (glm::mat4*)alignedAlloc(boneMatricesBufferSize, this->uniformDynamicAlignment);
-
-    this->modelUniformBuffers.resize(swapChainImages.size());
-    this->modelUniformBufferMemory.resize(swapChainImages.size());
-    this->cameraUniformBuffers.resize(swapChainImages.size());
-    this->cameraUniformBufferMemory.resize(swapChainImages.size());
-    this->boneUniformBuffers.resize(swapChainImages.size());
-    this->boneUniformBufferMemory.resize(swapChainImages.size());
-
-    for(size_t i = 0; i < this->swapChainImages.size() ; i++){
-        //Create the uniform for model data
-        this->createBuffer(modelMatrixBufferSize,
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                this->modelUniformBuffers[i],
-                this->modelUniformBufferMemory[i]);
-
-        //Create the uniform for camera data
-        this->createBuffer(viewMatricesBufferSize,
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                this->cameraUniformBuffers[i],
-                this->cameraUniformBufferMemory[i]);
+    //Each model only stores the bones of its rig, the palettes are packed and indexed by the skinning pass
+    this->bonePaletteOffsets.resize(this->models.size());
+    uint32_t boneCount = 0;
+    for(size_t i = 0 ; i < this->models.size() ; i++){
+        this->bonePaletteOffsets[i] = boneCount;
+        boneCount += std::max<uint32_t>(this->models[i]->getBoneCount(), 1);
+    }
+    size_t bonePaletteBufferSize = sizeof(AffineTransform) * boneCount;
 
-        //Create the bone matrices uniform data
-        this->createBuffer(boneMatricesBufferSize,
-                    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                    this->boneUniformBuffers[i],
-                    this->boneUniformBufferMemory[i]);
+    if(bonePaletteBufferSize > physicalDeviceProperties.limits.maxStorageBufferRange){
+        throw std::runtime_error("The bone palettes of the scene do not fit in a storage buffer.");
     }
+    if(instanceBufferSize > physicalDeviceProperties.limits.maxStorageBufferRange){
+        throw std::runtime_error("The instances of the scene do not fit in a storage buffer.");
+    }
+
+    //The slices are bound as uniform and storage buffers
+    VkDeviceSize alignment = std::max(physicalDeviceProperties.limits.minUniformBufferOffsetAlignment,
+                                      physicalDeviceProperties.limits.minStorageBufferOffsetAlignment);
+    this->frameRingBuffer = FrameRingBuffer(&this->memoryAllocator, this->device, alignment);
+    this->instanceSlice = this->frameRingBuffer.reserve(instanceBufferSize);
+    //The camera is also copied with the depth pyramid built from the frame
+    this->cameraSlice = this->frameRingBuffer.reserve(sizeof(CameraMatrices));
+    this->bonePaletteSlice = this->frameRingBuffer.reserve(bonePaletteBufferSize);
+    this->frameRingBuffer.init(static_cast<uint32_t>(this->swapChainImages.size()), FRAME_STREAMING_SIZE);
 }
 
 /**
- * Creates the graphics pipeline to draw
+ * Create the graphics pipeline of every vertex format and the compute pipelines of the passes
  */
-void Application::createGraphicsPipeline(){
+void Application::createPipelines(){
     auto vertShaderCode = readFile("./shaders/build/vertice.spv");
     auto fragShaderCode = readFile("./shaders/build/fragment.spv");
 
@@ -896,41 +1170,24 @@ void Application::createGraphicsPipeline(){
 
     VkPipelineShaderStageCreateInfo shaderStages[] = {vertexShaderStageInfo, fragmentShaderStageInfo};
 
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-    auto bindingDescription = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
     VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
     inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
     inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
     inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-    VkViewport viewport = {};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float) this->swapChainExtent.width;
-    viewport.height = (float) this->swapChainExtent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    //Which part of the framebuffer to draw
-    VkRect2D scissor = {};
-    scissor.offset = {0, 0};
-    scissor.extent = this->swapChainExtent;
-
+    //The viewport and the scissor are set when recording, the pipelines do not depend on the size of the swap chain
     VkPipelineViewportStateCreateInfo viewportState = {};
     viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
+    viewportState.pViewports = nullptr;
     viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
+    viewportState.pScissors = nullptr;
+
+    std::array<VkDynamicState, 2> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState = {};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
 
     VkPipelineRasterizationStateCreateInfo rasterizer = {};
     rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -1010,28 +1267,85 @@ void Application::createGraphicsPipeline(){
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     pipelineInfo.stageCount = 2;
     pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
     pipelineInfo.pInputAssemblyState = &inputAssembly;
     pipelineInfo.pViewportState = &viewportState;
     pipelineInfo.pRasterizationState = &rasterizer;
     pipelineInfo.pMultisampleState = &multisampling;
     pipelineInfo.pDepthStencilState = &depthStencil;
     pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = nullptr;
+    pipelineInfo.pDynamicState = &dynamicState;
     pipelineInfo.layout = this->pipelineLayout;
     pipelineInfo.renderPass = this->renderPass;
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
     pipelineInfo.basePipelineIndex = -1;
 
-    if(vkCreateGraphicsPipelines(this->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &this->graphicsPipeline) != VK_SUCCESS){
-        throw std::runtime_error("Failed to create graphics pipeline");
+    //Same shaders for every vertex format, the vertex input converts the packed attributes.
+    //The variants and the compute pipelines are compiled in parallel, the pipeline cache is internally synchronized
+    auto startTime = std::chrono::steady_clock::now();
+    const uint32_t pipelineCount = VERTEX_FORMAT_COUNT + COMPUTE_PIPELINE_COUNT;
+    std::vector<std::exception_ptr> errors(pipelineCount);
+    VkPipelineCache cache = this->pipelineCache.getCache();
+    this->threadPool->parallelFor(pipelineCount, [&](uint32_t begin, uint32_t end){
+        for(uint32_t index = begin ; index < end ; index++){
+            try{
+                this->createPipeline(index, pipelineInfo, cache);
+            }catch(...){
+                errors[index] = std::current_exception();
+            }
+        }
+    });
+    for(const std::exception_ptr &error : errors){
+        if(error){
+            std::rethrow_exception(error);
+        }
     }
 
+    double creationTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    this->runStats.pipelineCreationTime = creationTime / 1000.0;
+    this->runStats.pipelineCacheLoaded = this->pipelineCache.isLoaded();
+    printf("Created %u graphics and %u compute pipelines in %.2f ms (%s pipeline cache)\n",
+           VERTEX_FORMAT_COUNT, COMPUTE_PIPELINE_COUNT, creationTime, this->pipelineCache.isLoaded() ? "warm" : "cold");
+
     vkDestroyShaderModule(this->device, fragmentShaderModule, nullptr);
     vkDestroyShaderModule(this->device, vertexShaderModule, nullptr);
 }
 
+/**
+ * Create one of the pipelines of createPipelines, the graphics pipelines of the vertex formats come first
+ */
+void Application::createPipeline(uint32_t index, const VkGraphicsPipelineCreateInfo &pipelineInfo, VkPipelineCache cache){
+    if(index == VERTEX_FORMAT_COUNT){
+        this->skinningPass.createPipeline();
+        return;
+    }
+    if(index == VERTEX_FORMAT_COUNT + 1){
+        this->cullingPass.createPipeline();
+        return;
+    }
+    if(index == VERTEX_FORMAT_COUNT + 2){
+        this->hiZPass.createPipeline(this->msaaSamples);
+        return;
+    }
+
+    VertexFormat format = static_cast<VertexFormat>(index);
+    VkGraphicsPipelineCreateInfo formatPipelineInfo = pipelineInfo;
+    auto bindingDescriptions = VertexInput::getBindingDescriptions(format);
+    auto attributeDescriptions = VertexInput::getAttributeDescriptions(format);
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+    vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+    formatPipelineInfo.pVertexInputState = &vertexInputInfo;
+
+    if(vkCreateGraphicsPipelines(this->device, cache, 1, &formatPipelineInfo, nullptr, &this->graphicsPipelines[index]) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create graphics pipeline");
+    }
+}
+
 void Application::createFrameBuffers(){
     this->swapChainFramebuffers.resize(this->swapChainImageViews.size());
 
@@ -1084,7 +1398,7 @@ void Application::createDepthResources(){
             this->msaaSamples,
             depthformat,
             VK_IMAGE_TILING_OPTIMAL,
-            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
             this->depthImage,
             this->depthImageMemory
@@ -1131,16 +1445,22 @@ void Application::createCommandPool(){
     if(vkCreateCommandPool(this->device, &poolInfo, nullptr, &this->commandPool) != VK_SUCCESS){
         throw std::runtime_error("Failed to create command pool");
     }
+}
 
-    //Create transfer command pool
-    poolInfo = {};
-    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily.value();
-    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+/**
+ * The copies run on the transfer queue, the graphics queue acquires the resources and generates the mipmaps
+ */
+void Application::createUploadManager(){
+    QueueFamilyIndices queueFamilyIndices = this->findQueueFamilies(this->physicalDevice);
 
-    if(vkCreateCommandPool(this->device, &poolInfo, nullptr, &this->transferCommandPool) != VK_SUCCESS){
-        throw std::runtime_error("Failed to create transfer command pool");
-    }
+    VkPhysicalDeviceProperties physicalDeviceProperties;
+    vkGetPhysicalDeviceProperties(this->physicalDevice, &physicalDeviceProperties);
+    VkDeviceSize alignment = std::max<VkDeviceSize>(16, physicalDeviceProperties.limits.optimalBufferCopyOffsetAlignment);
+
+    this->uploadManager = UploadManager(this, this->device);
+    this->uploadManager.init(this->transferQueue, queueFamilyIndices.transferFamily.value(),
+                             this->graphicsQueue, queueFamilyIndices.graphicsFamiliy.value(),
+                             UPLOAD_STAGING_SIZE, alignment);
 }
 
 VkSampleCountFlagBits Application::getMaxUsableSampleCount(){
@@ -1180,10 +1500,7 @@ VkImageView Application::createImageView(VkImage image, VkFormat format, VkImage
     return imageView;
 }
 
-void Application::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &imageMemory){
-    QueueFamilyIndices queueFamilies = this->findQueueFamilies(this->physicalDevice);
-    uint32_t queueFamilyindices[] = {queueFamilies.transferFamily.value(), queueFamilies.presentFamily.value()};
-
+void Application::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, MemoryAllocation &imageMemory){
     VkImageCreateInfo imageInfo = {};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -1197,8 +1514,6 @@ void Application::createImage(uint32_t width, uint32_t height, uint32_t mipLevel
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     imageInfo.usage = usage;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-//        imageInfo.queueFamilyIndexCount = 1;
-//        imageInfo.pQueueFamilyIndices = &queueFamilies.graphicsFamiliy.value();
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.flags = 0;
     imageInfo.samples = numSamples;
@@ -1211,23 +1526,18 @@ void Application::createImage(uint32_t width, uint32_t height, uint32_t mipLevel
     VkMemoryRequirements memoryRequirements;
     vkGetImageMemoryRequirements(this->device, image, &memoryRequirements);
 
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memoryRequirements.size;
-    allocInfo.memoryTypeIndex = this->findMemoryType(memoryRequirements.memoryTypeBits, properties);
-
-    if(vkAllocateMemory(this->device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS){
-        throw std::runtime_error("Failed to allocate image memory.");
-    }
-
-    vkBindImageMemory(this->device, image, imageMemory, 0);
+    imageMemory = this->memoryAllocator.allocate(memoryRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR);
+    vkBindImageMemory(this->device, image, imageMemory.memory, imageMemory.offset);
 }
 
-void Application::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height){
-    VkCommandBuffer commandBuffer = this->beginSingleTimeCommands(this->transferCommandPool);
+void Application::destroyImage(VkImage image, MemoryAllocation &imageMemory){
+    vkDestroyImage(this->device, image, nullptr);
+    this->memoryAllocator.free(imageMemory);
+}
 
+void Application::copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height){
     VkBufferImageCopy region = {};
-    region.bufferOffset = 0;
+    region.bufferOffset = bufferOffset;
     region.bufferRowLength = 0;
     region.bufferImageHeight = 0;
     region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -1242,13 +1552,9 @@ void Application::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t wid
     };
 
     vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-    this->endSingleTimeCommands(this->transferQueue, this->transferCommandPool, commandBuffer);
 }
 
-void Application::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels){
-    VkCommandBuffer commandBuffer = this->beginSingleTimeCommands(this->commandPool);
-
+void Application::transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels){
     VkImageMemoryBarrier barrier = {};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.oldLayout = oldLayout;
@@ -1285,57 +1591,6 @@ void Application::transitionImageLayout(VkImage image, VkFormat format, VkImageL
                          0, nullptr,
                          0, nullptr,
                          1, &barrier);
-
-    this->endSingleTimeCommands(this->graphicsQueue, this->commandPool, commandBuffer);
-}
-
-
-
-VkCommandBuffer Application::beginSingleTimeCommands(VkCommandPool commandPool){
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(this->device, &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-    return commandBuffer;
-}
-
-void Application::endSingleTimeCommands(VkQueue queue, VkCommandPool commandPool, VkCommandBuffer commandBuffer){
-    vkEndCommandBuffer(commandBuffer);
-
-    //Run the command buffer
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(queue);
-
-    vkFreeCommandBuffers(this->device, commandPool, 1, &commandBuffer);
-}
-
-uint32_t Application::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties){
-    VkPhysicalDeviceMemoryProperties memoryProperties;
-    vkGetPhysicalDeviceMemoryProperties(this->physicalDevice, &memoryProperties);
-
-    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount ; i++){
-        if(typeFilter & (1 << i) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties){
-            return i;
-        }
-    }
-
-    throw std::runtime_error("Failed to find suitable memory type.");
 }
 
 void Application::createCommandBuffers(){
@@ -1374,27 +1629,53 @@ void Application::createCommandBuffers(){
         renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
         renderPassInfo.pClearValues = clearValues.data();
 
-        vkCmdBeginRenderPass(this->commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(this->commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-
-        VkDeviceSize indicesOffset = sizeof(Vertex) * this->nbVertices;
-        VkDeviceSize offsets[] = {0};
+        uint32_t firstQuery = static_cast<uint32_t>(i) * 2;
+        if(this->timestampsSupported){
+            vkCmdResetQueryPool(this->commandBuffers[i], this->timestampQueryPool, firstQuery, 2);
+            vkCmdWriteTimestamp(this->commandBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, this->timestampQueryPool, firstQuery);
+        }
 
-        vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, &this->vertexBuffer, offsets);
-        vkCmdBindIndexBuffer(commandBuffers[i], this->vertexBuffer, indicesOffset, VK_INDEX_TYPE_UINT32);
+        //Dynamic state of every render pass of the command buffer
+        VkViewport viewport = {};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float) this->swapChainExtent.width;
+        viewport.height = (float) this->swapChainExtent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(this->commandBuffers[i], 0, 1, &viewport);
+
+        //Which part of the framebuffer to draw
+        VkRect2D scissor = {};
+        scissor.offset = {0, 0};
+        scissor.extent = this->swapChainExtent;
+        vkCmdSetScissor(this->commandBuffers[i], 0, 1, &scissor);
+
+        //Cull the instances against the depth pyramid of the previous frame and build the draws of the first phase,
+        //then skin the instances it draws before the render pass
+        this->skinningPass.recordReset(this->commandBuffers[i], static_cast<uint32_t>(i));
+        this->cullingPass.recordFirstPhase(this->commandBuffers[i], static_cast<uint32_t>(i), this->occlusionCulling);
+        this->skinningPass.recordDispatch(this->commandBuffers[i], static_cast<uint32_t>(i), 0);
 
-        for(size_t j = 0 ; j < this->models.size() ; j++){
-            Model *model = this->models[j];
-            uint32_t modelDynamicOffset = j * static_cast<uint32_t>(this->uniformDynamicAlignment);
+        vkCmdBeginRenderPass(this->commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        this->recordDraws(this->commandBuffers[i], static_cast<uint32_t>(i), 0);
+        vkCmdEndRenderPass(this->commandBuffers[i]);
 
-            VkDescriptorSet* modelDescriptorSet =  model->getDescriptorSet(i);
-            vkCmdBindDescriptorSets(this->commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, modelDescriptorSet, 1,
-                                    &modelDynamicOffset);
+        //Build the depth pyramid of this frame and draw the instances it no longer occludes
+        if(this->occlusionCulling){
+            this->hiZPass.recordBuild(this->commandBuffers[i], this->getCameraBufferInfo(static_cast<uint32_t>(i)));
+            this->cullingPass.recordSecondPhase(this->commandBuffers[i], static_cast<uint32_t>(i));
+            this->skinningPass.recordDispatch(this->commandBuffers[i], static_cast<uint32_t>(i), 1);
 
-            vkCmdDrawIndexed(commandBuffers[i], this->nbIndices, 1, 0, 0, 0);
+            renderPassInfo.renderPass = this->secondPhaseRenderPass;
+            vkCmdBeginRenderPass(this->commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            this->recordDraws(this->commandBuffers[i], static_cast<uint32_t>(i), 1);
+            vkCmdEndRenderPass(this->commandBuffers[i]);
         }
 
-        vkCmdEndRenderPass(this->commandBuffers[i]);
+        if(this->timestampsSupported){
+            vkCmdWriteTimestamp(this->commandBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->timestampQueryPool, firstQuery + 1);
+        }
 
         //END
         if(vkEndCommandBuffer(this->commandBuffers[i]) != VK_SUCCESS ){
@@ -1404,11 +1685,83 @@ void Application::createCommandBuffers(){
     }
 }
 
+/**
+ * Record the indirect draws of every batch built by a culling phase, inside a render pass
+ * @param phase culling phase that built the draws, each phase has its own draws and draw counts
+ */
+void Application::recordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t phase){
+    vkCmdBindIndexBuffer(commandBuffer, this->vertexBuffer, this->indexBufferOffset, VK_INDEX_TYPE_UINT32);
+
+    //The recorded commands only depend on the assets, the instances and draws are set by the culling pass
+    VkBuffer drawBuffer = this->cullingPass.getDrawBuffer(imageIndex);
+    VkBuffer drawCountBuffer = this->cullingPass.getDrawCountBuffer(imageIndex);
+    const uint32_t drawStride = sizeof(VkDrawIndexedIndirectCommand);
+    const uint32_t phaseFirstDraw = phase * static_cast<uint32_t>(this->batchDraws.size());
+    const uint32_t phaseFirstBatch = phase * static_cast<uint32_t>(this->instanceBatches.size());
+    VkPipeline boundPipeline = VK_NULL_HANDLE;
+    for(uint32_t batchIndex = 0 ; batchIndex < this->instanceBatches.size() ; batchIndex++){
+        const InstanceBatch &batch = this->instanceBatches[batchIndex];
+        ModelAsset *asset = batch.asset;
+
+        VkPipeline pipeline = this->graphicsPipelines[static_cast<size_t>(asset->getVertexFormat())];
+        if(pipeline != boundPipeline){
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            boundPipeline = pipeline;
+        }
+
+        //Texture attributes of the asset, the skinned vertices of the instances are fetched by the vertex shader
+        VkDeviceSize vertexOffset = asset->getVertexOffset();
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &this->vertexBuffer, &vertexOffset);
+
+        VkDescriptorSet* modelDescriptorSet =  asset->getDescriptorSet(imageIndex);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout, 0, 1, modelDescriptorSet, 0, nullptr);
+
+        //One draw per submesh for the visible instances, the batches with no visible instance have no draw
+        VkDeviceSize drawOffset = static_cast<VkDeviceSize>(drawStride) * (phaseFirstDraw + batch.firstDraw);
+        if(this->cmdDrawIndexedIndirectCount != nullptr){
+            this->cmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, drawOffset,
+                                              drawCountBuffer, sizeof(uint32_t) * (phaseFirstBatch + batchIndex), batch.drawCount, drawStride);
+        }else if(this->multiDrawIndirectSupported){
+            vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, drawOffset, batch.drawCount, drawStride);
+        }else{
+            for(uint32_t draw = 0 ; draw < batch.drawCount ; draw++){
+                vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, drawOffset + drawStride * draw, 1, drawStride);
+            }
+        }
+    }
+}
+
+/**
+ * Create the timestamp queries of every swap chain image, the GPU time is not reported when the graphics queue has no timestamps
+ */
+void Application::createTimestampQueryPool(){
+    VkPhysicalDeviceProperties physicalDeviceProperties;
+    vkGetPhysicalDeviceProperties(this->physicalDevice, &physicalDeviceProperties);
+    this->timestampPeriod = physicalDeviceProperties.limits.timestampPeriod;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(this->physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(this->physicalDevice, &queueFamilyCount, queueFamilies.data());
+    uint32_t graphicsFamily = this->findQueueFamilies(this->physicalDevice).graphicsFamiliy.value();
+    this->timestampsSupported = queueFamilies[graphicsFamily].timestampValidBits > 0;
+
+    VkQueryPoolCreateInfo queryPoolInfo = {};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = static_cast<uint32_t>(this->swapChainImages.size()) * 2;
+
+    if(vkCreateQueryPool(this->device, &queryPoolInfo, nullptr, &this->timestampQueryPool) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create timestamp query pool.");
+    }
+}
+
 void Application::createSyncObjects(){
     this->imageAvailableSemaphore.resize(MAX_FRAMES_IN_FLIGHT);
     this->renderFinishedSemaphore.resize(MAX_FRAMES_IN_FLIGHT);
     this->inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
     this->imagesInFlight.resize(this->swapChainImages.size(), VK_NULL_HANDLE);
+    this->imageOcclusionCulling.resize(this->swapChainImages.size(), this->occlusionCulling);
 
     VkSemaphoreCreateInfo semaphoreInfo = {};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -1442,38 +1795,88 @@ void Application::recreateSwapChain(){
         glfwWaitEvents();
     }
 
+    //Only the attachments, the framebuffers and the depth pyramid depend on the size of the swap chain.
+    //The scene buffers, the render passes, the pipelines and the descriptor sets are kept
+    auto startTime = std::chrono::steady_clock::now();
+    //The pending uploads may clear the depth pyramid destroyed below
+    this->uploadManager.flush();
     vkDeviceWaitIdle(this->device);
+    size_t imageCount = this->swapChainImages.size();
     this->cleanupSwapChain();
     this->createSwapChain();
     this->createImageViews();
-    this->createRenderPass();
-    this->createGraphicsPipeline();
     this->createColorResources();
     this->createDepthResources();
     this->createFrameBuffers();
-    this->createUniformBuffers();
+    this->hiZPass.resize(this->depthImageView, this->swapChainExtent);
+    if(this->swapChainImages.size() != imageCount){
+        this->recreateFrameResources();
+    }else{
+        this->cullingPass.setDepthPyramid(this->hiZPass);
+    }
     this->createCommandBuffers();
+    this->imagesInFlight.assign(this->swapChainImages.size(), VK_NULL_HANDLE);
+    this->imageOcclusionCulling.assign(this->swapChainImages.size(), this->occlusionCulling);
+
+    double resizeTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    printf("Resized the swap chain to %ux%u in %.2f ms\n", this->swapChainExtent.width, this->swapChainExtent.height, resizeTime);
 
     this->framebufferResized = false;
 }
 
+/**
+ * Create the resources of every swap chain image again, when a new swap chain does not have the same number of images
+ */
+void Application::recreateFrameResources(){
+    this->frameRingBuffer.cleanup();
+    this->skinningPass.cleanup();
+    this->cullingPass.cleanup();
+    vkDestroyQueryPool(this->device, this->timestampQueryPool, nullptr);
+
+    this->createUniformBuffers();
+    this->skinningPass.init(this->models, this->instanceBatches, this->vertexBuffer);
+    this->cullingPass.init(this->batchDraws, static_cast<uint32_t>(this->instanceBatches.size()), static_cast<uint32_t>(this->instanceModels.size()), this->skinningPass, this->hiZPass);
+    this->createTimestampQueryPool();
+    //The descriptor sets of the assets point to the frame ring buffer and to the buffers of the passes
+    this->assetManager.recreateDescriptorSets();
+}
+
 void Application::cleanup() {
     if(enableValidationLayers) {
         DestroyDebugUtilsMessengerEXT(this->instance, this->debugMessenger, nullptr);
     }
 
+    this->uploadManager.waitIdle();
     this->cleanupSwapChain();
-    for(Model *model : this->models){
-        model->cleanup();
+
+    this->destroyBuffer(this->vertexBuffer, this->vertexBufferMemory);
+    this->frameRingBuffer.cleanup();
+    this->skinningPass.cleanup();
+    this->cullingPass.cleanup();
+    this->hiZPass.cleanup();
+    vkDestroyQueryPool(this->device, this->timestampQueryPool, nullptr);
+
+    this->skinningPass.cleanupPipeline();
+    this->cullingPass.cleanupPipeline();
+    this->hiZPass.cleanupPipeline();
+    for(VkPipeline pipeline : this->graphicsPipelines){
+        vkDestroyPipeline(this->device, pipeline, nullptr);
     }
-    if(this->uboInstance.model){
-        alignedFree(this->uboInstance.model);
+    vkDestroyPipelineLayout(this->device, this->pipelineLayout, nullptr);
+
+    vkDestroyRenderPass(this->device, this->renderPass, nullptr);
+    vkDestroyRenderPass(this->device, this->secondPhaseRenderPass, nullptr);
+    vkDestroySwapchainKHR(this->device, this->swapChain, nullptr);
+
+    for(Model *model : this->models){
+        delete model;
     }
+    this->models.clear();
+    this->assetManager.cleanup();
 
     vkDestroyDescriptorSetLayout(this->device, this->descriptorSetLayout, nullptr);
 
     vkDestroyCommandPool(this->device, this->commandPool, nullptr);
-    vkDestroyCommandPool(this->device, this->transferCommandPool, nullptr);
 
     for(size_t i = 0 ; i < MAX_FRAMES_IN_FLIGHT ; i++){
         vkDestroySemaphore(this->device, this->renderFinishedSemaphore[i], nullptr);
@@ -1481,6 +1884,10 @@ void Application::cleanup() {
         vkDestroyFence(this->device, this->inFlightFences[i], nullptr);
     }
 
+    this->uploadManager.cleanup();
+    this->pipelineCache.save(PIPELINE_CACHE_PATH);
+    this->pipelineCache.cleanup();
+    this->memoryAllocator.cleanup();
     vkDestroyDevice(this->device, nullptr);
     vkDestroySurfaceKHR(this->instance, surface, nullptr);
     vkDestroyInstance(this->instance, nullptr);
@@ -1489,39 +1896,22 @@ void Application::cleanup() {
     glfwTerminate();
 }
 
+/**
+ * Destroy the resources that depend on the size of the swap chain, the swap chain itself is retired when the next one is created
+ */
 void Application::cleanupSwapChain(){
     for(auto framebuffer : this->swapChainFramebuffers){
         vkDestroyFramebuffer(this->device, framebuffer, nullptr);
     }
 
-    vkDestroyBuffer(this->device, this->vertexBuffer, nullptr);
-    vkFreeMemory(this->device, this->vertexBufferMemory, nullptr);
-
-    for (size_t i = 0; i < swapChainImages.size(); i++) {
-        vkDestroyBuffer(device, this->modelUniformBuffers[i], nullptr);
-        vkFreeMemory(device, this->modelUniformBufferMemory[i], nullptr);
-        vkDestroyBuffer(device, this->cameraUniformBuffers[i], nullptr);
-        vkFreeMemory(device, this->cameraUniformBufferMemory[i], nullptr);
-        vkDestroyBuffer(device, this->boneUniformBuffers[i], nullptr);
-        vkFreeMemory(device, this->boneUniformBufferMemory[i], nullptr);
-    }
-
     vkDestroyImageView(this->device, this->colorImageView, nullptr);
-    vkDestroyImage(this->device, this->colorImage, nullptr);
-    vkFreeMemory(this->device, this->colorImageMemory, nullptr);
+    this->destroyImage(this->colorImage, this->colorImageMemory);
 
-    vkDestroyImage(this->device, this->depthImage, nullptr);
     vkDestroyImageView(this->device, this->depthImageView, nullptr);
-    vkFreeMemory(this->device, this->depthImageMemory, nullptr);
+    this->destroyImage(this->depthImage, this->depthImageMemory);
 
     vkFreeCommandBuffers(this->device, this->commandPool, static_cast<uint32_t>(this->commandBuffers.size()), this->commandBuffers.data());
 
-    vkDestroyPipeline(this->device, this->graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(this->device, this->pipelineLayout, nullptr);
-
-    vkDestroyRenderPass(this->device, this->renderPass, nullptr);
-    vkDestroySwapchainKHR(this->device, this->swapChain, nullptr);
-
     //Destroy image views
     for(auto imageView : this->swapChainImageViews){
         vkDestroyImageView(this->device, imageView, nullptr);
@@ -1530,18 +1920,14 @@ void Application::cleanupSwapChain(){
 
 
 void Application::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-                  VkBuffer &buffer, VkDeviceMemory &bufferMemory){
-
-    auto queueIndices = this->findQueueFamilies(this->physicalDevice);
-    uint32_t queueFamilies[] = {queueIndices.graphicsFamiliy.value(), queueIndices.transferFamily.value()};
+                  VkBuffer &buffer, MemoryAllocation &bufferMemory){
 
+    //The buffers written by the transfer queue are released to the graphics queue by the upload manager
     VkBufferCreateInfo bufferInfo = {};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
     bufferInfo.usage = usage;
-    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
-    bufferInfo.queueFamilyIndexCount = 2;
-    bufferInfo.pQueueFamilyIndices = queueFamilies;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     bufferInfo.flags = 0;
 
     if(vkCreateBuffer(this->device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS){
@@ -1551,28 +1937,35 @@ void Application::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMe
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(this->device, buffer, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = this->findMemoryType(memRequirements.memoryTypeBits, properties);
+    bufferMemory = this->memoryAllocator.allocate(memRequirements, properties, true);
+    vkBindBufferMemory(this->device, buffer, bufferMemory.memory, bufferMemory.offset);
+}
 
-    if(vkAllocateMemory(this->device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS){
-        throw std::runtime_error("Failed to allocate vertex buffer memory.");
-    }
+/**
+ * Create a mapped host visible buffer to upload data from, it must be destroyed once the upload is done
+ */
+void Application::createStagingBuffer(VkDeviceSize size, VkBuffer &buffer, MemoryAllocation &bufferMemory){
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    bufferInfo.flags = 0;
 
-    vkBindBufferMemory(this->device, buffer, bufferMemory, 0);
-}
+    if(vkCreateBuffer(this->device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create staging buffer.");
+    }
 
-void Application::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size){
-    auto commandBuffer = this->beginSingleTimeCommands(this->transferCommandPool);
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(this->device, buffer, &memRequirements);
 
-    VkBufferCopy copyRegion = {};
-    copyRegion.srcOffset = 0;
-    copyRegion.dstOffset = 0;
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+    bufferMemory = this->memoryAllocator.allocateTransient(memRequirements);
+    vkBindBufferMemory(this->device, buffer, bufferMemory.memory, bufferMemory.offset);
+}
 
-    this->endSingleTimeCommands(this->transferQueue, this->transferCommandPool, commandBuffer);
+void Application::destroyBuffer(VkBuffer buffer, MemoryAllocation &bufferMemory){
+    vkDestroyBuffer(this->device, buffer, nullptr);
+    this->memoryAllocator.free(bufferMemory);
 }
 
 VkPhysicalDevice Application::getPhysicalDevice(){
@@ -1586,6 +1979,18 @@ VkCommandPool Application::getCommandPool(){
     return this->commandPool;
 }
 
+UploadManager &Application::getUploadManager(){
+    return this->uploadManager;
+}
+
+VkPipelineCache Application::getPipelineCache(){
+    return this->pipelineCache.getCache();
+}
+
+const RunStats& Application::getRunStats() const {
+    return this->runStats;
+}
+
 uint32_t Application::getSwapChainImagesCount(){
     return this->swapChainImages.size();
 }
@@ -1593,14 +1998,22 @@ uint32_t Application::getSwapChainImagesCount(){
 VkDescriptorSetLayout Application::getDescriptorSetLayout(){
     return this->descriptorSetLayout;
 }
-VkBuffer Application::getModelUniformBuffer(uint32_t index){
-    return this->modelUniformBuffers[index];
+VkDescriptorBufferInfo Application::getInstanceBufferInfo(uint32_t index){
+    return this->frameRingBuffer.getBufferInfo(this->instanceSlice, index);
+}
+
+VkDescriptorBufferInfo Application::getCameraBufferInfo(uint32_t index){
+    return this->frameRingBuffer.getBufferInfo(this->cameraSlice, index);
+}
+
+VkDescriptorBufferInfo Application::getBonePaletteBufferInfo(uint32_t index){
+    return this->frameRingBuffer.getBufferInfo(this->bonePaletteSlice, index);
 }
 
-VkBuffer Application::getCameraUniformBuffer(uint32_t index){
-    return this->cameraUniformBuffers[index];
+VkBuffer Application::getSkinnedVertexBuffer(){
+    return this->skinningPass.getSkinnedVertexBuffer();
 }
 
-VkBuffer Application::getBoneUniformBuffer(uint32_t index){
-    return this->boneUniformBuffers[index];
+VkBuffer Application::getVisibleInstanceBuffer(uint32_t index){
+    return this->cullingPass.getVisibleInstanceBuffer(index);
 }
@@ -21,6 +21,7 @@
 #include <vector>
 #include <iostream>
 #include <optional>
+#include <memory>
 #include <ctime>
 #include <thread>
 #include <set>
@@ -29,6 +30,20 @@
 #include "Vertex.hpp"
 #include "Model.hpp"
 #include "Camera.hpp"
+#include "AssetManager.hpp"
+#include "ThreadPool.hpp"
+#include "SkinningPass.hpp"
+#include "CullingPass.hpp"
+#include "HiZPass.hpp"
+#include "MemoryAllocator.hpp"
+#include "FrameRingBuffer.hpp"
+#include "UploadManager.hpp"
+#include "PipelineCache.hpp"
+
+//Size of the texture array of the fragment shader
+const uint32_t MAX_MODEL_TEXTURES = 8;
+//Frames recorded by the host while the GPU draws the previous ones
+const int MAX_FRAMES_IN_FLIGHT = 2;
 
 struct SwapChainSupportDetails {
     VkSurfaceCapabilitiesKHR capabilities;
@@ -48,12 +63,33 @@ struct QueueFamilyIndices {
     }
 };
 
-struct ModelMatrix {
-    glm::mat4 *model = nullptr;
+/**
+ * Per-instance data read by the skinning pass and by the vertex shader with gl_InstanceIndex (std430 layout)
+ */
+struct InstanceData {
+    glm::mat4 model;
+    //Bounding sphere of the asset in model space, tested by the culling pass
+    glm::vec4 boundingSphere;
+    //First vertex of the instance in the skinned vertex buffer, in the range of the frame in flight
+    uint32_t firstSkinnedVertex;
+    //Indirect draws of the batch of the instance
+    uint32_t firstDraw;
+    uint32_t drawCount;
+    uint32_t batch;
+    //First bone of the palette of the instance
+    uint32_t firstBone;
 };
 
-struct BoneMatrices{
-    glm::mat4 *transforms = nullptr;
+/**
+ * Instances of the same asset, drawn with one instanced draw per submesh
+ */
+struct InstanceBatch {
+    ModelAsset *asset;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+    //One indirect draw per submesh of the asset
+    uint32_t firstDraw;
+    uint32_t drawCount;
 };
 
 struct CameraMatrices {
@@ -61,10 +97,47 @@ struct CameraMatrices {
     glm::mat4 proj;
 };
 
+/**
+ * Options of a run of the application, given on the command line
+ */
+struct ApplicationSettings {
+    //Instances of the character, placed on a square grid
+    uint32_t instanceCount = 1;
+    //Threads importing the assets and evaluating the animations, 0 uses one thread per hardware core
+    uint32_t workerThreadCount = 0;
+    //Frames drawn before closing, 0 runs until the window is closed. The frame rate is not capped when set.
+    uint32_t frameCount = 0;
+    //Occlusion culling against the depth pyramid at startup, toggled with the O key
+    bool occlusionCulling = true;
+    //Weld and reorder the geometry of the models at import, off to measure the draws without it
+    bool meshOptimization = true;
+};
+
+/**
+ * Times in seconds summed over the frames of a run with a frame count, the first frames are skipped
+ */
+struct RunStats {
+    uint32_t frameCount = 0;
+    double frameTime = 0.0;
+    double animationTime = 0.0;
+    uint32_t gpuFrameCount = 0;
+    double gpuTime = 0.0;
+    //Instances culled and drawn by the frames read back
+    uint32_t cullingFrameCount = 0;
+    CullingStats culling = {};
+    //Creation of the graphics and compute pipelines, and whether the pipeline cache was read from the disk
+    double pipelineCreationTime = 0.0;
+    bool pipelineCacheLoaded = false;
+};
+
 class Model;
 
+VkShaderModule createShaderModule(VkDevice *device, const std::vector<char>& code);
+
 class Application {
 public:
+    explicit Application(const ApplicationSettings &settings = ApplicationSettings());
+
     void run() {
         initWindow();
         initVulkan();
@@ -72,10 +145,22 @@ public:
         cleanup();
     }
 
+    void createPipelinesHeadless(const std::string &cachePath);
+
 private:
+    ApplicationSettings settings;
+    RunStats runStats;
+    //Frames drawn since the start
+    uint32_t frameIndex = 0;
+
+    MemoryAllocator memoryAllocator;
+    UploadManager uploadManager;
+    PipelineCache pipelineCache;
+    AssetManager assetManager;
     std::vector<Model*> models;
+    std::unique_ptr<ThreadPool> threadPool;
 
-    GLFWwindow *window;
+    GLFWwindow *window = nullptr;
     VkInstance instance;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     VkDevice device;
@@ -84,18 +169,20 @@ private:
     VkQueue presentQueue;
     VkQueue transferQueue;
     VkRenderPass renderPass;
+    //Same attachments as the render pass, loaded to draw the instances of the second culling phase
+    VkRenderPass secondPhaseRenderPass;
     VkDescriptorSetLayout  descriptorSetLayout;
     VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
+    //One graphics pipeline per vertex format, they only differ by their vertex input
+    std::array<VkPipeline, VERTEX_FORMAT_COUNT> graphicsPipelines;
 
-    VkSwapchainKHR swapChain;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
     std::vector<VkImage> swapChainImages;
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
     std::vector<VkImageView> swapChainImageViews;
     std::vector<VkFramebuffer> swapChainFramebuffers;
     VkCommandPool commandPool;
-    VkCommandPool transferCommandPool;
     std::vector<VkCommandBuffer> commandBuffers;
 
     std::vector<VkSemaphore> imageAvailableSemaphore;
@@ -104,32 +191,55 @@ private:
     std::vector<VkFence> imagesInFlight;
     size_t currentFrame = 0;
 
-    std::vector<VkBuffer> modelUniformBuffers;
-    std::vector<VkDeviceMemory> modelUniformBufferMemory;
-
-    std::vector<VkBuffer> cameraUniformBuffers;
-    std::vector<VkDeviceMemory> cameraUniformBufferMemory;
-
-    std::vector<VkBuffer> boneUniformBuffers;
-    std::vector<VkDeviceMemory> boneUniformBufferMemory;
-
-    ModelMatrix uboInstance = {};
-    BoneMatrices boneMatrices = {};
-    size_t uniformDynamicAlignment;
+    //Data written at every frame: the instance data of every model ordered by batch, the camera
+    //matrices and the packed 3x4 bone palettes of every model, read by the skinning pass
+    FrameRingBuffer frameRingBuffer;
+    FrameSlice instanceSlice;
+    FrameSlice cameraSlice;
+    FrameSlice bonePaletteSlice;
+
+    //Model of every instance slot
+    std::vector<uint32_t> instanceModels;
+    std::vector<InstanceBatch> instanceBatches;
+    //Indirect draws of every batch before the culling, with no instance
+    std::vector<VkDrawIndexedIndirectCommand> batchDraws;
+
+    //First bone of the palette of every model
+    std::vector<uint32_t> bonePaletteOffsets;
+
+    SkinningPass skinningPass;
+    CullingPass cullingPass;
+    HiZPass hiZPass;
+    //Toggled with the O key, the instances are then only culled against the frustum
+    bool occlusionCulling = true;
+    bool occlusionKeyPressed = false;
+    //Occlusion culling of the last frame submitted with every image, its stats are read once the image is reused
+    std::vector<bool> imageOcclusionCulling;
+    //GPU time since the start with the occlusion culling off and on
+    std::array<double, 2> modeGpuTime = {};
+    std::array<uint32_t, 2> modeGpuFrames = {};
+
+    //Two timestamps per swap chain image, around the commands of the frame
+    VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+    bool timestampsSupported = false;
+    float timestampPeriod = 0.0f;
+
+    //Optional device capabilities of the indirect draws, the draws of a batch fall back to a fixed count
+    bool multiDrawIndirectSupported = false;
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
 
     VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
-    uint32_t nbVertices = 0;
+    MemoryAllocation vertexBufferMemory;
+    //The indices follow the vertices of every asset in the vertex buffer
+    VkDeviceSize indexBufferOffset = 0;
     uint32_t nbIndices = 0;
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
 
     VkImage depthImage;
     VkImageView depthImageView;
-    VkDeviceMemory depthImageMemory;
+    MemoryAllocation depthImageMemory;
 
     VkImage colorImage;
-    VkDeviceMemory colorImageMemory;
+    MemoryAllocation colorImageMemory;
     VkImageView colorImageView;
 
 
@@ -140,10 +250,18 @@ private:
     //FPS calculation
     double lastTime = glfwGetTime();
     int nbFrames = 0;
+    double animationTime = 0.0;
+    uint64_t animationFrame = 0;
+    std::array<AnimationLodStats, ANIMATION_LOD_COUNT> animationLodStats;
+    //Culling stats and GPU time of the frames done since the last report
+    CullingStats cullingStats = {};
+    double gpuTime = 0.0;
+    int nbGpuFrames = 0;
 
     bool framebufferResized = false;
 
     double clockToMilliseconds(clock_t ticks);
+    bool isMeasuring() const;
     void initWindow();
     void mainLoop();
     void drawFrame();
@@ -154,6 +272,7 @@ private:
     void createSurface();
     void pickPhysicalDevice();
     void createLogicalDevice();
+    void createInstanceBatches();
     void createUniformBuffers();
     void createSwapChain();
     void recreateSwapChain();
@@ -161,14 +280,21 @@ private:
     void createVertexBuffers();
     void createRenderPass();
     void createDescriptorSetLayout();
-    void createGraphicsPipeline();
+    void createPipelines();
+    void createPipeline(uint32_t index, const VkGraphicsPipelineCreateInfo &pipelineInfo, VkPipelineCache cache);
     void createCommandPool();
+    void createUploadManager();
     void createColorResources();
     void createDepthResources();
     void createFrameBuffers();
     void createCommandBuffers();
+    void recordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t phase);
+    void createTimestampQueryPool();
+    void readFrameStats(uint32_t imageIndex);
     void createSyncObjects();
 
+    void recreateFrameResources();
+
     void cleanup();
     void cleanupSwapChain();
 
@@ -185,7 +311,6 @@ private:
     VkFormat findDepthFormat();
     VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
     VkSampleCountFlagBits getMaxUsableSampleCount();
-    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
     static void framebufferResizeCallback(GLFWwindow *window, int width, int height){
         auto app = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
@@ -194,26 +319,30 @@ private:
 
 public:
     void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-                      VkBuffer &buffer, VkDeviceMemory &bufferMemory);
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-
-    VkCommandBuffer beginSingleTimeCommands(VkCommandPool commandPool);
-    void endSingleTimeCommands(VkQueue queue, VkCommandPool commandPool, VkCommandBuffer commandBuffer);
-
-    void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &imageMemory);
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
-    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels);
+                      VkBuffer &buffer, MemoryAllocation &bufferMemory);
+    void createStagingBuffer(VkDeviceSize size, VkBuffer &buffer, MemoryAllocation &bufferMemory);
+    void destroyBuffer(VkBuffer buffer, MemoryAllocation &bufferMemory);
+
+    void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, MemoryAllocation &imageMemory);
+    void destroyImage(VkImage image, MemoryAllocation &imageMemory);
+    void copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height);
+    void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels);
     VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
 
     uint32_t getSwapChainImagesCount();
     VkDescriptorSetLayout getDescriptorSetLayout();
-    VkBuffer getModelUniformBuffer(uint32_t index);
-    VkBuffer getCameraUniformBuffer(uint32_t index);
-    VkBuffer getBoneUniformBuffer(uint32_t index);
+    VkDescriptorBufferInfo getInstanceBufferInfo(uint32_t index);
+    VkDescriptorBufferInfo getCameraBufferInfo(uint32_t index);
+    VkDescriptorBufferInfo getBonePaletteBufferInfo(uint32_t index);
+    VkBuffer getSkinnedVertexBuffer();
+    VkBuffer getVisibleInstanceBuffer(uint32_t index);
 
     VkPhysicalDevice getPhysicalDevice();
     VkQueue getGraphicsQueue();
     VkCommandPool getCommandPool();
+    UploadManager &getUploadManager();
+    VkPipelineCache getPipelineCache();
+    const RunStats& getRunStats() const;
 };
 
 
@@ -0,0 +1,149 @@
+//
+// Created by cleme on 2020-02-14.
+//
+
+#include "AssetManager.hpp"
+#include "ModelAsset.hpp"
+#include "ThreadPool.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+
+AssetManager::AssetManager(){
+
+}
+
+AssetManager::AssetManager(Application *application, VkDevice &device){
+    this->application = application;
+    this->device = device;
+}
+
+/**
+ * Register the model at the specified path, or return the asset if it was already registered.
+ * The model is empty until importModels is called.
+ * @param vertexFormat layout of the vertices, packed vertices fall back to full ones when they are not precise enough
+ */
+std::shared_ptr<ModelAsset> AssetManager::loadModel(const std::string &path, VertexFormat vertexFormat, bool meshOptimization){
+    auto asset = this->modelAssets.find(path);
+    if(asset != this->modelAssets.end()){
+        return asset->second;
+    }
+
+    auto modelAsset = std::make_shared<ModelAsset>(this->application, this->device, path, vertexFormat, meshOptimization);
+    this->modelAssets[path] = modelAsset;
+    this->pendingAssets.push_back(modelAsset.get());
+
+    return modelAsset;
+}
+
+/**
+ * Import every pending model. The model files and then the images of the textures
+ * are decoded in parallel, each job is one file so the import takes about as long
+ * as the slowest file. The textures are uploaded once every image is decoded.
+ */
+void AssetManager::importModels(ThreadPool &threadPool){
+    if(this->pendingAssets.empty()){
+        return;
+    }
+    auto startTime = std::chrono::steady_clock::now();
+
+    //An exception can not leave a worker thread, the first one is thrown again on this thread
+    std::mutex errorMutex;
+    std::exception_ptr error = nullptr;
+    auto catchError = [&](auto &&job){
+        try{
+            job();
+        }catch(...){
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if(!error){
+                error = std::current_exception();
+            }
+        }
+    };
+
+    threadPool.parallelFor(static_cast<uint32_t>(this->pendingAssets.size()), [&](uint32_t begin, uint32_t end){
+        for(uint32_t i = begin ; i < end ; i++){
+            catchError([&](){ this->pendingAssets[i]->load(); });
+        }
+    });
+    if(error){
+        std::rethrow_exception(error);
+    }
+
+    //Every image is decoded once, even when several materials use it
+    std::vector<std::string> imagePaths;
+    std::map<std::string, uint32_t> imageIndices;
+    for(ModelAsset *asset : this->pendingAssets){
+        for(const std::string &texturePath : asset->getTexturePaths()){
+            if(imageIndices.find(texturePath) == imageIndices.end()){
+                imageIndices[texturePath] = static_cast<uint32_t>(imagePaths.size());
+                imagePaths.push_back(texturePath);
+            }
+        }
+    }
+
+    std::vector<DecodedImage> images(imagePaths.size());
+    threadPool.parallelFor(static_cast<uint32_t>(imagePaths.size()), [&](uint32_t begin, uint32_t end){
+        for(uint32_t i = begin ; i < end ; i++){
+            catchError([&](){ images[i] = Texture::decodeImage(imagePaths[i]); });
+        }
+    });
+    if(error){
+        std::rethrow_exception(error);
+    }
+    double decodeTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    //Vulkan uploads stay on this thread
+    for(ModelAsset *asset : this->pendingAssets){
+        std::vector<DecodedImage> assetImages;
+        for(const std::string &texturePath : asset->getTexturePaths()){
+            assetImages.push_back(images[imageIndices[texturePath]]);
+        }
+        asset->createTextures(assetImages);
+    }
+
+    double importTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    printf("Imported %zu models and %zu images on %u threads in %.2f ms (%.2f ms decoding, %.2f ms uploading)\n",
+           this->pendingAssets.size(), imagePaths.size(), threadPool.getThreadCount(),
+           importTime, decodeTime, importTime - decodeTime);
+
+    this->pendingAssets.clear();
+}
+
+/**
+ * @return every imported asset, in a stable order
+ */
+std::vector<ModelAsset*> AssetManager::getModelAssets(){
+    std::vector<ModelAsset*> assets;
+    for(auto &asset : this->modelAssets){
+        assets.push_back(asset.second.get());
+    }
+
+    return assets;
+}
+
+/**
+ * Create the GPU resources of the assets that depend on the swap chain
+ */
+void AssetManager::init(){
+    for(auto &asset : this->modelAssets){
+        asset.second->init();
+    }
+}
+
+void AssetManager::recreateDescriptorSets(){
+    for(auto &asset : this->modelAssets){
+        asset.second->recreateDescriptorSets();
+    }
+}
+
+void AssetManager::cleanup(){
+    for(auto &asset : this->modelAssets){
+        asset.second->cleanup();
+    }
+
+    this->modelAssets.clear();
+    this->pendingAssets.clear();
+}
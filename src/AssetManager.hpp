@@ -0,0 +1,47 @@
+//
+// Created by cleme on 2020-02-14.
+//
+
+#ifndef GAME_ENGINE_ASSETMANAGER_HPP
+#define GAME_ENGINE_ASSETMANAGER_HPP
+
+#include <vulkan/vulkan.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Vertex.hpp"
+
+class Application;
+class ModelAsset;
+class ThreadPool;
+
+/**
+ * Registry of the imported model files.
+ * Each file is imported once, every instance of it shares the same asset.
+ * The files are imported together by importModels, on every thread of a pool.
+ */
+class AssetManager {
+private:
+    Application *application = nullptr;
+    VkDevice device = VK_NULL_HANDLE;
+
+    std::map<std::string, std::shared_ptr<ModelAsset>> modelAssets;
+    //Assets registered by loadModel and not imported yet
+    std::vector<ModelAsset*> pendingAssets;
+
+public:
+    AssetManager();
+    AssetManager(Application *application, VkDevice &device);
+
+    std::shared_ptr<ModelAsset> loadModel(const std::string &path, VertexFormat vertexFormat = VertexFormat::Packed, bool meshOptimization = true);
+    void importModels(ThreadPool &threadPool);
+    std::vector<ModelAsset*> getModelAssets();
+
+    void init();
+    void recreateDescriptorSets();
+    void cleanup();
+};
+
+
+#endif //GAME_ENGINE_ASSETMANAGER_HPP
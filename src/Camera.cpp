@@ -61,6 +61,13 @@ glm::mat4 Camera::getViewMatrix() {
             );
 }
 
+/**
+ * @return The position of the camera in world space
+ */
+glm::vec3 Camera::getPosition() {
+    return this->cameraWorldPos;
+}
+
 void Camera::computeMatricesFromInputs(){
     static double lastTime = glfwGetTime();
 
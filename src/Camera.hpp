@@ -30,6 +30,7 @@ public:
     Camera(GLFWwindow *window);
     glm::mat4 getViewMatrix();
     glm::mat4 getProjectionMatrix();
+    glm::vec3 getPosition();
 };
 
 
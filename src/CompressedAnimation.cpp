@@ -0,0 +1,500 @@
+//
+// Created by cleme on 2020-02-20.
+//
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <stdexcept>
+#include "CompressedAnimation.hpp"
+#include "MeshCache.hpp"
+
+const float QUANTIZATION_STEPS = 65535.0f;
+//Largest value of the three smallest components of a normalized quaternion
+const float SMALLEST_THREE_RANGE = 0.70710678f;
+const float SMALLEST_THREE_STEPS = 32767.0f;
+
+uint16_t quantize(float value, float minimum, float extent){
+    if(extent <= 0.0f){
+        return 0;
+    }
+
+    float normalized = std::clamp((value - minimum) / extent, 0.0f, 1.0f);
+    return static_cast<uint16_t>(std::lround(normalized * QUANTIZATION_STEPS));
+}
+
+float dequantize(uint16_t value, float minimum, float extent){
+    return minimum + (static_cast<float>(value) / QUANTIZATION_STEPS) * extent;
+}
+
+/**
+ * Interpolate two keys the same way as the samplers do, normalized lerp for the rotations
+ */
+void interpolateKeys(TrackType type, const float *from, const float *to, float factor, float *result){
+    if(type != TrackType::Rotation){
+        for(uint32_t c = 0 ; c < 3 ; c++){
+            result[c] = from[c] + (to[c] - from[c]) * factor;
+        }
+        return;
+    }
+
+    float cosTheta = from[0] * to[0] + from[1] * to[1] + from[2] * to[2] + from[3] * to[3];
+    float sign = cosTheta < 0.0f ? -1.0f : 1.0f;
+    float lengthSquared = 0.0f;
+    for(uint32_t c = 0 ; c < 4 ; c++){
+        result[c] = from[c] + (to[c] * sign - from[c]) * factor;
+        lengthSquared += result[c] * result[c];
+    }
+
+    float inverseLength = 1.0f / std::sqrt(lengthSquared);
+    for(uint32_t c = 0 ; c < 4 ; c++){
+        result[c] *= inverseLength;
+    }
+}
+
+/**
+ * @return the largest difference between the components of two keys, q and -q are the same rotation
+ */
+float keyDistance(TrackType type, const float *a, const float *b){
+    if(type != TrackType::Rotation){
+        return std::max({std::fabs(a[0] - b[0]), std::fabs(a[1] - b[1]), std::fabs(a[2] - b[2])});
+    }
+
+    float same = 0.0f;
+    float opposite = 0.0f;
+    for(uint32_t c = 0 ; c < 4 ; c++){
+        same = std::max(same, std::fabs(a[c] - b[c]));
+        opposite = std::max(opposite, std::fabs(a[c] + b[c]));
+    }
+
+    return std::min(same, opposite);
+}
+
+/**
+ * Greedy key reduction: the segment starting at the last kept key grows as long as
+ * interpolating its ends reproduces every key inside it within the tolerance.
+ * @param values original values of the keys
+ * @param decoded values of the keys after quantization
+ * @return the indices of the kept keys
+ */
+std::vector<uint32_t> reduceKeys(TrackType type, const std::vector<float> &times, const std::vector<float> &values,
+                                 const std::vector<float> &decoded, float tolerance){
+    uint32_t components = type == TrackType::Rotation ? 4 : 3;
+    uint32_t keyCount = static_cast<uint32_t>(times.size());
+    if(keyCount < 2){
+        return {0};
+    }
+
+    //Constant tracks only keep their first key
+    bool constant = true;
+    for(uint32_t i = 0 ; i < keyCount && constant ; i++){
+        constant = keyDistance(type, &decoded[0], &values[i * components]) <= tolerance;
+    }
+    if(constant){
+        return {0};
+    }
+
+    std::vector<uint32_t> keptKeys = {0};
+    uint32_t anchor = 0;
+    for(uint32_t end = 2 ; end < keyCount ; end++){
+        bool valid = true;
+        for(uint32_t i = anchor + 1 ; i < end && valid ; i++){
+            float deltaTime = times[end] - times[anchor];
+            float factor = deltaTime > 0.0f ? (times[i] - times[anchor]) / deltaTime : 0.0f;
+
+            float interpolated[4];
+            interpolateKeys(type, &decoded[anchor * components], &decoded[end * components], factor, interpolated);
+            valid = keyDistance(type, interpolated, &values[i * components]) <= tolerance;
+        }
+
+        if(!valid){
+            anchor = end - 1;
+            keptKeys.push_back(anchor);
+        }
+    }
+    keptKeys.push_back(keyCount - 1);
+
+    return keptKeys;
+}
+
+/**
+ * Quantize the keys of a clip and drop the keys that can be interpolated from their neighbours
+ */
+CompressedAnimationClip::CompressedAnimationClip(const AnimationClip &clip, const Skeleton &skeleton, const ClipCompressionSettings &settings){
+    this->name = clip.getName();
+    this->duration = clip.getDuration();
+    this->ticksPerSecond = clip.getTicksPerSecond();
+
+    //Ranges of the translations and scales of the whole clip
+    float translationMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    float scaleMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    std::fill(this->translationMin, this->translationMin + 3, FLT_MAX);
+    std::fill(this->scaleMin, this->scaleMin + 3, FLT_MAX);
+
+    for(const AnimationChannel &channel : clip.getChannels()){
+        for(const glm::vec3 &position : channel.positions){
+            for(int c = 0 ; c < 3 ; c++){
+                this->translationMin[c] = std::min(this->translationMin[c], position[c]);
+                translationMax[c] = std::max(translationMax[c], position[c]);
+            }
+        }
+        for(const glm::vec3 &scale : channel.scales){
+            for(int c = 0 ; c < 3 ; c++){
+                this->scaleMin[c] = std::min(this->scaleMin[c], scale[c]);
+                scaleMax[c] = std::max(scaleMax[c], scale[c]);
+            }
+        }
+    }
+
+    for(int c = 0 ; c < 3 ; c++){
+        if(this->translationMin[c] > translationMax[c]){
+            this->translationMin[c] = translationMax[c] = 0.0f;
+        }
+        if(this->scaleMin[c] > scaleMax[c]){
+            this->scaleMin[c] = scaleMax[c] = 1.0f;
+        }
+        this->translationExtent[c] = translationMax[c] - this->translationMin[c];
+        this->scaleExtent[c] = scaleMax[c] - this->scaleMin[c];
+    }
+
+    //The channels of the nodes with the tallest subtrees come first
+    std::vector<const AnimationChannel*> sortedChannels;
+    for(const AnimationChannel &channel : clip.getChannels()){
+        sortedChannels.push_back(&channel);
+    }
+    std::stable_sort(sortedChannels.begin(), sortedChannels.end(), [&](const AnimationChannel *a, const AnimationChannel *b){
+        return skeleton.getNodeHeight(a->nodeIndex) > skeleton.getNodeHeight(b->nodeIndex);
+    });
+
+    for(const AnimationChannel *sortedChannel : sortedChannels){
+        const AnimationChannel &channel = *sortedChannel;
+        CompressedChannel compressedChannel;
+        compressedChannel.nodeIndex = channel.nodeIndex;
+        compressedChannel.nodeHeight = skeleton.getNodeHeight(channel.nodeIndex);
+
+        std::vector<float> values;
+        for(const glm::vec3 &position : channel.positions){
+            values.insert(values.end(), {position.x, position.y, position.z});
+        }
+        compressedChannel.translation = this->compressTrack(TrackType::Translation, channel.positionTimes, values, settings.translationTolerance);
+
+        values.clear();
+        for(const glm::quat &rotation : channel.rotations){
+            glm::quat normalized = glm::normalize(rotation);
+            values.insert(values.end(), {normalized.x, normalized.y, normalized.z, normalized.w});
+        }
+        compressedChannel.rotation = this->compressTrack(TrackType::Rotation, channel.rotationTimes, values, settings.rotationTolerance);
+
+        values.clear();
+        for(const glm::vec3 &scale : channel.scales){
+            values.insert(values.end(), {scale.x, scale.y, scale.z});
+        }
+        compressedChannel.scale = this->compressTrack(TrackType::Scale, channel.scaleTimes, values, settings.scaleTolerance);
+
+        this->channels.push_back(compressedChannel);
+    }
+
+    this->keyTimes.shrink_to_fit();
+    this->keyValues.shrink_to_fit();
+}
+
+/**
+ * Quantize the keys of one track, reduce them and append the kept keys to the key arrays
+ */
+CompressedTrack CompressedAnimationClip::compressTrack(TrackType type, const std::vector<float> &times, const std::vector<float> &values, float tolerance){
+    CompressedTrack track;
+    track.firstKey = static_cast<uint32_t>(this->keyTimes.size());
+
+    if(times.empty()){
+        return track;
+    }
+
+    uint32_t components = type == TrackType::Rotation ? 4 : 3;
+    std::vector<uint16_t> encoded(times.size() * 3);
+    std::vector<float> decoded(times.size() * components);
+    for(size_t i = 0 ; i < times.size() ; i++){
+        this->encodeKey(type, &values[i * components], &encoded[i * 3]);
+        this->decodeKey(type, &encoded[i * 3], &decoded[i * components]);
+    }
+
+    //The decoded keys are already up to half a quantization step away from the original ones,
+    //a smaller tolerance would keep every key of the clips with a large extent
+    float quantizationStep = 2.0f * SMALLEST_THREE_RANGE / SMALLEST_THREE_STEPS;
+    if(type != TrackType::Rotation){
+        const float *extent = type == TrackType::Translation ? this->translationExtent : this->scaleExtent;
+        quantizationStep = std::max({extent[0], extent[1], extent[2]}) / QUANTIZATION_STEPS;
+    }
+    tolerance = std::max(tolerance, quantizationStep);
+
+    for(uint32_t key : reduceKeys(type, times, values, decoded, tolerance)){
+        this->keyTimes.push_back(times[key]);
+        this->keyValues.insert(this->keyValues.end(), &encoded[key * 3], &encoded[key * 3] + 3);
+    }
+
+    track.keyCount = static_cast<uint32_t>(this->keyTimes.size()) - track.firstKey;
+    return track;
+}
+
+void CompressedAnimationClip::encodeKey(TrackType type, const float *value, uint16_t *key) const {
+    if(type == TrackType::Translation || type == TrackType::Scale){
+        const float *minimum = type == TrackType::Translation ? this->translationMin : this->scaleMin;
+        const float *extent = type == TrackType::Translation ? this->translationExtent : this->scaleExtent;
+        for(int c = 0 ; c < 3 ; c++){
+            key[c] = quantize(value[c], minimum[c], extent[c]);
+        }
+        return;
+    }
+
+    //Smallest three: the largest component is dropped and rebuilt from the unit length,
+    //its index takes 2 bits and the three others 15 bits each
+    uint32_t largest = 0;
+    for(uint32_t c = 1 ; c < 4 ; c++){
+        if(std::fabs(value[c]) > std::fabs(value[largest])){
+            largest = c;
+        }
+    }
+    float sign = value[largest] < 0.0f ? -1.0f : 1.0f;
+
+    uint64_t packed = largest;
+    for(uint32_t c = 0 ; c < 4 ; c++){
+        if(c == largest){
+            continue;
+        }
+        float normalized = std::clamp((value[c] * sign + SMALLEST_THREE_RANGE) / (2.0f * SMALLEST_THREE_RANGE), 0.0f, 1.0f);
+        packed = (packed << 15) | static_cast<uint64_t>(std::lround(normalized * SMALLEST_THREE_STEPS));
+    }
+
+    key[0] = static_cast<uint16_t>(packed >> 32);
+    key[1] = static_cast<uint16_t>(packed >> 16);
+    key[2] = static_cast<uint16_t>(packed);
+}
+
+void CompressedAnimationClip::decodeKey(TrackType type, const uint16_t *key, float *value) const {
+    if(type == TrackType::Translation || type == TrackType::Scale){
+        const float *minimum = type == TrackType::Translation ? this->translationMin : this->scaleMin;
+        const float *extent = type == TrackType::Translation ? this->translationExtent : this->scaleExtent;
+        for(int c = 0 ; c < 3 ; c++){
+            value[c] = dequantize(key[c], minimum[c], extent[c]);
+        }
+        return;
+    }
+
+    uint64_t packed = (static_cast<uint64_t>(key[0]) << 32) | (static_cast<uint64_t>(key[1]) << 16) | key[2];
+    uint32_t largest = static_cast<uint32_t>(packed >> 45) & 3;
+
+    float lengthSquared = 0.0f;
+    int shift = 30;
+    for(uint32_t c = 0 ; c < 4 ; c++){
+        if(c == largest){
+            continue;
+        }
+        float normalized = static_cast<float>((packed >> shift) & 0x7FFF) / SMALLEST_THREE_STEPS;
+        value[c] = normalized * 2.0f * SMALLEST_THREE_RANGE - SMALLEST_THREE_RANGE;
+        lengthSquared += value[c] * value[c];
+        shift -= 15;
+    }
+    value[largest] = std::sqrt(std::max(0.0f, 1.0f - lengthSquared));
+}
+
+/**
+ * Decode the keys around the sampled time and queue their interpolation
+ */
+void CompressedAnimationClip::gatherTrack(TrackType type, const CompressedTrack &track, uint32_t key, float animationTime, uint32_t node, PoseBlend &blend) const {
+    uint32_t components = type == TrackType::Rotation ? 4 : 3;
+    uint32_t firstKey = track.firstKey + key;
+
+    float from[4];
+    this->decodeKey(type, &this->keyValues[firstKey * 3], from);
+    if(track.keyCount == 1){
+        blend.add(node, 0.0f, from, from, components);
+        return;
+    }
+
+    float to[4];
+    this->decodeKey(type, &this->keyValues[(firstKey + 1) * 3], to);
+    blend.add(node, keyFactor(&this->keyTimes[track.firstKey], key, animationTime), from, to, components);
+}
+
+const std::string& CompressedAnimationClip::getName() const {
+    return this->name;
+}
+
+/**
+ * Read a clip written by writeCache, the keys are already compressed
+ */
+CompressedAnimationClip::CompressedAnimationClip(CacheReader &reader, const Skeleton &skeleton){
+    this->name = reader.readString();
+    this->duration = reader.read<float>();
+    this->ticksPerSecond = reader.read<float>();
+    for(int c = 0 ; c < 3 ; c++){
+        this->translationMin[c] = reader.read<float>();
+        this->translationExtent[c] = reader.read<float>();
+        this->scaleMin[c] = reader.read<float>();
+        this->scaleExtent[c] = reader.read<float>();
+    }
+
+    reader.readArray(this->channels);
+    reader.readArray(this->keyTimes);
+    reader.readArray(this->keyValues);
+
+    //The samplers trust the tracks, check them once here
+    bool valid = this->keyValues.size() == this->keyTimes.size() * 3;
+    for(const CompressedChannel &channel : this->channels){
+        valid = valid && channel.nodeIndex < skeleton.getNodeCount();
+        for(const CompressedTrack *track : {&channel.translation, &channel.rotation, &channel.scale}){
+            valid = valid && static_cast<uint64_t>(track->firstKey) + track->keyCount <= this->keyTimes.size();
+        }
+    }
+
+    if(!valid){
+        throw std::runtime_error("Corrupted animation " + this->name + " in mesh cache.");
+    }
+}
+
+void CompressedAnimationClip::writeCache(CacheWriter &writer) const {
+    writer.writeString(this->name);
+    writer.write(this->duration);
+    writer.write(this->ticksPerSecond);
+    for(int c = 0 ; c < 3 ; c++){
+        writer.write(this->translationMin[c]);
+        writer.write(this->translationExtent[c]);
+        writer.write(this->scaleMin[c]);
+        writer.write(this->scaleExtent[c]);
+    }
+
+    writer.writeArray(this->channels);
+    writer.writeArray(this->keyTimes);
+    writer.writeArray(this->keyValues);
+}
+
+/**
+ * @return the number of bytes used by the keys of the clip
+ */
+uint32_t CompressedAnimationClip::getKeyCount() const {
+    return static_cast<uint32_t>(this->keyTimes.size());
+}
+
+size_t CompressedAnimationClip::getMemorySize() const {
+    return sizeof(CompressedAnimationClip)
+         + this->channels.size() * sizeof(CompressedChannel)
+         + this->keyTimes.size() * sizeof(float)
+         + this->keyValues.size() * sizeof(uint16_t);
+}
+
+/**
+ * @return the time in ticks inside the clip, the clip is looped
+ */
+float CompressedAnimationClip::getAnimationTime(float timeInSeconds) const {
+    return fmod(timeInSeconds * this->ticksPerSecond, this->duration);
+}
+
+/**
+ * Overwrite the local transforms of the animated nodes of the pose, the keys are found with a binary search
+ */
+void CompressedAnimationClip::sample(float animationTime, Pose &pose) const {
+    AnimationCursor cursor;
+    this->sample(animationTime, pose, cursor);
+}
+
+/**
+ * Overwrite the local transforms of the animated nodes of the pose.
+ * The keys are advanced from the previous sample of the cursor when the time moved forward.
+ * @param minimumHeight the nodes closer than this to a leaf of the skeleton keep their current transform
+ */
+void CompressedAnimationClip::sample(float animationTime, Pose &pose, AnimationCursor &cursor, uint32_t minimumHeight) const {
+    bool forward = cursor.clip == this && animationTime >= cursor.lastTime && minimumHeight >= cursor.minimumHeight;
+
+    if(cursor.clip != this){
+        cursor.clip = this;
+        cursor.positionKeys.assign(this->channels.size(), 0);
+        cursor.rotationKeys.assign(this->channels.size(), 0);
+        cursor.scaleKeys.assign(this->channels.size(), 0);
+    }
+    cursor.lastTime = animationTime;
+    cursor.minimumHeight = minimumHeight;
+
+    clearKeys(pose);
+
+    for(size_t i = 0 ; i < this->channels.size() && this->channels[i].nodeHeight >= minimumHeight ; i++){
+        const CompressedChannel &channel = this->channels[i];
+
+        if(channel.translation.keyCount > 0){
+            uint32_t key = findKey(&this->keyTimes[channel.translation.firstKey], channel.translation.keyCount, animationTime, cursor.positionKeys[i], forward);
+            this->gatherTrack(TrackType::Translation, channel.translation, key, animationTime, channel.nodeIndex, pose.translationKeys);
+        }
+        if(channel.rotation.keyCount > 0){
+            uint32_t key = findKey(&this->keyTimes[channel.rotation.firstKey], channel.rotation.keyCount, animationTime, cursor.rotationKeys[i], forward);
+            this->gatherTrack(TrackType::Rotation, channel.rotation, key, animationTime, channel.nodeIndex, pose.rotationKeys);
+        }
+        if(channel.scale.keyCount > 0){
+            uint32_t key = findKey(&this->keyTimes[channel.scale.firstKey], channel.scale.keyCount, animationTime, cursor.scaleKeys[i], forward);
+            this->gatherTrack(TrackType::Scale, channel.scale, key, animationTime, channel.nodeIndex, pose.scaleKeys);
+        }
+    }
+
+    blendPose(pose);
+}
+
+/**
+ * Length of a column of the 3x3 part of a transform, the scale of the transform along that axis
+ */
+float columnLength(const AffineTransform &transform, int column){
+    return std::sqrt(transform.rows[0][column] * transform.rows[0][column]
+                   + transform.rows[1][column] * transform.rows[1][column]
+                   + transform.rows[2][column] * transform.rows[2][column]);
+}
+
+/**
+ * Sample both clips every tick, or at most 1000 times, and compare the bone palettes.
+ * The errors of the local transforms add up along the chains of bones, the palettes give the error seen on the skinned vertices.
+ */
+ClipCompressionError measureCompressionError(const AnimationClip &clip, const CompressedAnimationClip &compressedClip, const Skeleton &skeleton){
+    ClipCompressionError error;
+    Pose pose;
+    Pose compressedPose;
+    std::vector<AffineTransform> palette(skeleton.getBoneCount());
+    std::vector<AffineTransform> compressedPalette(skeleton.getBoneCount());
+
+    float step = std::max(1.0f, clip.getDuration() / 1000.0f);
+    for(float animationTime = 0.0f ; animationTime <= clip.getDuration() ; animationTime += step){
+        skeleton.resetPose(pose);
+        skeleton.resetPose(compressedPose);
+        clip.sample(animationTime, pose);
+        compressedClip.sample(animationTime, compressedPose);
+        skeleton.computeBonePalette(pose, palette.data());
+        skeleton.computeBonePalette(compressedPose, compressedPalette.data());
+
+        for(uint32_t bone = 0 ; bone < skeleton.getBoneCount() ; bone++){
+            const AffineTransform &transform = palette[bone];
+            const AffineTransform &compressedTransform = compressedPalette[bone];
+
+            float translationDistance = 0.0f;
+            float scaleDistance = 0.0f;
+            float lengths[3];
+            float compressedLengths[3];
+            for(int c = 0 ; c < 3 ; c++){
+                float translationDelta = transform.rows[c][3] - compressedTransform.rows[c][3];
+                translationDistance += translationDelta * translationDelta;
+
+                lengths[c] = std::max(columnLength(transform, c), FLT_MIN);
+                compressedLengths[c] = std::max(columnLength(compressedTransform, c), FLT_MIN);
+                scaleDistance = std::max(scaleDistance, std::fabs(lengths[c] - compressedLengths[c]));
+            }
+
+            //Angle of the rotation between both transforms, from the trace of transpose(R) * compressedR
+            float trace = 0.0f;
+            for(int row = 0 ; row < 3 ; row++){
+                for(int column = 0 ; column < 3 ; column++){
+                    trace += transform.rows[row][column] / lengths[column] * compressedTransform.rows[row][column] / compressedLengths[column];
+                }
+            }
+            float angle = std::acos(std::clamp((trace - 1.0f) * 0.5f, -1.0f, 1.0f));
+
+            error.translation = std::max(error.translation, std::sqrt(translationDistance));
+            error.rotationDegrees = std::max(error.rotationDegrees, glm::degrees(angle));
+            error.scale = std::max(error.scale, scaleDistance);
+        }
+    }
+
+    return error;
+}
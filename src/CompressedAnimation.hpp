@@ -0,0 +1,105 @@
+//
+// Created by cleme on 2020-02-20.
+//
+
+#ifndef GAME_ENGINE_COMPRESSEDANIMATION_HPP
+#define GAME_ENGINE_COMPRESSEDANIMATION_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Animation.hpp"
+#include "Skeleton.hpp"
+
+class CacheReader;
+class CacheWriter;
+
+/**
+ * Maximum error allowed when a key is dropped, in model units for the
+ * translations and scales and in quaternion components for the rotations.
+ * The tolerances are raised to one quantization step of the clip when they are smaller.
+ */
+struct ClipCompressionSettings {
+    float translationTolerance = 0.001f;
+    float rotationTolerance = 0.0005f;
+    float scaleTolerance = 0.0005f;
+};
+
+/**
+ * Largest difference between a clip and its compressed version, measured on the bone palettes in model space.
+ */
+struct ClipCompressionError {
+    float translation = 0.0f;
+    float rotationDegrees = 0.0f;
+    float scale = 0.0f;
+};
+
+/**
+ * Range of the keys of one track in the key arrays of the clip
+ */
+struct CompressedTrack {
+    uint32_t firstKey = 0;
+    uint32_t keyCount = 0;
+};
+
+struct CompressedChannel {
+    uint32_t nodeIndex = 0;
+    uint32_t nodeHeight = 0;
+    CompressedTrack translation;
+    CompressedTrack rotation;
+    CompressedTrack scale;
+};
+
+enum class TrackType {
+    Translation,
+    Rotation,
+    Scale
+};
+
+/**
+ * Animation clip with its keys reduced and quantized.
+ * Every key takes 48 bits: translations and scales are three 16 bit values
+ * inside the range of the clip, rotations use the smallest three encoding.
+ * The channels are sorted from the root to the leaves of the skeleton so that
+ * the animation LOD can skip the channels of the small bones.
+ */
+class CompressedAnimationClip {
+private:
+    std::string name;
+    float duration;
+    float ticksPerSecond;
+    std::vector<CompressedChannel> channels;
+
+    std::vector<float> keyTimes;
+    std::vector<uint16_t> keyValues;
+
+    //Quantization ranges of the clip
+    float translationMin[3] = {0.0f};
+    float translationExtent[3] = {0.0f};
+    float scaleMin[3] = {0.0f};
+    float scaleExtent[3] = {0.0f};
+
+    CompressedTrack compressTrack(TrackType type, const std::vector<float> &times, const std::vector<float> &values, float tolerance);
+    void encodeKey(TrackType type, const float *value, uint16_t *key) const;
+    void decodeKey(TrackType type, const uint16_t *key, float *value) const;
+    void gatherTrack(TrackType type, const CompressedTrack &track, uint32_t key, float animationTime, uint32_t node, PoseBlend &blend) const;
+
+public:
+    CompressedAnimationClip(const AnimationClip &clip, const Skeleton &skeleton, const ClipCompressionSettings &settings);
+    CompressedAnimationClip(CacheReader &reader, const Skeleton &skeleton);
+
+    void writeCache(CacheWriter &writer) const;
+
+    const std::string& getName() const;
+    uint32_t getKeyCount() const;
+    size_t getMemorySize() const;
+
+    float getAnimationTime(float timeInSeconds) const;
+    void sample(float animationTime, Pose &pose) const;
+    void sample(float animationTime, Pose &pose, AnimationCursor &cursor, uint32_t minimumHeight = 0) const;
+};
+
+ClipCompressionError measureCompressionError(const AnimationClip &clip, const CompressedAnimationClip &compressedClip, const Skeleton &skeleton);
+
+
+#endif //GAME_ENGINE_COMPRESSEDANIMATION_HPP
@@ -0,0 +1,396 @@
+//
+// Created by cleme on 2020-02-27.
+//
+
+#include "Application.hpp"
+#include "CullingPass.hpp"
+#include "HiZPass.hpp"
+#include "SkinningPass.hpp"
+#include "../include/helper/FileHelper.hpp"
+
+const uint32_t CULLING_GROUP_SIZE = 64;
+
+CullingPass::CullingPass(){
+
+}
+
+CullingPass::CullingPass(Application *application, VkDevice &device){
+    this->application = application;
+    this->device = device;
+}
+
+/**
+ * Create the draw buffers of every swap chain image, the pipeline must be created first
+ * @param draws the draws of every instance batch, their instance count is set by the culling
+ * @param batchCount number of instance batches, each batch has its own draw count
+ * @param skinningPass the pass skinning the instances drawn by each phase
+ * @param hiZPass the depth pyramid tested by the occlusion culling
+ */
+void CullingPass::init(const std::vector<VkDrawIndexedIndirectCommand> &draws, uint32_t batchCount, uint32_t instanceCount, SkinningPass &skinningPass, HiZPass &hiZPass){
+    this->drawCount = static_cast<uint32_t>(draws.size());
+    this->batchCount = batchCount;
+    this->instanceCount = instanceCount;
+
+    this->createBuffers(draws);
+    this->createDescriptorSets(skinningPass, hiZPass);
+}
+
+void CullingPass::createDescriptorSetLayout(){
+    //Camera matrices, then instances, draws, draw counts and visible instances,
+    //the depth pyramid and its camera, then the instances drawn by the first phase, the stats
+    //and the indirect dispatches and the instances of the skinning pass
+    std::array<VkDescriptorSetLayoutBinding, 11> bindings = {};
+    for(uint32_t i = 0 ; i < bindings.size() ; i++){
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        if(i == 0 || i == 6){
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        }else if(i == 5){
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        }
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if(vkCreateDescriptorSetLayout(this->device, &layoutInfo, nullptr, &this->descriptorSetLayout) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create culling descriptor set layout.");
+    }
+}
+
+/**
+ * Create the descriptor set layout and the compute pipeline, they are kept when the buffers are created again.
+ * Can run on any thread, along with the creation of the other pipelines.
+ */
+void CullingPass::createPipeline(){
+    this->createDescriptorSetLayout();
+
+    auto computeShaderCode = readFile("./shaders/build/culling.spv");
+    VkShaderModule computeShaderModule = createShaderModule(&this->device, computeShaderCode);
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullingParameters);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &this->descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if(vkCreatePipelineLayout(this->device, &pipelineLayoutInfo, nullptr, &this->pipelineLayout) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create culling pipeline layout.");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = computeShaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = this->pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    if(vkCreateComputePipelines(this->device, this->application->getPipelineCache(), 1, &pipelineInfo, nullptr, &this->pipeline) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create culling pipeline.");
+    }
+
+    vkDestroyShaderModule(this->device, computeShaderModule, nullptr);
+}
+
+/**
+ * The draws, draw counts and visible instances of the second phase follow the ones of the first phase
+ */
+void CullingPass::createBuffers(const std::vector<VkDrawIndexedIndirectCommand> &draws){
+    VkDeviceSize drawBufferSize = sizeof(VkDrawIndexedIndirectCommand) * std::max<uint32_t>(this->drawCount, 1) * 2;
+    VkDeviceSize drawCountBufferSize = sizeof(uint32_t) * std::max<uint32_t>(this->batchCount, 1) * 2;
+    VkDeviceSize visibleInstanceBufferSize = sizeof(uint32_t) * std::max<uint32_t>(this->instanceCount, 1) * 2;
+    VkDeviceSize instanceVisibilityBufferSize = sizeof(uint32_t) * std::max<uint32_t>(this->instanceCount, 1);
+
+    //The instances of the second phase are compacted after the ones of the first phase
+    std::vector<VkDrawIndexedIndirectCommand> phaseDraws(draws);
+    for(VkDrawIndexedIndirectCommand draw : draws){
+        draw.firstInstance += this->instanceCount;
+        phaseDraws.push_back(draw);
+    }
+
+    //The template is uploaded once, the draw buffers are reset from it at every frame
+    this->application->createBuffer(drawBufferSize,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            this->drawTemplateBuffer,
+            this->drawTemplateBufferMemory);
+    if(!phaseDraws.empty()){
+        this->application->getUploadManager().uploadBuffer(this->drawTemplateBuffer, 0, phaseDraws.data(), sizeof(VkDrawIndexedIndirectCommand) * phaseDraws.size());
+    }
+
+    uint32_t nbFrameBuffers = this->application->getSwapChainImagesCount();
+    this->drawBuffers.resize(nbFrameBuffers);
+    this->drawBufferMemory.resize(nbFrameBuffers);
+    this->drawCountBuffers.resize(nbFrameBuffers);
+    this->drawCountBufferMemory.resize(nbFrameBuffers);
+    this->visibleInstanceBuffers.resize(nbFrameBuffers);
+    this->visibleInstanceBufferMemory.resize(nbFrameBuffers);
+    this->instanceVisibilityBuffers.resize(nbFrameBuffers);
+    this->instanceVisibilityBufferMemory.resize(nbFrameBuffers);
+    this->statsBuffers.resize(nbFrameBuffers);
+    this->statsBufferMemory.resize(nbFrameBuffers);
+    for(uint32_t i = 0 ; i < nbFrameBuffers ; i++){
+        this->application->createBuffer(drawBufferSize,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                this->drawBuffers[i],
+                this->drawBufferMemory[i]);
+
+        this->application->createBuffer(drawCountBufferSize,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                this->drawCountBuffers[i],
+                this->drawCountBufferMemory[i]);
+
+        this->application->createBuffer(visibleInstanceBufferSize,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                this->visibleInstanceBuffers[i],
+                this->visibleInstanceBufferMemory[i]);
+
+        this->application->createBuffer(instanceVisibilityBufferSize,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                this->instanceVisibilityBuffers[i],
+                this->instanceVisibilityBufferMemory[i]);
+
+        this->application->createBuffer(sizeof(CullingStats),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                this->statsBuffers[i],
+                this->statsBufferMemory[i]);
+
+        memset(this->statsBufferMemory[i].mappedData, 0, sizeof(CullingStats));
+    }
+}
+
+void CullingPass::createDescriptorSets(SkinningPass &skinningPass, HiZPass &hiZPass){
+    uint32_t nbFrameBuffers = this->application->getSwapChainImagesCount();
+
+    std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = nbFrameBuffers * 2;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = nbFrameBuffers * 8;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[2].descriptorCount = nbFrameBuffers;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = nbFrameBuffers;
+    poolInfo.flags = 0;
+
+    if(vkCreateDescriptorPool(this->device, &poolInfo, nullptr, &this->descriptorPool) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create culling descriptor pool.");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(nbFrameBuffers, this->descriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = this->descriptorPool;
+    allocInfo.descriptorSetCount = nbFrameBuffers;
+    allocInfo.pSetLayouts = layouts.data();
+
+    this->descriptorSets.resize(nbFrameBuffers);
+    if(vkAllocateDescriptorSets(this->device, &allocInfo, this->descriptorSets.data()) != VK_SUCCESS){
+        throw std::runtime_error("Failed to allocate culling descriptor sets.");
+    }
+
+    for(uint32_t frameBufferIndex = 0 ; frameBufferIndex < nbFrameBuffers ; frameBufferIndex++){
+        //The depth pyramid is the only image, its buffer info is unused
+        std::array<VkDescriptorBufferInfo, 11> bufferInfos = {};
+        bufferInfos[2].buffer = this->drawBuffers[frameBufferIndex];
+        bufferInfos[3].buffer = this->drawCountBuffers[frameBufferIndex];
+        bufferInfos[4].buffer = this->visibleInstanceBuffers[frameBufferIndex];
+        bufferInfos[6].buffer = hiZPass.getCameraBuffer();
+        bufferInfos[7].buffer = this->instanceVisibilityBuffers[frameBufferIndex];
+        bufferInfos[8].buffer = this->statsBuffers[frameBufferIndex];
+        bufferInfos[9].buffer = skinningPass.getDispatchBuffer(frameBufferIndex);
+        bufferInfos[10].buffer = skinningPass.getInstanceListBuffer(frameBufferIndex);
+        for(VkDescriptorBufferInfo &bufferInfo : bufferInfos){
+            bufferInfo.offset = 0;
+            bufferInfo.range = VK_WHOLE_SIZE;
+        }
+        //The camera and the instances are slices of the frame ring buffer
+        bufferInfos[0] = this->application->getCameraBufferInfo(frameBufferIndex);
+        bufferInfos[1] = this->application->getInstanceBufferInfo(frameBufferIndex);
+
+        VkDescriptorImageInfo pyramidInfo = {};
+        pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        pyramidInfo.imageView = hiZPass.getPyramidView();
+        pyramidInfo.sampler = hiZPass.getPyramidSampler();
+
+        std::array<VkWriteDescriptorSet, 11> descriptorWrites = {};
+        for(uint32_t i = 0 ; i < descriptorWrites.size() ; i++){
+            descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[i].dstSet = this->descriptorSets[frameBufferIndex];
+            descriptorWrites[i].dstBinding = i;
+            descriptorWrites[i].dstArrayElement = 0;
+            descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[i].descriptorCount = 1;
+            descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+        }
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[6].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[5].pBufferInfo = nullptr;
+        descriptorWrites[5].pImageInfo = &pyramidInfo;
+
+        vkUpdateDescriptorSets(this->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+}
+
+/**
+ * Point the descriptor sets to the depth pyramid and its camera again, once the pyramid is resized
+ */
+void CullingPass::setDepthPyramid(HiZPass &hiZPass){
+    VkDescriptorImageInfo pyramidInfo = {};
+    pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    pyramidInfo.imageView = hiZPass.getPyramidView();
+    pyramidInfo.sampler = hiZPass.getPyramidSampler();
+
+    VkDescriptorBufferInfo cameraInfo = {};
+    cameraInfo.buffer = hiZPass.getCameraBuffer();
+    cameraInfo.offset = 0;
+    cameraInfo.range = VK_WHOLE_SIZE;
+
+    for(VkDescriptorSet descriptorSet : this->descriptorSets){
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+        for(uint32_t i = 0 ; i < descriptorWrites.size() ; i++){
+            descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[i].dstSet = descriptorSet;
+            descriptorWrites[i].dstArrayElement = 0;
+            descriptorWrites[i].descriptorCount = 1;
+        }
+        descriptorWrites[0].dstBinding = 5;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[0].pImageInfo = &pyramidInfo;
+        descriptorWrites[1].dstBinding = 6;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[1].pBufferInfo = &cameraInfo;
+
+        vkUpdateDescriptorSets(this->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+}
+
+/**
+ * Record the reset of the draws and the first culling phase, against the depth pyramid of the previous frame.
+ * Must be recorded outside of a render pass.
+ * @param occlusionCulling false to only cull against the frustum, the second phase is then not needed
+ */
+void CullingPass::recordFirstPhase(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool occlusionCulling){
+    VkBufferCopy copyRegion = {};
+    copyRegion.size = sizeof(VkDrawIndexedIndirectCommand) * std::max<uint32_t>(this->drawCount, 1) * 2;
+    vkCmdCopyBuffer(commandBuffer, this->drawTemplateBuffer, this->drawBuffers[imageIndex], 1, &copyRegion);
+    vkCmdFillBuffer(commandBuffer, this->drawCountBuffers[imageIndex], 0, VK_WHOLE_SIZE, 0);
+    vkCmdFillBuffer(commandBuffer, this->statsBuffers[imageIndex], 0, VK_WHOLE_SIZE, 0);
+
+    VkMemoryBarrier resetBarrier = {};
+    resetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         1, &resetBarrier, 0, nullptr, 0, nullptr);
+
+    this->recordPhase(commandBuffer, imageIndex, 0, occlusionCulling);
+}
+
+/**
+ * Record the second culling phase, against the depth pyramid built from the draws of the first phase
+ */
+void CullingPass::recordSecondPhase(VkCommandBuffer commandBuffer, uint32_t imageIndex){
+    this->recordPhase(commandBuffer, imageIndex, 1, true);
+}
+
+/**
+ * Record the culling of every instance and the barrier that makes the draws visible to the indirect
+ * draw commands, the visible instances to the vertex shader and the stats to the host
+ */
+void CullingPass::recordPhase(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t phase, bool occlusionCulling){
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 0, 1, &this->descriptorSets[imageIndex], 0, nullptr);
+
+    CullingParameters parameters = {};
+    parameters.instanceCount = this->instanceCount;
+    parameters.drawCount = this->drawCount;
+    parameters.batchCount = this->batchCount;
+    parameters.phase = phase;
+    parameters.occlusionCulling = occlusionCulling ? 1 : 0;
+    vkCmdPushConstants(commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullingParameters), &parameters);
+    vkCmdDispatch(commandBuffer, (this->instanceCount + CULLING_GROUP_SIZE - 1) / CULLING_GROUP_SIZE, 1, 1);
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+/**
+ * Stats of the last frame rendered with the given image, only valid once the frame is done
+ */
+CullingStats CullingPass::getStats(uint32_t imageIndex){
+    CullingStats stats = {};
+    memcpy(&stats, this->statsBufferMemory[imageIndex].mappedData, sizeof(CullingStats));
+    return stats;
+}
+
+VkBuffer CullingPass::getDrawBuffer(uint32_t imageIndex){
+    return this->drawBuffers[imageIndex];
+}
+
+VkBuffer CullingPass::getDrawCountBuffer(uint32_t imageIndex){
+    return this->drawCountBuffers[imageIndex];
+}
+
+VkBuffer CullingPass::getVisibleInstanceBuffer(uint32_t imageIndex){
+    return this->visibleInstanceBuffers[imageIndex];
+}
+
+void CullingPass::cleanup(){
+    for(size_t i = 0 ; i < this->drawBuffers.size() ; i++){
+        this->application->destroyBuffer(this->drawBuffers[i], this->drawBufferMemory[i]);
+        this->application->destroyBuffer(this->drawCountBuffers[i], this->drawCountBufferMemory[i]);
+        this->application->destroyBuffer(this->visibleInstanceBuffers[i], this->visibleInstanceBufferMemory[i]);
+        this->application->destroyBuffer(this->instanceVisibilityBuffers[i], this->instanceVisibilityBufferMemory[i]);
+        this->application->destroyBuffer(this->statsBuffers[i], this->statsBufferMemory[i]);
+    }
+    this->drawBuffers.clear();
+    this->drawBufferMemory.clear();
+    this->drawCountBuffers.clear();
+    this->drawCountBufferMemory.clear();
+    this->visibleInstanceBuffers.clear();
+    this->visibleInstanceBufferMemory.clear();
+    this->instanceVisibilityBuffers.clear();
+    this->instanceVisibilityBufferMemory.clear();
+    this->statsBuffers.clear();
+    this->statsBufferMemory.clear();
+
+    this->application->destroyBuffer(this->drawTemplateBuffer, this->drawTemplateBufferMemory);
+
+    vkDestroyDescriptorPool(this->device, this->descriptorPool, nullptr);
+}
+
+void CullingPass::cleanupPipeline(){
+    vkDestroyPipeline(this->device, this->pipeline, nullptr);
+    vkDestroyPipelineLayout(this->device, this->pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(this->device, this->descriptorSetLayout, nullptr);
+}
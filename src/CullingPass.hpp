@@ -0,0 +1,105 @@
+//
+// Created by cleme on 2020-02-27.
+//
+
+#ifndef GAME_ENGINE_CULLINGPASS_HPP
+#define GAME_ENGINE_CULLINGPASS_HPP
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+#include "MemoryAllocator.hpp"
+
+class Application;
+class HiZPass;
+class SkinningPass;
+
+/**
+ * Parameters of the culling dispatch, sent as push constants
+ */
+struct CullingParameters {
+    uint32_t instanceCount;
+    uint32_t drawCount;
+    uint32_t batchCount;
+    uint32_t phase;
+    uint32_t occlusionCulling;
+};
+
+/**
+ * Number of instances culled and drawn by a frame
+ */
+struct CullingStats {
+    uint32_t frustumCulled;
+    uint32_t occlusionCulled;
+    uint32_t firstPhaseDrawn;
+    uint32_t secondPhaseDrawn;
+};
+
+/**
+ * Compute pre-pass that culls the instances and builds the indirect draws, in two phases.
+ * The first phase tests the instances against the view frustum and the depth pyramid of the
+ * previous frame. The second phase, recorded once the pyramid is rebuilt from the depth of the
+ * first phase, tests the instances rejected by the pyramid again so that nothing visible is dropped.
+ *
+ * Each phase has its own draws: each draw of an instance batch gets the number of visible instances
+ * of the batch, the indices of the visible instances are compacted from the first instance of the
+ * batch. The draw count of a batch is zero when none of its instances is visible.
+ * The instances drawn by each phase are also listed for the skinning pass, with their count in its indirect dispatch.
+ */
+class CullingPass {
+private:
+    Application *application = nullptr;
+    VkDevice device = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> descriptorSets;
+
+    //Draws of every batch with no instance, copied to the draw buffers before the culling
+    VkBuffer drawTemplateBuffer = VK_NULL_HANDLE;
+    MemoryAllocation drawTemplateBufferMemory;
+    std::vector<VkBuffer> drawBuffers;
+    std::vector<MemoryAllocation> drawBufferMemory;
+    std::vector<VkBuffer> drawCountBuffers;
+    std::vector<MemoryAllocation> drawCountBufferMemory;
+    std::vector<VkBuffer> visibleInstanceBuffers;
+    std::vector<MemoryAllocation> visibleInstanceBufferMemory;
+    std::vector<VkBuffer> instanceVisibilityBuffers;
+    std::vector<MemoryAllocation> instanceVisibilityBufferMemory;
+    //Read back by the host once the frame is done
+    std::vector<VkBuffer> statsBuffers;
+    std::vector<MemoryAllocation> statsBufferMemory;
+
+    uint32_t instanceCount = 0;
+    uint32_t drawCount = 0;
+    uint32_t batchCount = 0;
+
+    void createDescriptorSetLayout();
+    void createBuffers(const std::vector<VkDrawIndexedIndirectCommand> &draws);
+    void createDescriptorSets(SkinningPass &skinningPass, HiZPass &hiZPass);
+    void recordPhase(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t phase, bool occlusionCulling);
+
+public:
+    CullingPass();
+    CullingPass(Application *application, VkDevice &device);
+
+    void createPipeline();
+    void init(const std::vector<VkDrawIndexedIndirectCommand> &draws, uint32_t batchCount, uint32_t instanceCount, SkinningPass &skinningPass, HiZPass &hiZPass);
+    void setDepthPyramid(HiZPass &hiZPass);
+    void recordFirstPhase(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool occlusionCulling);
+    void recordSecondPhase(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    CullingStats getStats(uint32_t imageIndex);
+
+    VkBuffer getDrawBuffer(uint32_t imageIndex);
+    VkBuffer getDrawCountBuffer(uint32_t imageIndex);
+    VkBuffer getVisibleInstanceBuffer(uint32_t imageIndex);
+
+    void cleanup();
+    void cleanupPipeline();
+};
+
+
+#endif //GAME_ENGINE_CULLINGPASS_HPP
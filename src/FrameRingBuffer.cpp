@@ -0,0 +1,117 @@
+//
+// Created by cleme on 2020-03-01.
+//
+
+#include <stdexcept>
+#include "FrameRingBuffer.hpp"
+
+FrameRingBuffer::FrameRingBuffer(){
+
+}
+
+/**
+ * @param alignment alignment of the slices, must cover the offset alignment of the descriptors bound to them
+ */
+FrameRingBuffer::FrameRingBuffer(MemoryAllocator *memoryAllocator, VkDevice &device, VkDeviceSize alignment){
+    this->memoryAllocator = memoryAllocator;
+    this->device = device;
+    this->alignment = alignment;
+}
+
+VkDeviceSize FrameRingBuffer::align(VkDeviceSize offset, VkDeviceSize alignment){
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * Reserve a range at the same offset of every frame, must be called before init
+ */
+FrameSlice FrameRingBuffer::reserve(VkDeviceSize size){
+    FrameSlice slice = {};
+    slice.offset = this->sliceSize;
+    slice.size = size;
+    this->sliceSize = align(this->sliceSize + size, this->alignment);
+    return slice;
+}
+
+/**
+ * Create the buffer, mapped for its whole lifetime
+ * @param streamingSize bytes of every frame that can be allocated during the frame, after the slices
+ */
+void FrameRingBuffer::init(uint32_t frameCount, VkDeviceSize streamingSize){
+    this->frameCount = frameCount;
+    this->frameSize = align(this->sliceSize + streamingSize, this->alignment);
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = this->frameSize * this->frameCount;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if(vkCreateBuffer(this->device, &bufferInfo, nullptr, &this->buffer) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create the frame ring buffer.");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(this->device, this->buffer, &memRequirements);
+
+    this->bufferMemory = this->memoryAllocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true);
+    vkBindBufferMemory(this->device, this->buffer, this->bufferMemory.memory, this->bufferMemory.offset);
+}
+
+/**
+ * Start writing the frame, the GPU must be done with its previous content
+ */
+void FrameRingBuffer::beginFrame(uint32_t frameIndex){
+    this->currentFrame = frameIndex;
+    this->head = this->sliceSize;
+}
+
+/**
+ * Mapped slice of the current frame
+ */
+void *FrameRingBuffer::getData(const FrameSlice &slice){
+    return static_cast<char*>(this->bufferMemory.mappedData) + this->frameSize * this->currentFrame + slice.offset;
+}
+
+/**
+ * Allocate a range of the current frame, freed when the frame is written again
+ * @param alignment alignment of the offset of the range in the buffer
+ * @return the mapped range and its offset in the buffer
+ */
+FrameAllocation FrameRingBuffer::allocate(VkDeviceSize size, VkDeviceSize alignment){
+    VkDeviceSize frameOffset = this->frameSize * this->currentFrame;
+    VkDeviceSize offset = align(frameOffset + this->head, alignment);
+    if(offset + size > frameOffset + this->frameSize){
+        throw std::runtime_error("The frame ring buffer is full.");
+    }
+
+    FrameAllocation allocation = {};
+    allocation.offset = offset;
+    allocation.data = static_cast<char*>(this->bufferMemory.mappedData) + offset;
+    this->head = offset + size - frameOffset;
+    return allocation;
+}
+
+VkBuffer FrameRingBuffer::getBuffer(){
+    return this->buffer;
+}
+
+/**
+ * Descriptor range of a slice in the given frame
+ */
+VkDescriptorBufferInfo FrameRingBuffer::getBufferInfo(const FrameSlice &slice, uint32_t frameIndex){
+    VkDescriptorBufferInfo bufferInfo = {};
+    bufferInfo.buffer = this->buffer;
+    bufferInfo.offset = this->frameSize * frameIndex + slice.offset;
+    bufferInfo.range = slice.size;
+    return bufferInfo;
+}
+
+void FrameRingBuffer::cleanup(){
+    vkDestroyBuffer(this->device, this->buffer, nullptr);
+    this->memoryAllocator->free(this->bufferMemory);
+    this->buffer = VK_NULL_HANDLE;
+    this->sliceSize = 0;
+    this->frameSize = 0;
+    this->head = 0;
+}
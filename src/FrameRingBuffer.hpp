@@ -0,0 +1,74 @@
+//
+// Created by cleme on 2020-03-01.
+//
+
+#ifndef GAME_ENGINE_FRAMERINGBUFFER_HPP
+#define GAME_ENGINE_FRAMERINGBUFFER_HPP
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+
+#include "MemoryAllocator.hpp"
+
+/**
+ * Range reserved at the same place in every frame of the ring buffer, so that the
+ * descriptor sets and the recorded command buffers can point to it
+ */
+struct FrameSlice {
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+};
+
+/**
+ * Range allocated for the current frame only
+ */
+struct FrameAllocation {
+    void *data = nullptr;
+    VkDeviceSize offset = 0;
+};
+
+/**
+ * Persistently mapped host visible buffer holding the data streamed to the GPU at every frame.
+ * The buffer has one frame per swap chain image, the host writes the frame of the image it is
+ * about to submit while the GPU reads the others.
+ *
+ * Each frame starts with the slices reserved before init, then the ranges allocated during the
+ * frame, which must be bound with dynamic offsets.
+ */
+class FrameRingBuffer {
+private:
+    MemoryAllocator *memoryAllocator = nullptr;
+    VkDevice device = VK_NULL_HANDLE;
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    MemoryAllocation bufferMemory;
+
+    VkDeviceSize alignment = 1;
+    VkDeviceSize sliceSize = 0;
+    VkDeviceSize frameSize = 0;
+    uint32_t frameCount = 0;
+
+    uint32_t currentFrame = 0;
+    VkDeviceSize head = 0;
+
+    static VkDeviceSize align(VkDeviceSize offset, VkDeviceSize alignment);
+
+public:
+    FrameRingBuffer();
+    FrameRingBuffer(MemoryAllocator *memoryAllocator, VkDevice &device, VkDeviceSize alignment);
+
+    FrameSlice reserve(VkDeviceSize size);
+    void init(uint32_t frameCount, VkDeviceSize streamingSize);
+
+    void beginFrame(uint32_t frameIndex);
+    void *getData(const FrameSlice &slice);
+    FrameAllocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+
+    VkBuffer getBuffer();
+    VkDescriptorBufferInfo getBufferInfo(const FrameSlice &slice, uint32_t frameIndex);
+
+    void cleanup();
+};
+
+
+#endif //GAME_ENGINE_FRAMERINGBUFFER_HPP
@@ -0,0 +1,358 @@
+//
+// Created by cleme on 2020-02-28.
+//
+
+#include "Application.hpp"
+#include "HiZPass.hpp"
+#include "../include/helper/FileHelper.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+const uint32_t HIZ_GROUP_SIZE = 8;
+
+HiZPass::HiZPass(){
+
+}
+
+HiZPass::HiZPass(Application *application, VkDevice &device){
+    this->application = application;
+    this->device = device;
+}
+
+/**
+ * Create the pyramid for a depth attachment of the given size, it is cleared to the far plane
+ * so that nothing is occluded before the first build. The pipeline must be created first.
+ * @param depthImageView view of the depth aspect of the depth attachment
+ */
+void HiZPass::init(VkImageView depthImageView, VkExtent2D extent){
+    this->extent = extent;
+    this->levelCount = static_cast<uint32_t>(std::floor(std::log2(std::max(extent.width, extent.height)))) + 1;
+
+    this->createPyramid();
+    this->createDescriptorSets(depthImageView);
+}
+
+/**
+ * Create the pyramid again for a new depth attachment, the pipeline is kept
+ */
+void HiZPass::resize(VkImageView depthImageView, VkExtent2D extent){
+    this->cleanupPyramid();
+
+    this->extent = extent;
+    this->levelCount = static_cast<uint32_t>(std::floor(std::log2(std::max(extent.width, extent.height)))) + 1;
+
+    this->createPyramid();
+    this->createDescriptorSets(depthImageView);
+}
+
+void HiZPass::createDescriptorSetLayout(){
+    //Depth attachment, then the previous and the current level of the pyramid
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings = {};
+    for(uint32_t i = 0 ; i < bindings.size() ; i++){
+        bindings[i].binding = i;
+        bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if(vkCreateDescriptorSetLayout(this->device, &layoutInfo, nullptr, &this->descriptorSetLayout) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create depth pyramid descriptor set layout.");
+    }
+}
+
+/**
+ * Create the descriptor set layout and the compute pipeline for a depth attachment with the given sample count.
+ * Can run on any thread, along with the creation of the other pipelines.
+ */
+void HiZPass::createPipeline(VkSampleCountFlagBits sampleCount){
+    this->sampleCount = sampleCount;
+    this->createDescriptorSetLayout();
+
+    //A multisampled depth attachment is read with a different sampler type
+    auto computeShaderCode = readFile(this->sampleCount == VK_SAMPLE_COUNT_1_BIT ? "./shaders/build/hiz.spv" : "./shaders/build/hiz_multisampled.spv");
+    VkShaderModule computeShaderModule = createShaderModule(&this->device, computeShaderCode);
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(HiZParameters);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &this->descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if(vkCreatePipelineLayout(this->device, &pipelineLayoutInfo, nullptr, &this->pipelineLayout) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create depth pyramid pipeline layout.");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = computeShaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = this->pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    if(vkCreateComputePipelines(this->device, this->application->getPipelineCache(), 1, &pipelineInfo, nullptr, &this->pipeline) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create depth pyramid pipeline.");
+    }
+
+    vkDestroyShaderModule(this->device, computeShaderModule, nullptr);
+}
+
+void HiZPass::createPyramid(){
+    this->application->createImage(this->extent.width, this->extent.height, this->levelCount, VK_SAMPLE_COUNT_1_BIT,
+                                   VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
+                                   VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                   this->pyramidImage, this->pyramidImageMemory);
+
+    //The culling pass reads every level, the build writes them one by one
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = this->pyramidImage;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = VK_FORMAT_R32_SFLOAT;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = this->levelCount;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if(vkCreateImageView(this->device, &viewInfo, nullptr, &this->pyramidView) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create depth pyramid image view.");
+    }
+
+    this->levelViews.resize(this->levelCount);
+    for(uint32_t level = 0 ; level < this->levelCount ; level++){
+        viewInfo.subresourceRange.baseMipLevel = level;
+        viewInfo.subresourceRange.levelCount = 1;
+        if(vkCreateImageView(this->device, &viewInfo, nullptr, &this->levelViews[level]) != VK_SUCCESS){
+            throw std::runtime_error("Failed to create depth pyramid level view.");
+        }
+    }
+
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.anisotropyEnable = VK_FALSE;
+    samplerInfo.maxAnisotropy = 1;
+    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    samplerInfo.unnormalizedCoordinates = VK_FALSE;
+    samplerInfo.compareEnable = VK_FALSE;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = 0.0f;
+
+    if(vkCreateSampler(this->device, &samplerInfo, nullptr, &this->depthSampler) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create depth sampler.");
+    }
+
+    samplerInfo.maxLod = static_cast<float>(this->levelCount);
+    if(vkCreateSampler(this->device, &samplerInfo, nullptr, &this->pyramidSampler) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create depth pyramid sampler.");
+    }
+
+    this->application->createBuffer(sizeof(CameraMatrices),
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            this->cameraBuffer,
+            this->cameraBufferMemory);
+
+    //Far plane everywhere and a null camera, the instances are all visible until the first build.
+    //The clear goes with the next upload batch, which is submitted before the next frame
+    VkCommandBuffer commandBuffer = this->application->getUploadManager().getGraphicsCommandBuffer();
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = this->pyramidImage;
+    barrier.subresourceRange = viewInfo.subresourceRange;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = this->levelCount;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkClearColorValue farPlane = {};
+    farPlane.float32[0] = 1.0f;
+    vkCmdClearColorImage(commandBuffer, this->pyramidImage, VK_IMAGE_LAYOUT_GENERAL, &farPlane, 1, &barrier.subresourceRange);
+    vkCmdFillBuffer(commandBuffer, this->cameraBuffer, 0, VK_WHOLE_SIZE, 0);
+
+    VkMemoryBarrier clearBarrier = {};
+    clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         1, &clearBarrier, 0, nullptr, 0, nullptr);
+}
+
+void HiZPass::createDescriptorSets(VkImageView depthImageView){
+    std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = this->levelCount;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = this->levelCount * 2;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = this->levelCount;
+    poolInfo.flags = 0;
+
+    if(vkCreateDescriptorPool(this->device, &poolInfo, nullptr, &this->descriptorPool) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create depth pyramid descriptor pool.");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(this->levelCount, this->descriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = this->descriptorPool;
+    allocInfo.descriptorSetCount = this->levelCount;
+    allocInfo.pSetLayouts = layouts.data();
+
+    this->descriptorSets.resize(this->levelCount);
+    if(vkAllocateDescriptorSets(this->device, &allocInfo, this->descriptorSets.data()) != VK_SUCCESS){
+        throw std::runtime_error("Failed to allocate depth pyramid descriptor sets.");
+    }
+
+    for(uint32_t level = 0 ; level < this->levelCount ; level++){
+        VkDescriptorImageInfo depthInfo = {};
+        depthInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        depthInfo.imageView = depthImageView;
+        depthInfo.sampler = this->depthSampler;
+
+        //The first level is reduced from the depth attachment, its source level is not read
+        std::array<VkDescriptorImageInfo, 2> levelInfos = {};
+        levelInfos[0].imageView = this->levelViews[level == 0 ? 0 : level - 1];
+        levelInfos[1].imageView = this->levelViews[level];
+        for(VkDescriptorImageInfo &levelInfo : levelInfos){
+            levelInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            levelInfo.sampler = VK_NULL_HANDLE;
+        }
+
+        std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+        for(uint32_t i = 0 ; i < descriptorWrites.size() ; i++){
+            descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[i].dstSet = this->descriptorSets[level];
+            descriptorWrites[i].dstBinding = i;
+            descriptorWrites[i].dstArrayElement = 0;
+            descriptorWrites[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            descriptorWrites[i].descriptorCount = 1;
+            descriptorWrites[i].pImageInfo = i == 0 ? &depthInfo : &levelInfos[i - 1];
+        }
+
+        vkUpdateDescriptorSets(this->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+}
+
+/**
+ * Record the reduction of every level and the copy of the camera that rendered the depth.
+ * Must be recorded outside of a render pass, once the depth attachment is in the
+ * depth stencil read only layout.
+ */
+void HiZPass::recordBuild(VkCommandBuffer commandBuffer, const VkDescriptorBufferInfo &cameraBufferInfo){
+    //The previous culling reads the pyramid and its camera
+    VkMemoryBarrier readBarrier = {};
+    readBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    readBarrier.srcAccessMask = 0;
+    readBarrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         1, &readBarrier, 0, nullptr, 0, nullptr);
+
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = cameraBufferInfo.offset;
+    copyRegion.size = sizeof(CameraMatrices);
+    vkCmdCopyBuffer(commandBuffer, cameraBufferInfo.buffer, this->cameraBuffer, 1, &copyRegion);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
+
+    HiZParameters parameters = {};
+    parameters.sampleCount = static_cast<uint32_t>(this->sampleCount);
+    for(uint32_t level = 0 ; level < this->levelCount ; level++){
+        uint32_t width = std::max(this->extent.width >> level, 1u);
+        uint32_t height = std::max(this->extent.height >> level, 1u);
+
+        parameters.level = level;
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 0, 1, &this->descriptorSets[level], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HiZParameters), &parameters);
+        vkCmdDispatch(commandBuffer, (width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+        //The next level reads this one, the culling reads all of them
+        VkMemoryBarrier levelBarrier = {};
+        levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                             1, &levelBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    VkMemoryBarrier cameraBarrier = {};
+    cameraBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cameraBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    cameraBarrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                         1, &cameraBarrier, 0, nullptr, 0, nullptr);
+}
+
+VkImageView HiZPass::getPyramidView(){
+    return this->pyramidView;
+}
+
+VkSampler HiZPass::getPyramidSampler(){
+    return this->pyramidSampler;
+}
+
+VkBuffer HiZPass::getCameraBuffer(){
+    return this->cameraBuffer;
+}
+
+/**
+ * Destroy the resources that depend on the size of the depth attachment
+ */
+void HiZPass::cleanupPyramid(){
+    this->application->destroyBuffer(this->cameraBuffer, this->cameraBufferMemory);
+
+    vkDestroySampler(this->device, this->pyramidSampler, nullptr);
+    vkDestroySampler(this->device, this->depthSampler, nullptr);
+    for(VkImageView levelView : this->levelViews){
+        vkDestroyImageView(this->device, levelView, nullptr);
+    }
+    this->levelViews.clear();
+    vkDestroyImageView(this->device, this->pyramidView, nullptr);
+    this->application->destroyImage(this->pyramidImage, this->pyramidImageMemory);
+
+    vkDestroyDescriptorPool(this->device, this->descriptorPool, nullptr);
+    this->descriptorSets.clear();
+}
+
+void HiZPass::cleanup(){
+    this->cleanupPyramid();
+}
+
+void HiZPass::cleanupPipeline(){
+    vkDestroyPipeline(this->device, this->pipeline, nullptr);
+    vkDestroyPipelineLayout(this->device, this->pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(this->device, this->descriptorSetLayout, nullptr);
+}
@@ -0,0 +1,79 @@
+//
+// Created by cleme on 2020-02-28.
+//
+
+#ifndef GAME_ENGINE_HIZPASS_HPP
+#define GAME_ENGINE_HIZPASS_HPP
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+#include "MemoryAllocator.hpp"
+
+class Application;
+
+/**
+ * Parameters of the reduction of one level of the pyramid, sent as push constants
+ */
+struct HiZParameters {
+    uint32_t level;
+    uint32_t sampleCount;
+};
+
+/**
+ * Compute pass that builds a hierarchical depth pyramid from the depth attachment.
+ * Each texel holds the farthest depth of the pixels it covers, the first level has the
+ * size of the depth attachment. The camera used to render the depth is copied with the
+ * pyramid so that the culling pass can project the instances the same way.
+ */
+class HiZPass {
+private:
+    Application *application = nullptr;
+    VkDevice device = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    //One descriptor set per level of the pyramid
+    std::vector<VkDescriptorSet> descriptorSets;
+
+    VkImage pyramidImage = VK_NULL_HANDLE;
+    MemoryAllocation pyramidImageMemory;
+    VkImageView pyramidView = VK_NULL_HANDLE;
+    std::vector<VkImageView> levelViews;
+    VkSampler depthSampler = VK_NULL_HANDLE;
+    VkSampler pyramidSampler = VK_NULL_HANDLE;
+
+    VkBuffer cameraBuffer = VK_NULL_HANDLE;
+    MemoryAllocation cameraBufferMemory;
+
+    VkExtent2D extent = {};
+    uint32_t levelCount = 0;
+    VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT;
+
+    void createDescriptorSetLayout();
+    void createPyramid();
+    void createDescriptorSets(VkImageView depthImageView);
+    void cleanupPyramid();
+
+public:
+    HiZPass();
+    HiZPass(Application *application, VkDevice &device);
+
+    void createPipeline(VkSampleCountFlagBits sampleCount);
+    void init(VkImageView depthImageView, VkExtent2D extent);
+    void resize(VkImageView depthImageView, VkExtent2D extent);
+    void recordBuild(VkCommandBuffer commandBuffer, const VkDescriptorBufferInfo &cameraBufferInfo);
+
+    VkImageView getPyramidView();
+    VkSampler getPyramidSampler();
+    VkBuffer getCameraBuffer();
+
+    void cleanup();
+    void cleanupPipeline();
+};
+
+
+#endif //GAME_ENGINE_HIZPASS_HPP
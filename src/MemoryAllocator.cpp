@@ -0,0 +1,346 @@
+//
+// Created by cleme on 2020-02-29.
+//
+
+#include "MemoryAllocator.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+//Size of the blocks, smaller on the small heaps so that a block is at most an eighth of its heap
+const VkDeviceSize MEMORY_BLOCK_SIZE = 64 * 1024 * 1024;
+//Size of the smallest range, every range is this size times a power of two
+const VkDeviceSize MIN_ALLOCATION_SIZE = 256;
+const VkDeviceSize TRANSIENT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+static VkDeviceSize roundUpToPowerOfTwo(VkDeviceSize size){
+    VkDeviceSize power = 1;
+    while(power < size){
+        power <<= 1;
+    }
+    return power;
+}
+
+static uint32_t floorLog2(VkDeviceSize powerOfTwo){
+    uint32_t log = 0;
+    while(powerOfTwo > 1){
+        powerOfTwo >>= 1;
+        log++;
+    }
+    return log;
+}
+
+MemoryAllocator::MemoryAllocator(){
+
+}
+
+MemoryAllocator::MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device){
+    this->physicalDevice = physicalDevice;
+    this->device = device;
+    vkGetPhysicalDeviceMemoryProperties(this->physicalDevice, &this->memoryProperties);
+
+    this->pools.resize(this->memoryProperties.memoryTypeCount * 2);
+    this->poolBlockSizes.resize(this->pools.size());
+    for(uint32_t memoryType = 0 ; memoryType < this->memoryProperties.memoryTypeCount ; memoryType++){
+        VkDeviceSize heapSize = this->memoryProperties.memoryHeaps[this->memoryProperties.memoryTypes[memoryType].heapIndex].size;
+        VkDeviceSize blockSize = MEMORY_BLOCK_SIZE;
+        while(blockSize > MIN_ALLOCATION_SIZE && blockSize > heapSize / 8){
+            blockSize >>= 1;
+        }
+        this->poolBlockSizes[memoryType * 2] = blockSize;
+        this->poolBlockSizes[memoryType * 2 + 1] = blockSize;
+    }
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties){
+    for (uint32_t i = 0; i < this->memoryProperties.memoryTypeCount ; i++){
+        if(typeFilter & (1 << i) && (this->memoryProperties.memoryTypes[i].propertyFlags & properties) == properties){
+            return i;
+        }
+    }
+
+    throw std::runtime_error("Failed to find suitable memory type.");
+}
+
+/**
+ * Allocate device memory, mapped for its whole lifetime when it is host visible
+ */
+VkDeviceMemory MemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void **mappedData){
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    VkDeviceMemory memory;
+    if(vkAllocateMemory(this->device, &allocInfo, nullptr, &memory) != VK_SUCCESS){
+        throw std::runtime_error("Failed to allocate device memory.");
+    }
+
+    *mappedData = nullptr;
+    if(this->memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT){
+        if(vkMapMemory(this->device, memory, 0, VK_WHOLE_SIZE, 0, mappedData) != VK_SUCCESS){
+            throw std::runtime_error("Failed to map device memory.");
+        }
+    }
+
+    return memory;
+}
+
+/**
+ * Allocate a block with a single free range of the highest order
+ */
+void MemoryAllocator::createBlock(MemoryBlock &block, VkDeviceSize size, uint32_t memoryType){
+    block.memory = this->allocateDeviceMemory(size, memoryType, &block.mappedData);
+    block.size = size;
+    block.freeRanges.clear();
+    block.freeRanges.resize(floorLog2(size / MIN_ALLOCATION_SIZE) + 1);
+    block.freeRanges.back().insert(0);
+    block.allocationCount = 0;
+    block.usedBytes = 0;
+    block.allocatedBytes = 0;
+}
+
+void MemoryAllocator::destroyBlock(MemoryBlock &block){
+    if(block.memory != VK_NULL_HANDLE){
+        vkFreeMemory(this->device, block.memory, nullptr);
+    }
+    block = MemoryBlock();
+}
+
+/**
+ * Take the free range of the lowest offset of the smallest order that fits, and split it down to the requested order
+ * @return false if the block has no range large enough
+ */
+bool MemoryAllocator::allocateRange(MemoryBlock &block, uint32_t order, VkDeviceSize &offset){
+    uint32_t freeOrder = order;
+    while(freeOrder < block.freeRanges.size() && block.freeRanges[freeOrder].empty()){
+        freeOrder++;
+    }
+    if(freeOrder >= block.freeRanges.size()){
+        return false;
+    }
+
+    offset = *block.freeRanges[freeOrder].begin();
+    block.freeRanges[freeOrder].erase(block.freeRanges[freeOrder].begin());
+
+    //Keep the upper half of each split free
+    while(freeOrder > order){
+        freeOrder--;
+        block.freeRanges[freeOrder].insert(offset + (MIN_ALLOCATION_SIZE << freeOrder));
+    }
+    return true;
+}
+
+/**
+ * Give back a range, merged with its buddy as long as the buddy is free
+ */
+void MemoryAllocator::freeRange(MemoryBlock &block, VkDeviceSize offset, uint32_t order){
+    while(order + 1 < block.freeRanges.size()){
+        VkDeviceSize buddy = offset ^ (MIN_ALLOCATION_SIZE << order);
+        auto buddyRange = block.freeRanges[order].find(buddy);
+        if(buddyRange == block.freeRanges[order].end()){
+            break;
+        }
+        block.freeRanges[order].erase(buddyRange);
+        offset = std::min(offset, buddy);
+        order++;
+    }
+    block.freeRanges[order].insert(offset);
+}
+
+/**
+ * Allocate a range for a resource, the resources larger than a block get their own device memory
+ * @param linear true for the buffers and the linear images, false for the optimal images
+ */
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, bool linear){
+    MemoryAllocation allocation = {};
+    uint32_t memoryType = this->findMemoryType(requirements.memoryTypeBits, properties);
+    allocation.pool = memoryType * 2 + (linear ? 0 : 1);
+    allocation.size = requirements.size;
+
+    //A range is aligned on its size, which covers the alignment of the resource
+    VkDeviceSize rangeSize = roundUpToPowerOfTwo(std::max({requirements.size, requirements.alignment, MIN_ALLOCATION_SIZE}));
+    if(rangeSize > this->poolBlockSizes[allocation.pool]){
+        allocation.kind = AllocationKind::Dedicated;
+        allocation.memory = this->allocateDeviceMemory(requirements.size, memoryType, &allocation.mappedData);
+        this->dedicatedCount++;
+        this->dedicatedBytes += requirements.size;
+        return allocation;
+    }
+
+    allocation.kind = AllocationKind::Block;
+    allocation.order = floorLog2(rangeSize / MIN_ALLOCATION_SIZE);
+
+    std::vector<MemoryBlock> &pool = this->pools[allocation.pool];
+    bool allocated = false;
+    for(uint32_t blockIndex = 0 ; blockIndex < pool.size() && !allocated ; blockIndex++){
+        if(pool[blockIndex].memory != VK_NULL_HANDLE && this->allocateRange(pool[blockIndex], allocation.order, allocation.offset)){
+            allocation.block = blockIndex;
+            allocated = true;
+        }
+    }
+
+    if(!allocated){
+        //Reuse the slot of a destroyed block so that the indices of the allocations stay valid
+        uint32_t blockIndex = 0;
+        while(blockIndex < pool.size() && pool[blockIndex].memory != VK_NULL_HANDLE){
+            blockIndex++;
+        }
+        if(blockIndex == pool.size()){
+            pool.emplace_back();
+        }
+        this->createBlock(pool[blockIndex], this->poolBlockSizes[allocation.pool], memoryType);
+        this->allocateRange(pool[blockIndex], allocation.order, allocation.offset);
+        allocation.block = blockIndex;
+    }
+
+    MemoryBlock &block = pool[allocation.block];
+    block.allocationCount++;
+    block.usedBytes += requirements.size;
+    block.allocatedBytes += rangeSize;
+    allocation.memory = block.memory;
+    if(block.mappedData != nullptr){
+        allocation.mappedData = static_cast<char*>(block.mappedData) + allocation.offset;
+    }
+    return allocation;
+}
+
+/**
+ * Allocate host visible memory for a staging buffer, freed before the next frame.
+ * The staging ranges are packed one after the other, the block is rewound once they are all freed.
+ */
+MemoryAllocation MemoryAllocator::allocateTransient(const VkMemoryRequirements &requirements){
+    const VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if(this->transientBlock.memory == VK_NULL_HANDLE){
+        this->transientMemoryType = this->findMemoryType(requirements.memoryTypeBits, properties);
+        this->transientBlock.memory = this->allocateDeviceMemory(TRANSIENT_BLOCK_SIZE, this->transientMemoryType, &this->transientBlock.mappedData);
+        this->transientBlock.size = TRANSIENT_BLOCK_SIZE;
+    }
+
+    VkDeviceSize offset = (this->transientHead + requirements.alignment - 1) / requirements.alignment * requirements.alignment;
+    if(!(requirements.memoryTypeBits & (1 << this->transientMemoryType)) || offset + requirements.size > this->transientBlock.size){
+        return this->allocate(requirements, properties, true);
+    }
+
+    this->transientHead = offset + requirements.size;
+    this->transientBlock.allocationCount++;
+    this->transientBlock.usedBytes += requirements.size;
+
+    MemoryAllocation allocation = {};
+    allocation.kind = AllocationKind::Transient;
+    allocation.memory = this->transientBlock.memory;
+    allocation.offset = offset;
+    allocation.size = requirements.size;
+    allocation.mappedData = static_cast<char*>(this->transientBlock.mappedData) + offset;
+    return allocation;
+}
+
+/**
+ * Give back the range of a resource, the resource must be destroyed first.
+ * An empty block is destroyed unless it is the last one of its pool.
+ */
+void MemoryAllocator::free(MemoryAllocation &allocation){
+    if(allocation.memory == VK_NULL_HANDLE){
+        return;
+    }
+
+    if(allocation.kind == AllocationKind::Dedicated){
+        vkFreeMemory(this->device, allocation.memory, nullptr);
+        this->dedicatedCount--;
+        this->dedicatedBytes -= allocation.size;
+    }else if(allocation.kind == AllocationKind::Transient){
+        this->transientBlock.allocationCount--;
+        this->transientBlock.usedBytes -= allocation.size;
+        if(this->transientBlock.allocationCount == 0){
+            this->transientHead = 0;
+        }
+    }else{
+        std::vector<MemoryBlock> &pool = this->pools[allocation.pool];
+        MemoryBlock &block = pool[allocation.block];
+        this->freeRange(block, allocation.offset, allocation.order);
+        block.allocationCount--;
+        block.usedBytes -= allocation.size;
+        block.allocatedBytes -= MIN_ALLOCATION_SIZE << allocation.order;
+
+        if(block.allocationCount == 0){
+            uint32_t liveBlocks = 0;
+            for(const MemoryBlock &poolBlock : pool){
+                if(poolBlock.memory != VK_NULL_HANDLE){
+                    liveBlocks++;
+                }
+            }
+            if(liveBlocks > 1){
+                this->destroyBlock(block);
+            }
+        }
+    }
+
+    allocation = MemoryAllocation();
+}
+
+MemoryStats MemoryAllocator::getStats(){
+    MemoryStats stats = {};
+    VkDeviceSize largestFreeRanges = 0;
+    for(const std::vector<MemoryBlock> &pool : this->pools){
+        for(const MemoryBlock &block : pool){
+            if(block.memory == VK_NULL_HANDLE){
+                continue;
+            }
+            stats.blockCount++;
+            stats.blockBytes += block.size;
+            stats.allocationCount += block.allocationCount;
+            stats.usedBytes += block.usedBytes;
+            stats.allocatedBytes += block.allocatedBytes;
+            for(const std::set<VkDeviceSize> &ranges : block.freeRanges){
+                stats.freeRangeCount += static_cast<uint32_t>(ranges.size());
+            }
+            for(uint32_t order = static_cast<uint32_t>(block.freeRanges.size()) ; order > 0 ; order--){
+                if(!block.freeRanges[order - 1].empty()){
+                    stats.largestFreeRange = std::max(stats.largestFreeRange, MIN_ALLOCATION_SIZE << (order - 1));
+                    largestFreeRanges += MIN_ALLOCATION_SIZE << (order - 1);
+                    break;
+                }
+            }
+        }
+    }
+    stats.dedicatedCount = this->dedicatedCount;
+    stats.dedicatedBytes = this->dedicatedBytes;
+
+    VkDeviceSize freeBytes = stats.blockBytes - stats.allocatedBytes;
+    if(freeBytes > 0){
+        stats.fragmentation = 1.0f - static_cast<float>(largestFreeRanges) / static_cast<float>(freeBytes);
+    }
+    return stats;
+}
+
+void MemoryAllocator::printStats(){
+    const double mebibyte = 1024.0 * 1024.0;
+    MemoryStats stats = this->getStats();
+    printf("Device memory: %u blocks of %.1f MiB, %u allocations using %.1f MiB (%.1f MiB once rounded), "
+           "%u free ranges, largest %.1f MiB, %.1f%% fragmentation, %u dedicated allocations of %.1f MiB\n",
+           stats.blockCount,
+           stats.blockBytes / mebibyte,
+           stats.allocationCount,
+           stats.usedBytes / mebibyte,
+           stats.allocatedBytes / mebibyte,
+           stats.freeRangeCount,
+           stats.largestFreeRange / mebibyte,
+           stats.fragmentation * 100.0f,
+           stats.dedicatedCount,
+           stats.dedicatedBytes / mebibyte);
+}
+
+/**
+ * Free every block, the resources and their dedicated allocations must be freed first
+ */
+void MemoryAllocator::cleanup(){
+    for(std::vector<MemoryBlock> &pool : this->pools){
+        for(MemoryBlock &block : pool){
+            this->destroyBlock(block);
+        }
+        pool.clear();
+    }
+    this->destroyBlock(this->transientBlock);
+    this->transientHead = 0;
+}
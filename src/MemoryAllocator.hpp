@@ -0,0 +1,120 @@
+//
+// Created by cleme on 2020-02-29.
+//
+
+#ifndef GAME_ENGINE_MEMORYALLOCATOR_HPP
+#define GAME_ENGINE_MEMORYALLOCATOR_HPP
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <set>
+#include <vector>
+
+enum class AllocationKind : uint32_t {
+    //Range of a block of the buddy allocator
+    Block,
+    //Own device memory, for the resources larger than a block
+    Dedicated,
+    //Range of the linear staging block
+    Transient
+};
+
+/**
+ * Range of device memory bound to a buffer or an image
+ */
+struct MemoryAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    //Persistently mapped pointer to the start of the range, null when the memory is not host visible
+    void *mappedData = nullptr;
+
+    AllocationKind kind = AllocationKind::Block;
+    uint32_t pool = 0;
+    uint32_t block = 0;
+    uint32_t order = 0;
+};
+
+/**
+ * Usage of the device memory, the fragmentation is the part of the free memory of the blocks
+ * that is not in the largest free range of its block
+ */
+struct MemoryStats {
+    uint32_t blockCount = 0;
+    VkDeviceSize blockBytes = 0;
+    uint32_t allocationCount = 0;
+    //Requested bytes, and bytes taken in the blocks once rounded to a power of two
+    VkDeviceSize usedBytes = 0;
+    VkDeviceSize allocatedBytes = 0;
+    VkDeviceSize largestFreeRange = 0;
+    //Free ranges of every order, one per block once the buddies of an empty block are merged
+    uint32_t freeRangeCount = 0;
+    uint32_t dedicatedCount = 0;
+    VkDeviceSize dedicatedBytes = 0;
+    float fragmentation = 0.0f;
+};
+
+/**
+ * Block of device memory split between the resources with a buddy allocator.
+ * The free ranges of each order are sorted by offset, a range of order n has
+ * the minimum allocation size times 2^n bytes and is aligned on its size.
+ */
+struct MemoryBlock {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    void *mappedData = nullptr;
+    std::vector<std::set<VkDeviceSize>> freeRanges;
+    uint32_t allocationCount = 0;
+    VkDeviceSize usedBytes = 0;
+    VkDeviceSize allocatedBytes = 0;
+};
+
+/**
+ * Sub-allocates the buffers and images from large blocks of device memory instead
+ * of calling vkAllocateMemory for each of them.
+ *
+ * There is one pool of blocks per memory type and per resource tiling: the linear resources
+ * (buffers) and the optimal ones (images) never share a block, so that they never share a
+ * bufferImageGranularity page. The host visible blocks stay mapped. The staging buffers are
+ * taken from a linear block that is rewound once all of them are freed.
+ */
+class MemoryAllocator {
+private:
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+
+    //Two pools per memory type, the linear resources first
+    std::vector<std::vector<MemoryBlock>> pools;
+    std::vector<VkDeviceSize> poolBlockSizes;
+    uint32_t dedicatedCount = 0;
+    VkDeviceSize dedicatedBytes = 0;
+
+    //Staging memory, allocated linearly
+    MemoryBlock transientBlock;
+    uint32_t transientMemoryType = 0;
+    VkDeviceSize transientHead = 0;
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, void **mappedData);
+    void createBlock(MemoryBlock &block, VkDeviceSize size, uint32_t memoryType);
+    void destroyBlock(MemoryBlock &block);
+    bool allocateRange(MemoryBlock &block, uint32_t order, VkDeviceSize &offset);
+    void freeRange(MemoryBlock &block, VkDeviceSize offset, uint32_t order);
+
+public:
+    MemoryAllocator();
+    MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device);
+
+    MemoryAllocation allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, bool linear);
+    MemoryAllocation allocateTransient(const VkMemoryRequirements &requirements);
+    void free(MemoryAllocation &allocation);
+
+    MemoryStats getStats();
+    void printStats();
+
+    void cleanup();
+};
+
+
+#endif //GAME_ENGINE_MEMORYALLOCATOR_HPP
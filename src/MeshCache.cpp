@@ -0,0 +1,205 @@
+//
+// Created by cleme on 2020-02-23.
+//
+
+#include "MeshCache.hpp"
+
+#include <cstdio>
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(){
+
+}
+
+MappedFile::~MappedFile(){
+    this->close();
+}
+
+/**
+ * Map the whole file in memory
+ * @return false if the file does not exist or cannot be mapped
+ */
+bool MappedFile::open(const std::string &path){
+    this->close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE){
+        return false;
+    }
+    this->fileHandle = file;
+
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0){
+        this->close();
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping == nullptr){
+        this->close();
+        return false;
+    }
+    this->mappingHandle = mapping;
+
+    this->data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if(this->data == nullptr){
+        this->close();
+        return false;
+    }
+    this->size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    this->fileDescriptor = ::open(path.c_str(), O_RDONLY);
+    if(this->fileDescriptor < 0){
+        return false;
+    }
+
+    struct stat fileStat;
+    if(fstat(this->fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0){
+        this->close();
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, this->fileDescriptor, 0);
+    if(mapping == MAP_FAILED){
+        this->close();
+        return false;
+    }
+    this->data = static_cast<const char*>(mapping);
+    this->size = static_cast<size_t>(fileStat.st_size);
+#endif
+
+    return true;
+}
+
+void MappedFile::close(){
+#ifdef _WIN32
+    if(this->data){
+        UnmapViewOfFile(this->data);
+    }
+    if(this->mappingHandle){
+        CloseHandle(this->mappingHandle);
+    }
+    if(this->fileHandle){
+        CloseHandle(this->fileHandle);
+    }
+    this->mappingHandle = nullptr;
+    this->fileHandle = nullptr;
+#else
+    if(this->data){
+        munmap(const_cast<char*>(this->data), this->size);
+    }
+    if(this->fileDescriptor >= 0){
+        ::close(this->fileDescriptor);
+    }
+    this->fileDescriptor = -1;
+#endif
+
+    this->data = nullptr;
+    this->size = 0;
+}
+
+const char* MappedFile::getData() const {
+    return this->data;
+}
+
+size_t MappedFile::getSize() const {
+    return this->size;
+}
+
+void CacheWriter::align(size_t alignment){
+    size_t alignedSize = (this->data.size() + alignment - 1) / alignment * alignment;
+    this->data.resize(alignedSize, 0);
+}
+
+void CacheWriter::writeBytes(const void *bytes, size_t size){
+    const char *begin = static_cast<const char*>(bytes);
+    this->data.insert(this->data.end(), begin, begin + size);
+}
+
+void CacheWriter::writeString(const std::string &value){
+    this->write(static_cast<uint32_t>(value.size()));
+    this->writeBytes(value.data(), value.size());
+}
+
+/**
+ * Write the cache to a temporary file first, a crash while saving never leaves a truncated cache behind
+ */
+void CacheWriter::save(const std::string &path) const {
+    std::string temporaryPath = path + ".tmp";
+
+    FILE *file = fopen(temporaryPath.c_str(), "wb");
+    if(!file){
+        throw std::runtime_error("Failed to open " + temporaryPath);
+    }
+
+    size_t written = fwrite(this->data.data(), 1, this->data.size(), file);
+    fclose(file);
+    if(written != this->data.size()){
+        std::remove(temporaryPath.c_str());
+        throw std::runtime_error("Failed to write " + temporaryPath);
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if(error){
+        std::remove(temporaryPath.c_str());
+        throw std::runtime_error("Failed to write " + path + ": " + error.message());
+    }
+}
+
+CacheReader::CacheReader(const char *data, size_t size){
+    this->data = data;
+    this->size = size;
+}
+
+void CacheReader::align(size_t alignment){
+    this->position = (this->position + alignment - 1) / alignment * alignment;
+}
+
+const char* CacheReader::readBytes(size_t size){
+    if(this->position > this->size || size > this->size - this->position){
+        throw std::runtime_error("Truncated mesh cache.");
+    }
+
+    const char *bytes = this->data + this->position;
+    this->position += size;
+    return bytes;
+}
+
+std::string CacheReader::readString(){
+    uint32_t length = this->read<uint32_t>();
+    const char *bytes = this->readBytes(length);
+    return std::string(bytes, length);
+}
+
+/**
+ * Size and modification time of a source file, a cache built from another version of the file is not used
+ * @return false if the file does not exist
+ */
+bool getSourceStamp(const std::string &path, uint64_t &size, int64_t &time){
+    std::error_code error;
+    size = std::filesystem::file_size(path, error);
+    if(error){
+        return false;
+    }
+
+    auto writeTime = std::filesystem::last_write_time(path, error);
+    if(error){
+        return false;
+    }
+    time = static_cast<int64_t>(writeTime.time_since_epoch().count());
+
+    return true;
+}
@@ -0,0 +1,142 @@
+//
+// Created by cleme on 2020-02-23.
+//
+
+#ifndef GAME_ENGINE_MESHCACHE_HPP
+#define GAME_ENGINE_MESHCACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+const char MESH_CACHE_MAGIC[4] = {'G', 'E', 'M', 'C'};
+//Increase when the layout of the cache or of the serialized types changes
+const uint32_t MESH_CACHE_VERSION = 5;
+//Arrays start on this alignment so that they can be read in place from the mapped file
+const size_t MESH_CACHE_ARRAY_ALIGNMENT = 16;
+
+/**
+ * First bytes of a cache file. The cache is rebuilt when the source file,
+ * the version, the requested vertex format or the vertex layout do not match.
+ */
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t vertexFormat;
+    //Format asked by the application, the vertices are full when packing them was not precise enough
+    uint32_t requestedVertexFormat;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+};
+
+/**
+ * Read only view of a whole file mapped in memory
+ */
+class MappedFile {
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#else
+    int fileDescriptor = -1;
+#endif
+
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string &path);
+    void close();
+
+    const char* getData() const;
+    size_t getSize() const;
+};
+
+/**
+ * Build a cache file in memory, values are written with the layout of the running build
+ */
+class CacheWriter {
+private:
+    std::vector<char> data;
+
+public:
+    void align(size_t alignment);
+    void writeBytes(const void *bytes, size_t size);
+    void writeString(const std::string &value);
+    void save(const std::string &path) const;
+
+    template<typename T>
+    void write(const T &value){
+        static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be cached");
+        this->writeBytes(&value, sizeof(T));
+    }
+
+    template<typename T>
+    void writeArray(const T *values, uint32_t count){
+        static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be cached");
+        this->write(count);
+        this->align(MESH_CACHE_ARRAY_ALIGNMENT);
+        this->writeBytes(values, sizeof(T) * count);
+    }
+
+    template<typename T>
+    void writeArray(const std::vector<T> &values){
+        this->writeArray(values.data(), static_cast<uint32_t>(values.size()));
+    }
+};
+
+/**
+ * Read the values of a cache file, throws when the file is truncated
+ */
+class CacheReader {
+private:
+    const char *data;
+    size_t size;
+    size_t position = 0;
+
+public:
+    CacheReader(const char *data, size_t size);
+
+    void align(size_t alignment);
+    const char* readBytes(size_t size);
+    std::string readString();
+
+    template<typename T>
+    T read(){
+        static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be cached");
+        T value;
+        std::memcpy(&value, this->readBytes(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    /**
+     * @return the array in place in the file, valid as long as the file is mapped
+     */
+    template<typename T>
+    const T* readArrayView(uint32_t &count){
+        count = this->read<uint32_t>();
+        this->align(MESH_CACHE_ARRAY_ALIGNMENT);
+        return reinterpret_cast<const T*>(this->readBytes(sizeof(T) * count));
+    }
+
+    template<typename T>
+    void readArray(std::vector<T> &values){
+        uint32_t count;
+        const T *view = this->readArrayView<T>(count);
+        values.assign(view, view + count);
+    }
+};
+
+bool getSourceStamp(const std::string &path, uint64_t &size, int64_t &time);
+
+
+#endif //GAME_ENGINE_MESHCACHE_HPP
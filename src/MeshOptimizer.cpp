@@ -0,0 +1,250 @@
+//
+// Created by cleme on 2020-02-24.
+//
+
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+//Weights of the vertex score of Forsyth's "Linear-Speed Vertex Cache Optimisation"
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+/**
+ * Merge the vertices that are equal, the index buffer is rewritten to use the remaining vertices
+ */
+void weldVertices(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices){
+    std::unordered_map<Vertex, uint32_t> uniqueVertices;
+    uniqueVertices.reserve(vertices.size());
+
+    std::vector<Vertex> weldedVertices;
+    std::vector<uint32_t> remap(vertices.size());
+    for(size_t i = 0 ; i < vertices.size() ; i++){
+        auto vertex = uniqueVertices.find(vertices[i]);
+        if(vertex == uniqueVertices.end()){
+            remap[i] = static_cast<uint32_t>(weldedVertices.size());
+            uniqueVertices[vertices[i]] = remap[i];
+            weldedVertices.push_back(vertices[i]);
+        }else{
+            remap[i] = vertex->second;
+        }
+    }
+
+    for(uint32_t &index : indices){
+        index = remap[index];
+    }
+    vertices.swap(weldedVertices);
+}
+
+/**
+ * Score of a vertex, higher when it is in the cache and when few triangles still use it
+ * @param cachePosition position in the LRU cache, -1 if the vertex is not in the cache
+ * @param remainingTriangles triangles using the vertex that are not emitted yet
+ */
+static float computeVertexScore(int32_t cachePosition, uint32_t remainingTriangles){
+    if(remainingTriangles == 0){
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if(cachePosition >= 0){
+        if(cachePosition < 3){
+            //The vertices of the last triangle get a fixed score so that strips are not favoured over fans
+            score = LAST_TRIANGLE_SCORE;
+        }else{
+            float scale = 1.0f / static_cast<float>(VERTEX_CACHE_OPTIMIZATION_SIZE - 3);
+            score = std::pow(1.0f - static_cast<float>(cachePosition - 3) * scale, CACHE_DECAY_POWER);
+        }
+    }
+
+    //Finish the vertices with few triangles left first, they would need to be transformed again later
+    score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+    return score;
+}
+
+/**
+ * Reorder the triangles so that consecutive triangles share their vertices and the
+ * transformed vertices are reused from the post-transform cache (Forsyth's algorithm)
+ * @param indices triangle list, reordered in place
+ * @param vertexCount number of vertices referenced by the indices
+ */
+void optimizeVertexCache(uint32_t *indices, size_t indexCount, uint32_t vertexCount){
+    size_t triangleCount = indexCount / 3;
+    if(triangleCount == 0){
+        return;
+    }
+
+    //Triangles using each vertex, the triangles that are not emitted yet are kept first
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+    for(size_t i = 0 ; i < triangleCount * 3 ; i++){
+        triangleOffsets[indices[i] + 1]++;
+    }
+    for(uint32_t vertex = 0 ; vertex < vertexCount ; vertex++){
+        triangleOffsets[vertex + 1] += triangleOffsets[vertex];
+    }
+
+    std::vector<uint32_t> remainingTriangles(vertexCount);
+    std::vector<uint32_t> vertexTriangles(triangleCount * 3);
+    for(size_t triangle = 0 ; triangle < triangleCount ; triangle++){
+        for(size_t corner = 0 ; corner < 3 ; corner++){
+            uint32_t vertex = indices[triangle * 3 + corner];
+            vertexTriangles[triangleOffsets[vertex] + remainingTriangles[vertex]] = static_cast<uint32_t>(triangle);
+            remainingTriangles[vertex]++;
+        }
+    }
+
+    std::vector<int32_t> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for(uint32_t vertex = 0 ; vertex < vertexCount ; vertex++){
+        vertexScores[vertex] = computeVertexScore(-1, remainingTriangles[vertex]);
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    int64_t bestTriangle = 0;
+    for(size_t triangle = 0 ; triangle < triangleCount ; triangle++){
+        const uint32_t *corners = &indices[triangle * 3];
+        triangleScores[triangle] = vertexScores[corners[0]] + vertexScores[corners[1]] + vertexScores[corners[2]];
+        if(triangleScores[triangle] > triangleScores[bestTriangle]){
+            bestTriangle = static_cast<int64_t>(triangle);
+        }
+    }
+
+    std::vector<uint32_t> orderedIndices;
+    orderedIndices.reserve(triangleCount * 3);
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> nextCache;
+    size_t firstRemainingTriangle = 0;
+
+    while(orderedIndices.size() < triangleCount * 3){
+        if(bestTriangle < 0){
+            //No triangle uses a vertex of the cache, start again from the first remaining triangle
+            while(emitted[firstRemainingTriangle]){
+                firstRemainingTriangle++;
+            }
+            bestTriangle = static_cast<int64_t>(firstRemainingTriangle);
+        }
+
+        const uint32_t *corners = &indices[bestTriangle * 3];
+        emitted[bestTriangle] = true;
+
+        //Emit the triangle, its vertices move to the front of the cache
+        nextCache.clear();
+        for(size_t corner = 0 ; corner < 3 ; corner++){
+            uint32_t vertex = corners[corner];
+            orderedIndices.push_back(vertex);
+            if(std::find(nextCache.begin(), nextCache.end(), vertex) == nextCache.end()){
+                nextCache.push_back(vertex);
+            }
+
+            uint32_t *triangles = &vertexTriangles[triangleOffsets[vertex]];
+            uint32_t *last = triangles + remainingTriangles[vertex] - 1;
+            std::swap(*std::find(triangles, last + 1, static_cast<uint32_t>(bestTriangle)), *last);
+            remainingTriangles[vertex]--;
+        }
+        for(uint32_t vertex : cache){
+            if(vertex != corners[0] && vertex != corners[1] && vertex != corners[2]){
+                nextCache.push_back(vertex);
+            }
+        }
+
+        //Update the vertices of the cache and the ones pushed out of it
+        for(size_t i = 0 ; i < nextCache.size() ; i++){
+            uint32_t vertex = nextCache[i];
+            cachePositions[vertex] = i < VERTEX_CACHE_OPTIMIZATION_SIZE ? static_cast<int32_t>(i) : -1;
+            vertexScores[vertex] = computeVertexScore(cachePositions[vertex], remainingTriangles[vertex]);
+        }
+
+        //The next triangle is the best one using a vertex that was updated
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for(uint32_t vertex : nextCache){
+            const uint32_t *triangles = &vertexTriangles[triangleOffsets[vertex]];
+            for(uint32_t i = 0 ; i < remainingTriangles[vertex] ; i++){
+                uint32_t triangle = triangles[i];
+                const uint32_t *triangleCorners = &indices[triangle * 3];
+                triangleScores[triangle] = vertexScores[triangleCorners[0]] + vertexScores[triangleCorners[1]] + vertexScores[triangleCorners[2]];
+                if(triangleScores[triangle] > bestScore){
+                    bestScore = triangleScores[triangle];
+                    bestTriangle = triangle;
+                }
+            }
+        }
+
+        if(nextCache.size() > VERTEX_CACHE_OPTIMIZATION_SIZE){
+            nextCache.resize(VERTEX_CACHE_OPTIMIZATION_SIZE);
+        }
+        cache.swap(nextCache);
+    }
+
+    std::copy(orderedIndices.begin(), orderedIndices.end(), indices);
+}
+
+/**
+ * Reorder the vertices in the order of their first use by the indices, so that the vertex
+ * fetches of consecutive triangles read neighbouring memory. Unused vertices are removed.
+ */
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices){
+    const uint32_t unassigned = UINT32_MAX;
+    std::vector<uint32_t> remap(vertices.size(), unassigned);
+    std::vector<Vertex> orderedVertices;
+    orderedVertices.reserve(vertices.size());
+
+    for(uint32_t &index : indices){
+        if(remap[index] == unassigned){
+            remap[index] = static_cast<uint32_t>(orderedVertices.size());
+            orderedVertices.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices.swap(orderedVertices);
+}
+
+/**
+ * Average cache miss ratio: vertices transformed per triangle with a FIFO post-transform cache.
+ * 0.5 is the best possible value for a regular grid, 3 means that no vertex is ever reused.
+ */
+float computeACMR(const uint32_t *indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize){
+    size_t triangleCount = indexCount / 3;
+    if(triangleCount == 0){
+        return 0.0f;
+    }
+
+    //A vertex is in the cache when it was inserted less than cacheSize misses ago
+    std::vector<uint32_t> insertionTimes(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    uint32_t misses = 0;
+    for(size_t i = 0 ; i < triangleCount * 3 ; i++){
+        uint32_t vertex = indices[i];
+        if(time - insertionTimes[vertex] > cacheSize){
+            insertionTimes[vertex] = time;
+            time++;
+            misses++;
+        }
+    }
+
+    return static_cast<float>(misses) / static_cast<float>(triangleCount);
+}
+
+/**
+ * Weld the duplicated vertices, then order the triangles for the post-transform cache
+ * and the vertices for the fetches
+ */
+MeshOptimizationStats optimizeMesh(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices){
+    MeshOptimizationStats stats;
+    stats.verticesBefore = static_cast<uint32_t>(vertices.size());
+    stats.acmrBefore = computeACMR(indices.data(), indices.size(), static_cast<uint32_t>(vertices.size()));
+
+    weldVertices(vertices, indices);
+    optimizeVertexCache(indices.data(), indices.size(), static_cast<uint32_t>(vertices.size()));
+    optimizeVertexFetch(vertices, indices);
+
+    stats.verticesAfter = static_cast<uint32_t>(vertices.size());
+    stats.acmrAfter = computeACMR(indices.data(), indices.size(), static_cast<uint32_t>(vertices.size()));
+    return stats;
+}
@@ -0,0 +1,36 @@
+//
+// Created by cleme on 2020-02-24.
+//
+
+#ifndef GAME_ENGINE_MESHOPTIMIZER_HPP
+#define GAME_ENGINE_MESHOPTIMIZER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Vertex.hpp"
+
+//Size of the LRU cache modelled when ordering the triangles
+const uint32_t VERTEX_CACHE_OPTIMIZATION_SIZE = 32;
+//Size of the FIFO cache used to measure the ACMR, close to the post-transform cache of current GPUs
+const uint32_t VERTEX_CACHE_MEASURE_SIZE = 16;
+
+/**
+ * Geometry of a mesh before and after the import optimizations
+ */
+struct MeshOptimizationStats {
+    uint32_t verticesBefore = 0;
+    uint32_t verticesAfter = 0;
+    float acmrBefore = 0.0f;
+    float acmrAfter = 0.0f;
+};
+
+void weldVertices(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices);
+void optimizeVertexCache(uint32_t *indices, size_t indexCount, uint32_t vertexCount);
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices);
+float computeACMR(const uint32_t *indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_MEASURE_SIZE);
+
+MeshOptimizationStats optimizeMesh(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices);
+
+
+#endif //GAME_ENGINE_MESHOPTIMIZER_HPP
@@ -5,65 +5,79 @@
 #ifndef GAME_ENGINE_MODEL_HPP
 #define GAME_ENGINE_MODEL_HPP
 
-#include <vulkan/vulkan.h>
-#include <string>
-#include <unordered_map>
+#include <array>
+#include <cfloat>
+#include <memory>
 #include <vector>
-#include "Vertex.hpp"
-#include "Application.hpp"
-#include "Texture.hpp"
-#include <assimp/scene.h>
-#include <assimp/matrix4x4.h>
-#include <map>
-#include <assimp/Importer.hpp>
-
-class Application;
-class Texture;
+#include <glm/glm.hpp>
+#include "Skeleton.hpp"
+#include "CompressedAnimation.hpp"
+
+class ModelAsset;
+
+/**
+ * Animation level of detail, selected from the distance between a model and the camera
+ */
+struct AnimationLod {
+    //Models closer than this distance use this level
+    float distance;
+    //Frames between two evaluations of the skeleton, the palette is held in between
+    uint32_t updateInterval;
+    //Nodes closer than this to a leaf of the skeleton (fingers, face...) keep their bind pose
+    uint32_t minimumHeight;
+};
 
-struct BoneInfo{
-    aiMatrix4x4 finalTransformation = aiMatrix4x4();
-    aiMatrix4x4 boneOffset = aiMatrix4x4();
+const uint32_t ANIMATION_LOD_COUNT = 4;
+const std::array<AnimationLod, ANIMATION_LOD_COUNT> ANIMATION_LODS = {{
+    {10.0f, 1, 0},
+    {25.0f, 2, 0},
+    {50.0f, 4, 2},
+    {FLT_MAX, 8, 3}
+}};
+
+/**
+ * Work done for one animation LOD level
+ */
+struct AnimationLodStats {
+    uint32_t models = 0;
+    uint32_t evaluations = 0;
+    double evaluationTime = 0.0;
 };
 
+/**
+ * An instance of a model asset in the scene.
+ * The geometry, skeleton, animations and GPU resources are shared with every
+ * other instance of the same asset, an instance only owns its transform and
+ * its animation state.
+ */
 class Model {
 private:
-    Application *application;
-    Assimp::Importer importer;
-    VkDevice device;
-    const aiScene *scene;
-
-    aiMatrix4x4 globalInverseTransform;
-
-    std::vector<Texture> textures;
+    std::shared_ptr<ModelAsset> asset;
 
     glm::mat4 modelMatrix;
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
 
-    //Bones
-    std::map<std::string, uint32_t> boneMapping;
-    std::vector<BoneInfo> boneInfos;
-    std::vector<VertexBoneData> bones;
-    uint32_t numberOfBones = 0;
+    //Animation
+    uint32_t animationIndex = 1;
+    AnimationCursor animationCursor;
+    Pose pose;
 
-    VkDescriptorPool descriptorPool;
-    std::vector<VkDescriptorSet> descriptorSets;
-
-    void loadModel(std::string path);
-    void createDescriptorSets();
-    void readNodeHierarchy(float animationTime, const aiNode* pNode, const aiMatrix4x4& parentTransform);
+    //Animation LOD, the last evaluated palette is kept for the frames that are not evaluated
+    std::vector<AffineTransform> palette;
+    uint32_t lodLevel = 0;
+    bool evaluated = false;
+    double evaluationTime = 0.0;
 
 public:
-    Model(Application *application, VkDevice &device, glm::vec3 position = glm::vec3(0.0f));
-    void cleanup();
-    void init();
-
-    VkDescriptorSet* getDescriptorSet(uint32_t i);
-    std::vector<Vertex> getVertices();
-    std::vector<uint32_t> getIndices();
+    Model(std::shared_ptr<ModelAsset> asset, glm::vec3 position = glm::vec3(0.0f));
 
+    ModelAsset* getAsset();
     glm::mat4 getModelMatrix();
-    void getBoneTransforms(float timeInSeconds, std::vector<glm::mat4> &transforms);
+    uint32_t getBoneCount();
+    void getBoneTransforms(float timeInSeconds, const glm::vec3 &cameraPosition, uint64_t frame, AffineTransform *transforms);
+
+    uint32_t getLodLevel() const;
+    bool wasEvaluated() const;
+    double getEvaluationTime() const;
 };
 
 
@@ -0,0 +1,658 @@
+//
+// Created by cleme on 2020-02-14.
+//
+
+#include "ModelAsset.hpp"
+#include "MeshOptimizer.hpp"
+#include "VertexPacking.hpp"
+
+#include <assimp/mesh.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <assimp/Importer.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+//The bounding sphere encloses the bind pose, it is enlarged so that the animated poses stay inside
+const float BOUNDING_SPHERE_POSE_MARGIN = 1.25f;
+
+ModelAsset::ModelAsset(Application *application, VkDevice &device, const std::string &path, VertexFormat vertexFormat, bool meshOptimization){
+    this->application = application;
+    this->device = device;
+    this->path = path;
+    this->requestedVertexFormat = vertexFormat;
+    this->meshOptimization = meshOptimization;
+}
+
+/**
+ * Import the geometry, skeleton and animations and find the textures of the materials.
+ * Only uses the CPU, several assets can be loaded at the same time on different threads.
+ */
+void ModelAsset::load(){
+    this->loadModel(this->path);
+}
+
+/**
+ * Load the model from its cache file next to the source file, the source file is
+ * only imported when there is no valid cache. The cache is written after an import.
+ */
+void ModelAsset::loadModel(std::string path) {
+    std::string cachePath = path + ".meshcache";
+
+    //The cache only holds optimized geometry
+    bool cached = this->meshOptimization && this->loadCache(cachePath);
+    if(!cached){
+        this->importModel(path);
+
+        try{
+            if(this->meshOptimization){
+                this->writeCache(cachePath);
+            }
+        }catch(const std::exception &e){
+            printf("Failed to write the mesh cache of %s: %s\n", path.c_str(), e.what());
+        }
+    }
+    this->computeBoundingSphere();
+}
+
+void ModelAsset::importModel(const std::string &path) {
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(path,
+            aiProcess_Triangulate|
+                    aiProcess_FlipUVs);
+
+    if(!scene || !scene->mRootNode){
+        throw std::runtime_error("Failed to load model " + path);
+    }
+
+    std::vector<glm::mat4> boneOffsets;
+
+    uint32_t numVertices = 0;
+    for(size_t meshIndex = 0 ; meshIndex < scene->mNumMeshes ; meshIndex++){
+        numVertices += scene->mMeshes[meshIndex]->mNumVertices;
+    }
+
+    this->vertices.resize(numVertices);
+    this->bones.resize(numVertices);
+
+    //Range of every mesh, its indices are relative to its first vertex
+    std::vector<Submesh> meshes;
+    uint32_t vertexOffset = 0;
+    for(size_t meshIndex = 0 ; meshIndex < scene->mNumMeshes; meshIndex++){
+        const aiMesh *mesh = scene->mMeshes[meshIndex];
+
+        //Load the bones
+        if(mesh->HasBones()){
+            for(size_t i = 0; i < mesh->mNumBones ; i++){
+                aiBone *bone = mesh->mBones[i];
+                uint32_t boneIndex = 0;
+                std::string nodeName(bone->mName.data);
+
+                if(this->boneMapping.find(nodeName) == this->boneMapping.end()){
+                    boneIndex = this->numberOfBones;
+                    this->numberOfBones++;
+
+                    boneOffsets.push_back(glm::transpose(glm::make_mat4(&bone->mOffsetMatrix.a1)));
+                    this->boneMapping[nodeName] = boneIndex;
+                }else{
+                    boneIndex = this->boneMapping[nodeName];
+                }
+
+                for(uint32_t j = 0 ; j < bone->mNumWeights ; j++){
+                    uint32_t vertexId = vertexOffset + bone->mWeights[j].mVertexId;
+                    float weight = bone->mWeights[j].mWeight;
+
+                    this->bones[vertexId].addBoneData(boneIndex, weight);
+                }
+
+            }
+        }
+
+        const aiVector3D zero3D(0.0f, 0.0f, 0.0f);
+        for(size_t vertexIndex = 0 ; vertexIndex < mesh->mNumVertices ; vertexIndex++){
+            const aiVector3D *pPos = &mesh->mVertices[vertexIndex];
+            const aiVector3D *pNormal = &mesh->mNormals[vertexIndex];
+            const aiVector3D *pTexCoord = mesh->HasTextureCoords(0) ? &mesh->mTextureCoords[0][vertexIndex] : &zero3D;
+
+            Vertex vertex = this->vertices[vertexOffset + vertexIndex];
+            vertex.pos = glm::vec3(pPos->x, pPos->y, pPos->z);
+            vertex.normal = glm::vec3(pNormal->x, pNormal->y, pNormal->z);
+            vertex.texCoord = glm::vec2(pTexCoord->x, pTexCoord->y);
+            vertex.texId = mesh->mMaterialIndex;
+
+            this->vertices[vertexOffset + vertexIndex] = vertex;
+        }
+
+        //Retrieve face data
+        Submesh meshRange = {};
+        meshRange.firstIndex = static_cast<uint32_t>(this->indices.size());
+        meshRange.vertexOffset = vertexOffset;
+        meshRange.vertexCount = mesh->mNumVertices;
+        meshRange.materialIndex = mesh->mMaterialIndex;
+        for(size_t faceIndex = 0 ; faceIndex < mesh->mNumFaces ; faceIndex++){
+            const aiFace &face = mesh->mFaces[faceIndex];
+            assert(face.mNumIndices == 3);
+
+            this->indices.push_back(face.mIndices[0]);
+            this->indices.push_back(face.mIndices[1]);
+            this->indices.push_back(face.mIndices[2]);
+        }
+        meshRange.indexCount = static_cast<uint32_t>(this->indices.size()) - meshRange.firstIndex;
+        meshes.push_back(meshRange);
+
+        vertexOffset += mesh->mNumVertices;
+    }
+
+    //Attach the bone information to the vertices
+    for(size_t vertexId = 0 ; vertexId < this->bones.size(); vertexId++){
+        const VertexBoneData &boneData = this->bones[vertexId];
+        this->vertices[vertexId].boneIds = glm::ivec4(boneData.ids[0], boneData.ids[1], boneData.ids[2], boneData.ids[3]);
+        this->vertices[vertexId].boneWeights = glm::vec4(boneData.weights[0], boneData.weights[1], boneData.weights[2], boneData.weights[3]);
+    }
+
+    //The meshes of a material are merged in one submesh, drawn with a single draw call
+    std::vector<Vertex> meshVertices;
+    std::vector<uint32_t> meshIndices;
+    meshVertices.swap(this->vertices);
+    meshIndices.swap(this->indices);
+    this->submeshes.clear();
+
+    MeshOptimizationStats optimizationStats;
+    float missesBefore = 0.0f;
+    float missesAfter = 0.0f;
+    for(uint32_t material = 0 ; material < scene->mNumMaterials ; material++){
+        std::vector<Vertex> submeshVertices;
+        std::vector<uint32_t> submeshIndices;
+        for(const Submesh &mesh : meshes){
+            if(mesh.materialIndex != material){
+                continue;
+            }
+
+            uint32_t baseVertex = static_cast<uint32_t>(submeshVertices.size());
+            auto firstVertex = meshVertices.begin() + mesh.vertexOffset;
+            submeshVertices.insert(submeshVertices.end(), firstVertex, firstVertex + mesh.vertexCount);
+            for(uint32_t i = 0 ; i < mesh.indexCount ; i++){
+                submeshIndices.push_back(baseVertex + meshIndices[mesh.firstIndex + i]);
+            }
+        }
+        if(submeshIndices.empty()){
+            continue;
+        }
+
+        //Assimp keeps the vertices of every face corner, weld them and order the geometry for the GPU caches
+        MeshOptimizationStats submeshStats;
+        if(this->meshOptimization){
+            submeshStats = optimizeMesh(submeshVertices, submeshIndices);
+        }else{
+            submeshStats.verticesBefore = static_cast<uint32_t>(submeshVertices.size());
+            submeshStats.verticesAfter = submeshStats.verticesBefore;
+            submeshStats.acmrBefore = computeACMR(submeshIndices.data(), submeshIndices.size(), submeshStats.verticesBefore);
+            submeshStats.acmrAfter = submeshStats.acmrBefore;
+        }
+        float triangleCount = static_cast<float>(submeshIndices.size() / 3);
+        optimizationStats.verticesBefore += submeshStats.verticesBefore;
+        optimizationStats.verticesAfter += submeshStats.verticesAfter;
+        missesBefore += submeshStats.acmrBefore * triangleCount;
+        missesAfter += submeshStats.acmrAfter * triangleCount;
+
+        Submesh submesh = {};
+        submesh.firstIndex = static_cast<uint32_t>(this->indices.size());
+        submesh.indexCount = static_cast<uint32_t>(submeshIndices.size());
+        submesh.vertexOffset = static_cast<uint32_t>(this->vertices.size());
+        submesh.vertexCount = static_cast<uint32_t>(submeshVertices.size());
+        submesh.materialIndex = material;
+        this->submeshes.push_back(submesh);
+
+        this->vertices.insert(this->vertices.end(), submeshVertices.begin(), submeshVertices.end());
+        this->indices.insert(this->indices.end(), submeshIndices.begin(), submeshIndices.end());
+    }
+
+    float totalTriangles = static_cast<float>(std::max<size_t>(this->indices.size() / 3, 1));
+    printf("%s %s: %zu meshes -> %zu submeshes, %u -> %u vertices, ACMR %.3f -> %.3f\n",
+           this->meshOptimization ? "Optimized" : "Kept the geometry of", path.c_str(),
+           meshes.size(), this->submeshes.size(),
+           optimizationStats.verticesBefore, optimizationStats.verticesAfter,
+           missesBefore / totalTriangles, missesAfter / totalTriangles);
+
+    this->vertexFormat = VertexFormat::Full;
+    this->vertexData = this->vertices.data();
+    if(this->requestedVertexFormat == VertexFormat::Packed){
+        VertexPackingError packingError;
+        if(packVertices(this->vertices, VertexPackingSettings(), this->packedVertices, packingError)){
+            this->vertexFormat = VertexFormat::Packed;
+            this->vertexData = this->packedVertices.data();
+        }else{
+            this->packedVertices.clear();
+        }
+        printf("%s %s: max error %.4f degrees normal, %.6f texture coordinates, %.4f weights%s\n",
+               this->vertexFormat == VertexFormat::Packed ? "Packed vertices of" : "Kept full vertices of", path.c_str(),
+               packingError.normalDegrees, packingError.texCoord, packingError.boneWeight,
+               packingError.boneIdOverflow ? ", more than 256 bones" : "");
+    }
+    this->vertexCount = static_cast<uint32_t>(this->vertices.size());
+    this->indexData = this->indices.data();
+    this->indexCount = static_cast<uint32_t>(this->indices.size());
+
+    //Load the skeleton and the animations
+    this->skeleton = Skeleton(scene, this->boneMapping, boneOffsets);
+    //The clips are compressed, only the compressed keys are kept for playback
+    ClipCompressionSettings compressionSettings;
+    for(uint32_t i = 0 ; i < scene->mNumAnimations ; i++){
+        AnimationClip clip(scene->mAnimations[i], this->skeleton);
+        this->animations.emplace_back(clip, this->skeleton, compressionSettings);
+    }
+
+    //Load the materials
+    for(size_t i = 0 ; i < scene->mNumMaterials ; i++){
+        aiMaterial *material = scene->mMaterials[i];
+
+        if(material->GetTextureCount(aiTextureType_DIFFUSE) > 0){
+            aiString path;
+
+            if(material->GetTexture(aiTextureType_DIFFUSE, 0, &path, nullptr, nullptr, nullptr, nullptr, nullptr) == AI_SUCCESS){
+                if(strcmp(path.data, ".") == -1) {
+                    this->textureFiles.push_back(path.data);
+                }else{
+                    this->textureFiles.push_back("");
+                }
+            }else{
+                this->textureFiles.push_back("");
+            }
+        }else{
+            this->textureFiles.push_back("");
+        }
+    }
+    this->resolveTexturePaths();
+}
+
+/**
+ * The textures are found next to the model file, wherever the model was loaded from
+ */
+void ModelAsset::resolveTexturePaths() {
+    std::string::size_type SlashIndex = this->path.find_last_of("/");
+    std::string Dir;
+
+    if (SlashIndex == std::string::npos) {
+        Dir = ".";
+    }
+    else if (SlashIndex == 0) {
+        Dir = "/";
+    }
+    else {
+        Dir = this->path.substr(0, SlashIndex);
+    }
+
+    this->texturePaths.clear();
+    for(const std::string &textureFile : this->textureFiles){
+        this->texturePaths.push_back(textureFile.empty() ? DEFAULT_TEXTURE_PATH : Dir + "/" + textureFile);
+    }
+}
+
+/**
+ * Map the cache file and read the asset from it. The vertices and indices are
+ * not copied, they stay in the mapped file until they are uploaded.
+ * @return false if there is no cache or if it is outdated or corrupted
+ */
+bool ModelAsset::loadCache(const std::string &cachePath) {
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if(!getSourceStamp(this->path, sourceSize, sourceTime) || !this->cacheFile.open(cachePath)){
+        return false;
+    }
+
+    try{
+        CacheReader reader(this->cacheFile.getData(), this->cacheFile.getSize());
+
+        MeshCacheHeader header = reader.read<MeshCacheHeader>();
+        //Full vertices are also used when packed vertices were requested but were not precise enough,
+        //a cache written for another requested format is rebuilt
+        bool vertexFormatValid = header.vertexFormat < VERTEX_FORMAT_COUNT
+                && header.requestedVertexFormat == static_cast<uint32_t>(this->requestedVertexFormat)
+                && (header.vertexFormat == static_cast<uint32_t>(this->requestedVertexFormat)
+                    || header.vertexFormat == static_cast<uint32_t>(VertexFormat::Full));
+        if(memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0
+           || header.version != MESH_CACHE_VERSION
+           || !vertexFormatValid
+           || header.vertexSize != VertexInput::getVertexSize(static_cast<VertexFormat>(header.vertexFormat))
+           || header.sourceSize != sourceSize
+           || header.sourceTime != sourceTime){
+            this->cacheFile.close();
+            return false;
+        }
+
+        this->vertexFormat = static_cast<VertexFormat>(header.vertexFormat);
+        if(this->vertexFormat == VertexFormat::Packed){
+            this->vertexData = reader.readArrayView<PackedVertex>(this->vertexCount);
+        }else{
+            this->vertexData = reader.readArrayView<Vertex>(this->vertexCount);
+        }
+        this->indexData = reader.readArrayView<uint32_t>(this->indexCount);
+
+        reader.readArray(this->submeshes);
+        for(const Submesh &submesh : this->submeshes){
+            if(static_cast<uint64_t>(submesh.firstIndex) + submesh.indexCount > this->indexCount
+               || static_cast<uint64_t>(submesh.vertexOffset) + submesh.vertexCount > this->vertexCount){
+                throw std::runtime_error("Corrupted submesh in mesh cache.");
+            }
+        }
+
+        this->skeleton = Skeleton(reader);
+
+        uint32_t animationCount = reader.read<uint32_t>();
+        this->animations.clear();
+        for(uint32_t i = 0 ; i < animationCount ; i++){
+            this->animations.emplace_back(reader, this->skeleton);
+        }
+
+        uint32_t materialCount = reader.read<uint32_t>();
+        this->textureFiles.resize(materialCount);
+        for(std::string &textureFile : this->textureFiles){
+            textureFile = reader.readString();
+        }
+        this->resolveTexturePaths();
+    }catch(const std::exception &e){
+        printf("Ignoring the mesh cache %s: %s\n", cachePath.c_str(), e.what());
+
+        this->cacheFile.close();
+        this->vertexData = nullptr;
+        this->vertexCount = 0;
+        this->indexData = nullptr;
+        this->indexCount = 0;
+        this->submeshes.clear();
+        this->skeleton = Skeleton();
+        this->animations.clear();
+        this->textureFiles.clear();
+        this->texturePaths.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void ModelAsset::writeCache(const std::string &cachePath) const {
+    MeshCacheHeader header = {};
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = this->getVertexSize();
+    header.vertexFormat = static_cast<uint32_t>(this->vertexFormat);
+    header.requestedVertexFormat = static_cast<uint32_t>(this->requestedVertexFormat);
+    if(!getSourceStamp(this->path, header.sourceSize, header.sourceTime)){
+        throw std::runtime_error("Failed to read the modification time of " + this->path);
+    }
+
+    CacheWriter writer;
+    writer.write(header);
+    if(this->vertexFormat == VertexFormat::Packed){
+        writer.writeArray(static_cast<const PackedVertex*>(this->vertexData), this->vertexCount);
+    }else{
+        writer.writeArray(static_cast<const Vertex*>(this->vertexData), this->vertexCount);
+    }
+    writer.writeArray(this->indexData, this->indexCount);
+    writer.writeArray(this->submeshes);
+
+    this->skeleton.writeCache(writer);
+
+    writer.write(static_cast<uint32_t>(this->animations.size()));
+    for(const CompressedAnimationClip &animation : this->animations){
+        animation.writeCache(writer);
+    }
+
+    writer.write(static_cast<uint32_t>(this->textureFiles.size()));
+    for(const std::string &textureFile : this->textureFiles){
+        writer.writeString(textureFile);
+    }
+
+    writer.save(cachePath);
+}
+
+/**
+ * Upload the textures of the materials, must be called from the main thread
+ * @param images the decoded image of every path of getTexturePaths()
+ */
+void ModelAsset::createTextures(const std::vector<DecodedImage> &images) {
+    for(const DecodedImage &image : images){
+        this->textures.push_back(Texture(this->application, this->device, image));
+    }
+}
+
+void ModelAsset::createDescriptorSets() {
+    uint32_t nbFrameBuffers = application->getSwapChainImagesCount();
+
+    //Create the descriptor pool, one set per swap chain image with the descriptors of the set layout
+    std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+    //Instance data, skinned vertices and visible instances
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = nbFrameBuffers * 3;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[1].descriptorCount = nbFrameBuffers;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[2].descriptorCount = nbFrameBuffers * MAX_MODEL_TEXTURES;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = static_cast<uint32_t>(nbFrameBuffers);
+    poolInfo.flags = 0;
+
+    if(vkCreateDescriptorPool(this->device, &poolInfo, nullptr, &this->descriptorPool) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create descriptor pool.");
+    }
+
+    //Create the descriptor sets
+    std::vector<VkDescriptorSetLayout> layouts(nbFrameBuffers, application->getDescriptorSetLayout());
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = this->descriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    allocInfo.pSetLayouts = layouts.data();
+
+    //swapchainImages
+    this->descriptorSets.resize(nbFrameBuffers);
+    if(vkAllocateDescriptorSets(this->device, &allocInfo, this->descriptorSets.data()) != VK_SUCCESS){
+        throw std::runtime_error("Failed to allocate descriptor sets");
+    }
+
+    for(size_t frameBufferIndex = 0 ; frameBufferIndex < nbFrameBuffers; frameBufferIndex++){
+        VkDescriptorBufferInfo instanceBufferInfo = application->getInstanceBufferInfo(frameBufferIndex);
+
+        VkDescriptorBufferInfo skinnedVertexBufferInfo = {};
+        skinnedVertexBufferInfo.buffer = application->getSkinnedVertexBuffer();
+        skinnedVertexBufferInfo.offset = 0;
+        skinnedVertexBufferInfo.range = VK_WHOLE_SIZE;
+
+        VkDescriptorBufferInfo visibleInstanceBufferInfo = {};
+        visibleInstanceBufferInfo.buffer = application->getVisibleInstanceBuffer(frameBufferIndex);
+        visibleInstanceBufferInfo.offset = 0;
+        visibleInstanceBufferInfo.range = VK_WHOLE_SIZE;
+
+        VkDescriptorBufferInfo viewBufferInfo = application->getCameraBufferInfo(frameBufferIndex);
+
+        std::vector<VkDescriptorImageInfo> imageInfos;
+        for(size_t imageInfoIndex = 0 ; imageInfoIndex < MAX_MODEL_TEXTURES ; imageInfoIndex++){
+            VkDescriptorImageInfo info = {};
+            if(imageInfoIndex < this->textures.size()) {
+                Texture &texture = this->textures[imageInfoIndex];
+
+                info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                info.imageView = texture.getImageView();
+                info.sampler = texture.getTextureSampler();
+
+            }else{
+                Texture &texture = this->textures[0];
+                info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                info.imageView = texture.getImageView();
+                info.sampler = texture.getTextureSampler();
+            }
+            imageInfos.push_back(info);
+        }
+
+        std::array<VkWriteDescriptorSet, 5> descriptorWrites = {};
+
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = this->descriptorSets[frameBufferIndex];
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pBufferInfo = &instanceBufferInfo;
+        descriptorWrites[0].pImageInfo = nullptr;
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = this->descriptorSets[frameBufferIndex];
+        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pBufferInfo = &viewBufferInfo;
+        descriptorWrites[1].pImageInfo = nullptr;
+
+        descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[2].dstSet = this->descriptorSets[frameBufferIndex];
+        descriptorWrites[2].dstBinding = 2;
+        descriptorWrites[2].dstArrayElement = 0;
+        descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[2].descriptorCount = static_cast<uint32_t>(imageInfos.size());
+        descriptorWrites[2].pImageInfo = &imageInfos[0];
+
+        descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[3].dstSet = this->descriptorSets[frameBufferIndex];
+        descriptorWrites[3].dstBinding = 3;
+        descriptorWrites[3].dstArrayElement = 0;
+        descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[3].descriptorCount = 1;
+        descriptorWrites[3].pBufferInfo = &skinnedVertexBufferInfo;
+        descriptorWrites[3].pImageInfo = nullptr;
+
+        descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[4].dstSet = this->descriptorSets[frameBufferIndex];
+        descriptorWrites[4].dstBinding = 4;
+        descriptorWrites[4].dstArrayElement = 0;
+        descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[4].descriptorCount = 1;
+        descriptorWrites[4].pBufferInfo = &visibleInstanceBufferInfo;
+        descriptorWrites[4].pImageInfo = nullptr;
+
+        vkUpdateDescriptorSets(this->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+    }
+}
+
+/**
+ * Sphere centered on the bounding box of the vertices, used to cull the instances of the asset
+ */
+void ModelAsset::computeBoundingSphere(){
+    //The position is the first member of both vertex formats
+    const uint8_t *vertices = static_cast<const uint8_t*>(this->vertexData);
+    uint32_t vertexSize = this->getVertexSize();
+    if(vertices == nullptr || this->vertexCount == 0){
+        this->boundingSphere = glm::vec4(0.0f);
+        return;
+    }
+
+    glm::vec3 minimum(INFINITY);
+    glm::vec3 maximum(-INFINITY);
+    for(uint32_t i = 0 ; i < this->vertexCount ; i++){
+        glm::vec3 position;
+        memcpy(&position, vertices + static_cast<size_t>(i) * vertexSize, sizeof(float) * 3);
+        minimum = glm::min(minimum, position);
+        maximum = glm::max(maximum, position);
+    }
+
+    glm::vec3 center = (minimum + maximum) * 0.5f;
+    float radius = 0.0f;
+    for(uint32_t i = 0 ; i < this->vertexCount ; i++){
+        glm::vec3 position;
+        memcpy(&position, vertices + static_cast<size_t>(i) * vertexSize, sizeof(float) * 3);
+        radius = std::max(radius, glm::length(position - center));
+    }
+
+    this->boundingSphere = glm::vec4(center, radius * BOUNDING_SPHERE_POSE_MARGIN);
+}
+
+void ModelAsset::init(){
+    this->createDescriptorSets();
+}
+
+/**
+ * Create the descriptor sets again when the number of swap chain images changes
+ */
+void ModelAsset::recreateDescriptorSets(){
+    vkDestroyDescriptorPool(this->device, this->descriptorPool, nullptr);
+    this->createDescriptorSets();
+}
+
+VkDescriptorSet* ModelAsset::getDescriptorSet(uint32_t i){
+    return &this->descriptorSets[i];
+}
+
+const void* ModelAsset::getVertexData() const {
+    return this->vertexData;
+}
+
+VertexFormat ModelAsset::getVertexFormat() const {
+    return this->vertexFormat;
+}
+
+uint32_t ModelAsset::getVertexSize() const {
+    return VertexInput::getVertexSize(this->vertexFormat);
+}
+
+uint32_t ModelAsset::getVertexCount() const {
+    return this->vertexCount;
+}
+
+const uint32_t* ModelAsset::getIndexData() const {
+    return this->indexData;
+}
+
+const std::vector<Submesh>& ModelAsset::getSubmeshes() const {
+    return this->submeshes;
+}
+
+glm::vec4 ModelAsset::getBoundingSphere() const {
+    return this->boundingSphere;
+}
+
+const Skeleton& ModelAsset::getSkeleton() const {
+    return this->skeleton;
+}
+
+const std::vector<CompressedAnimationClip>& ModelAsset::getAnimations() const {
+    return this->animations;
+}
+
+const std::string& ModelAsset::getPath() const {
+    return this->path;
+}
+
+const std::vector<std::string>& ModelAsset::getTexturePaths() const {
+    return this->texturePaths;
+}
+
+void ModelAsset::setGeometryOffsets(VkDeviceSize vertexOffset, uint32_t firstIndex){
+    this->vertexOffset = vertexOffset;
+    this->firstIndex = firstIndex;
+}
+
+VkDeviceSize ModelAsset::getVertexOffset() const {
+    return this->vertexOffset;
+}
+
+uint32_t ModelAsset::getFirstIndex() const {
+    return this->firstIndex;
+}
+
+uint32_t ModelAsset::getIndexCount() const {
+    return this->indexCount;
+}
+
+void ModelAsset::cleanup() {
+    for(size_t i = 0 ; i < this->textures.size() ; i++){
+        this->textures[i].cleanup();
+    }
+
+    vkDestroyDescriptorPool(this->device, this->descriptorPool, nullptr);
+}
@@ -0,0 +1,124 @@
+//
+// Created by cleme on 2020-02-14.
+//
+
+#ifndef GAME_ENGINE_MODELASSET_HPP
+#define GAME_ENGINE_MODELASSET_HPP
+
+#include <vulkan/vulkan.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "Vertex.hpp"
+#include "Application.hpp"
+#include "Texture.hpp"
+#include "Skeleton.hpp"
+#include "Animation.hpp"
+#include "CompressedAnimation.hpp"
+#include "MeshCache.hpp"
+
+class Application;
+class Texture;
+
+/**
+ * Range of the geometry of an asset drawn with one material.
+ * The indices are relative to the first vertex of the submesh.
+ */
+struct Submesh {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t vertexOffset;
+    uint32_t vertexCount;
+    uint32_t materialIndex;
+};
+
+/**
+ * Data imported from a model file, shared by every instance of the model:
+ * geometry, skeleton, animation clips, textures and descriptor sets.
+ */
+class ModelAsset {
+private:
+    Application *application;
+    VkDevice device;
+    std::string path;
+
+    std::vector<Texture> textures;
+    //Diffuse texture of every material, relative to the directory of the model file, empty without texture
+    std::vector<std::string> textureFiles;
+    //The same textures with the directory of the model file, or the default texture
+    std::vector<std::string> texturePaths;
+
+    //Geometry, owned by the vectors when imported or read in place from the mapped cache file
+    std::vector<Vertex> vertices;
+    std::vector<PackedVertex> packedVertices;
+    std::vector<uint32_t> indices;
+    MappedFile cacheFile;
+    const void *vertexData = nullptr;
+    uint32_t vertexCount = 0;
+    const uint32_t *indexData = nullptr;
+    uint32_t indexCount = 0;
+    //Sorted by material, one per material
+    std::vector<Submesh> submeshes;
+    //Center and radius of a sphere enclosing the vertices, in model space
+    glm::vec4 boundingSphere = glm::vec4(0.0f);
+
+    //The geometry is imported as is and never cached without it, to measure the optimizations
+    bool meshOptimization = true;
+
+    //Packed vertices are only used when the packing error is small enough
+    VertexFormat requestedVertexFormat;
+    VertexFormat vertexFormat = VertexFormat::Full;
+
+    //Location of the geometry in the vertex buffer of the application, the vertex offset is in bytes
+    VkDeviceSize vertexOffset = 0;
+    uint32_t firstIndex = 0;
+
+    //Bones
+    std::map<std::string, uint32_t> boneMapping;
+    std::vector<VertexBoneData> bones;
+    uint32_t numberOfBones = 0;
+
+    //Animation
+    Skeleton skeleton;
+    std::vector<CompressedAnimationClip> animations;
+
+    VkDescriptorPool descriptorPool;
+    std::vector<VkDescriptorSet> descriptorSets;
+
+    void loadModel(std::string path);
+    void importModel(const std::string &path);
+    bool loadCache(const std::string &cachePath);
+    void writeCache(const std::string &cachePath) const;
+    void resolveTexturePaths();
+    void computeBoundingSphere();
+    void createDescriptorSets();
+
+public:
+    ModelAsset(Application *application, VkDevice &device, const std::string &path, VertexFormat vertexFormat = VertexFormat::Packed, bool meshOptimization = true);
+    void load();
+    void createTextures(const std::vector<DecodedImage> &images);
+    void cleanup();
+    void init();
+    void recreateDescriptorSets();
+
+    VkDescriptorSet* getDescriptorSet(uint32_t i);
+    const void* getVertexData() const;
+    uint32_t getVertexCount() const;
+    VertexFormat getVertexFormat() const;
+    uint32_t getVertexSize() const;
+    const uint32_t* getIndexData() const;
+    const std::vector<Submesh>& getSubmeshes() const;
+    glm::vec4 getBoundingSphere() const;
+    const Skeleton& getSkeleton() const;
+    const std::vector<CompressedAnimationClip>& getAnimations() const;
+    const std::string& getPath() const;
+    const std::vector<std::string>& getTexturePaths() const;
+
+    void setGeometryOffsets(VkDeviceSize vertexOffset, uint32_t firstIndex);
+    VkDeviceSize getVertexOffset() const;
+    uint32_t getFirstIndex() const;
+    uint32_t getIndexCount() const;
+};
+
+
+#endif //GAME_ENGINE_MODELASSET_HPP
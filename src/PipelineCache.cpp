@@ -0,0 +1,118 @@
+//
+// Created by cleme on 2020-03-02.
+//
+
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#include "PipelineCache.hpp"
+#include "MeshCache.hpp"
+
+PipelineCache::PipelineCache(){
+
+}
+
+PipelineCache::PipelineCache(VkPhysicalDevice physicalDevice, VkDevice device){
+    this->physicalDevice = physicalDevice;
+    this->device = device;
+}
+
+PipelineCacheHeader PipelineCache::getDeviceHeader(){
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(this->physicalDevice, &properties);
+
+    PipelineCacheHeader header = {};
+    memcpy(header.magic, PIPELINE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = PIPELINE_CACHE_VERSION;
+    header.vendorID = properties.vendorID;
+    header.deviceID = properties.deviceID;
+    header.driverVersion = properties.driverVersion;
+    memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    return header;
+}
+
+/**
+ * Create the cache from the file, or empty if the file is missing, corrupted or written by another device or driver
+ */
+void PipelineCache::load(const std::string &path){
+    PipelineCacheHeader deviceHeader = this->getDeviceHeader();
+    std::vector<char> initialData;
+
+    MappedFile file;
+    if(file.open(path)){
+        try{
+            CacheReader reader(file.getData(), file.getSize());
+            PipelineCacheHeader header = reader.read<PipelineCacheHeader>();
+            if(memcmp(&header, &deviceHeader, sizeof(PipelineCacheHeader)) == 0){
+                reader.readArray(initialData);
+            }else{
+                printf("Ignoring the pipeline cache %s: written by another device or driver\n", path.c_str());
+            }
+        }catch(const std::exception &e){
+            printf("Ignoring the pipeline cache %s: %s\n", path.c_str(), e.what());
+            initialData.clear();
+        }
+        file.close();
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo = {};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = initialData.size();
+    cacheInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+    //The driver checks its own header too, and may still reject the data
+    if(vkCreatePipelineCache(this->device, &cacheInfo, nullptr, &this->cache) != VK_SUCCESS){
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+        initialData.clear();
+        if(vkCreatePipelineCache(this->device, &cacheInfo, nullptr, &this->cache) != VK_SUCCESS){
+            throw std::runtime_error("Failed to create pipeline cache.");
+        }
+    }
+
+    this->loaded = !initialData.empty();
+    printf("Pipeline cache %s: %s (%zu bytes)\n", path.c_str(), this->loaded ? "loaded" : "empty", initialData.size());
+}
+
+/**
+ * Write the content of the cache, with the pipelines created since the load
+ */
+void PipelineCache::save(const std::string &path){
+    size_t dataSize = 0;
+    if(vkGetPipelineCacheData(this->device, this->cache, &dataSize, nullptr) != VK_SUCCESS){
+        printf("Failed to read the pipeline cache.\n");
+        return;
+    }
+    std::vector<char> data(dataSize);
+    if(vkGetPipelineCacheData(this->device, this->cache, &dataSize, data.data()) != VK_SUCCESS){
+        printf("Failed to read the pipeline cache.\n");
+        return;
+    }
+    data.resize(dataSize);
+
+    CacheWriter writer;
+    writer.write(this->getDeviceHeader());
+    writer.writeArray(data);
+    try{
+        writer.save(path);
+    }catch(const std::exception &e){
+        printf("Failed to save the pipeline cache: %s\n", e.what());
+    }
+}
+
+VkPipelineCache PipelineCache::getCache(){
+    return this->cache;
+}
+
+/**
+ * @return true if the cache started from the data of a previous run
+ */
+bool PipelineCache::isLoaded(){
+    return this->loaded;
+}
+
+void PipelineCache::cleanup(){
+    vkDestroyPipelineCache(this->device, this->cache, nullptr);
+    this->cache = VK_NULL_HANDLE;
+}
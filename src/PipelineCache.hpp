@@ -0,0 +1,57 @@
+//
+// Created by cleme on 2020-03-02.
+//
+
+#ifndef GAME_ENGINE_PIPELINECACHE_HPP
+#define GAME_ENGINE_PIPELINECACHE_HPP
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <string>
+
+const char PIPELINE_CACHE_MAGIC[4] = {'G', 'E', 'P', 'C'};
+//Increase when the layout of the cache file changes
+const uint32_t PIPELINE_CACHE_VERSION = 1;
+
+/**
+ * First bytes of a pipeline cache file. The data of the driver is only given back to the
+ * device and the driver that wrote it, anything else starts from an empty cache.
+ */
+struct PipelineCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+/**
+ * VkPipelineCache shared by every pipeline of the application, loaded from the disk at
+ * startup and saved at shutdown so that the shaders are only compiled on the first run.
+ * The cache can be used from several threads at once.
+ */
+class PipelineCache {
+private:
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    bool loaded = false;
+
+    PipelineCacheHeader getDeviceHeader();
+
+public:
+    PipelineCache();
+    PipelineCache(VkPhysicalDevice physicalDevice, VkDevice device);
+
+    void load(const std::string &path);
+    void save(const std::string &path);
+
+    VkPipelineCache getCache();
+    bool isLoaded();
+
+    void cleanup();
+};
+
+
+#endif //GAME_ENGINE_PIPELINECACHE_HPP
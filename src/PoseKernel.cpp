@@ -0,0 +1,374 @@
+//
+// Created by cleme on 2020-02-18.
+//
+
+#include <cmath>
+#include "PoseKernel.hpp"
+
+//POSE_KERNEL_SCALAR keeps the scalar kernels, used to test them on any machine
+#if !defined(POSE_KERNEL_SCALAR) && (defined(__SSE2__) || defined(_M_X64))
+#define POSE_KERNEL_SSE
+#include <immintrin.h>
+#endif
+
+//The 8 wide kernels also use the fused multiply-add of the AVX2 processors
+#if defined(POSE_KERNEL_SSE) && defined(__AVX2__) && defined(__FMA__)
+#define POSE_KERNEL_AVX2
+#endif
+
+void PoseBlend::clear(){
+    this->nodes.clear();
+    this->factors.clear();
+    for(size_t i = 0 ; i < 4 ; i++){
+        this->from[i].clear();
+        this->to[i].clear();
+    }
+}
+
+void PoseBlend::add(uint32_t node, float factor, const float *fromValue, const float *toValue, uint32_t components){
+    this->nodes.push_back(node);
+    this->factors.push_back(factor);
+    for(uint32_t i = 0 ; i < components ; i++){
+        this->from[i].push_back(fromValue[i]);
+        this->to[i].push_back(toValue[i]);
+    }
+}
+
+/**
+ * Linear interpolation of the tracks [begin, end), written to their node
+ */
+void blendVectorsScalar(const PoseBlend &blend, std::array<std::vector<float>, 3> &values, size_t begin, size_t end){
+    for(size_t i = begin ; i < end ; i++){
+        float factor = blend.factors[i];
+        uint32_t node = blend.nodes[i];
+        for(size_t c = 0 ; c < 3 ; c++){
+            values[c][node] = blend.from[c][i] + (blend.to[c][i] - blend.from[c][i]) * factor;
+        }
+    }
+}
+
+/**
+ * Normalized linear interpolation of the rotation tracks [begin, end), taking the shortest path
+ */
+void blendRotationsScalar(const PoseBlend &blend, std::array<std::vector<float>, 4> &rotations, size_t begin, size_t end){
+    for(size_t i = begin ; i < end ; i++){
+        float factor = blend.factors[i];
+        uint32_t node = blend.nodes[i];
+
+        float cosTheta = 0.0f;
+        for(size_t c = 0 ; c < 4 ; c++){
+            cosTheta += blend.from[c][i] * blend.to[c][i];
+        }
+        float sign = cosTheta < 0.0f ? -1.0f : 1.0f;
+
+        float result[4];
+        float lengthSquared = 0.0f;
+        for(size_t c = 0 ; c < 4 ; c++){
+            result[c] = blend.from[c][i] + (blend.to[c][i] * sign - blend.from[c][i]) * factor;
+            lengthSquared += result[c] * result[c];
+        }
+
+        float inverseLength = 1.0f / std::sqrt(lengthSquared);
+        for(size_t c = 0 ; c < 4 ; c++){
+            rotations[c][node] = result[c] * inverseLength;
+        }
+    }
+}
+
+void blendVectors(const PoseBlend &blend, std::array<std::vector<float>, 3> &values){
+    size_t count = blend.nodes.size();
+    size_t i = 0;
+
+#ifdef POSE_KERNEL_AVX2
+    for(; i + 8 <= count ; i += 8){
+        __m256 factor = _mm256_loadu_ps(&blend.factors[i]);
+
+        alignas(32) float result[3][8];
+        for(size_t c = 0 ; c < 3 ; c++){
+            __m256 from = _mm256_loadu_ps(&blend.from[c][i]);
+            __m256 to = _mm256_loadu_ps(&blend.to[c][i]);
+            _mm256_store_ps(result[c], _mm256_fmadd_ps(_mm256_sub_ps(to, from), factor, from));
+        }
+
+        for(size_t k = 0 ; k < 8 ; k++){
+            uint32_t node = blend.nodes[i + k];
+            values[0][node] = result[0][k];
+            values[1][node] = result[1][k];
+            values[2][node] = result[2][k];
+        }
+    }
+#endif
+
+#ifdef POSE_KERNEL_SSE
+    for(; i + 4 <= count ; i += 4){
+        __m128 factor = _mm_loadu_ps(&blend.factors[i]);
+
+        alignas(16) float result[3][4];
+        for(size_t c = 0 ; c < 3 ; c++){
+            __m128 from = _mm_loadu_ps(&blend.from[c][i]);
+            __m128 to = _mm_loadu_ps(&blend.to[c][i]);
+            _mm_store_ps(result[c], _mm_add_ps(from, _mm_mul_ps(_mm_sub_ps(to, from), factor)));
+        }
+
+        for(size_t k = 0 ; k < 4 ; k++){
+            uint32_t node = blend.nodes[i + k];
+            values[0][node] = result[0][k];
+            values[1][node] = result[1][k];
+            values[2][node] = result[2][k];
+        }
+    }
+#endif
+
+    blendVectorsScalar(blend, values, i, count);
+}
+
+void blendRotations(const PoseBlend &blend, std::array<std::vector<float>, 4> &rotations){
+    size_t count = blend.nodes.size();
+    size_t i = 0;
+
+#ifdef POSE_KERNEL_AVX2
+    const __m256 signBit8 = _mm256_set1_ps(-0.0f);
+    const __m256 zero8 = _mm256_setzero_ps();
+    const __m256 one8 = _mm256_set1_ps(1.0f);
+
+    for(; i + 8 <= count ; i += 8){
+        __m256 factor = _mm256_loadu_ps(&blend.factors[i]);
+
+        __m256 from[4];
+        __m256 to[4];
+        __m256 cosTheta = zero8;
+        for(size_t c = 0 ; c < 4 ; c++){
+            from[c] = _mm256_loadu_ps(&blend.from[c][i]);
+            to[c] = _mm256_loadu_ps(&blend.to[c][i]);
+            cosTheta = _mm256_fmadd_ps(from[c], to[c], cosTheta);
+        }
+
+        //Flip the target rotation when it is on the other hemisphere
+        __m256 flip = _mm256_and_ps(_mm256_cmp_ps(cosTheta, zero8, _CMP_LT_OQ), signBit8);
+
+        __m256 result[4];
+        __m256 lengthSquared = zero8;
+        for(size_t c = 0 ; c < 4 ; c++){
+            __m256 target = _mm256_xor_ps(to[c], flip);
+            result[c] = _mm256_fmadd_ps(_mm256_sub_ps(target, from[c]), factor, from[c]);
+            lengthSquared = _mm256_fmadd_ps(result[c], result[c], lengthSquared);
+        }
+
+        __m256 inverseLength = _mm256_div_ps(one8, _mm256_sqrt_ps(lengthSquared));
+
+        alignas(32) float normalized[4][8];
+        for(size_t c = 0 ; c < 4 ; c++){
+            _mm256_store_ps(normalized[c], _mm256_mul_ps(result[c], inverseLength));
+        }
+
+        for(size_t k = 0 ; k < 8 ; k++){
+            uint32_t node = blend.nodes[i + k];
+            for(size_t c = 0 ; c < 4 ; c++){
+                rotations[c][node] = normalized[c][k];
+            }
+        }
+    }
+#endif
+
+#ifdef POSE_KERNEL_SSE
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+
+    for(; i + 4 <= count ; i += 4){
+        __m128 factor = _mm_loadu_ps(&blend.factors[i]);
+
+        __m128 from[4];
+        __m128 to[4];
+        __m128 cosTheta = zero;
+        for(size_t c = 0 ; c < 4 ; c++){
+            from[c] = _mm_loadu_ps(&blend.from[c][i]);
+            to[c] = _mm_loadu_ps(&blend.to[c][i]);
+            cosTheta = _mm_add_ps(cosTheta, _mm_mul_ps(from[c], to[c]));
+        }
+
+        //Flip the target rotation when it is on the other hemisphere
+        __m128 flip = _mm_and_ps(_mm_cmplt_ps(cosTheta, zero), signBit);
+
+        __m128 result[4];
+        __m128 lengthSquared = zero;
+        for(size_t c = 0 ; c < 4 ; c++){
+            __m128 target = _mm_xor_ps(to[c], flip);
+            result[c] = _mm_add_ps(from[c], _mm_mul_ps(_mm_sub_ps(target, from[c]), factor));
+            lengthSquared = _mm_add_ps(lengthSquared, _mm_mul_ps(result[c], result[c]));
+        }
+
+        __m128 inverseLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared));
+
+        alignas(16) float normalized[4][4];
+        for(size_t c = 0 ; c < 4 ; c++){
+            _mm_store_ps(normalized[c], _mm_mul_ps(result[c], inverseLength));
+        }
+
+        for(size_t k = 0 ; k < 4 ; k++){
+            uint32_t node = blend.nodes[i + k];
+            for(size_t c = 0 ; c < 4 ; c++){
+                rotations[c][node] = normalized[c][k];
+            }
+        }
+    }
+#endif
+
+    blendRotationsScalar(blend, rotations, i, count);
+}
+
+void buildLocalTransformsScalar(const std::array<std::vector<float>, 3> &translations,
+                                const std::array<std::vector<float>, 4> &rotations,
+                                const std::array<std::vector<float>, 3> &scales,
+                                AffineTransform *transforms, size_t begin, size_t end){
+    for(size_t i = begin ; i < end ; i++){
+        float x = rotations[0][i];
+        float y = rotations[1][i];
+        float z = rotations[2][i];
+        float w = rotations[3][i];
+        float sx = scales[0][i];
+        float sy = scales[1][i];
+        float sz = scales[2][i];
+
+        AffineTransform &transform = transforms[i];
+        transform.rows[0][0] = (1.0f - 2.0f * (y * y + z * z)) * sx;
+        transform.rows[0][1] = 2.0f * (x * y - w * z) * sy;
+        transform.rows[0][2] = 2.0f * (x * z + w * y) * sz;
+        transform.rows[0][3] = translations[0][i];
+
+        transform.rows[1][0] = 2.0f * (x * y + w * z) * sx;
+        transform.rows[1][1] = (1.0f - 2.0f * (x * x + z * z)) * sy;
+        transform.rows[1][2] = 2.0f * (y * z - w * x) * sz;
+        transform.rows[1][3] = translations[1][i];
+
+        transform.rows[2][0] = 2.0f * (x * z - w * y) * sx;
+        transform.rows[2][1] = 2.0f * (y * z + w * x) * sy;
+        transform.rows[2][2] = (1.0f - 2.0f * (x * x + y * y)) * sz;
+        transform.rows[2][3] = translations[2][i];
+    }
+}
+
+#ifdef POSE_KERNEL_SSE
+/**
+ * Write the rows of four transforms, each input holds one element of the row for the four transforms
+ */
+void storeRows(AffineTransform *transforms, size_t row, __m128 m0, __m128 m1, __m128 m2, __m128 m3){
+    _MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+    _mm_store_ps(transforms[0].rows[row], m0);
+    _mm_store_ps(transforms[1].rows[row], m1);
+    _mm_store_ps(transforms[2].rows[row], m2);
+    _mm_store_ps(transforms[3].rows[row], m3);
+}
+#endif
+
+/**
+ * Build the local transform of every node from its translation, rotation and scale
+ */
+void buildLocalTransforms(const std::array<std::vector<float>, 3> &translations,
+                          const std::array<std::vector<float>, 4> &rotations,
+                          const std::array<std::vector<float>, 3> &scales,
+                          AffineTransform *transforms){
+    size_t count = translations[0].size();
+    size_t i = 0;
+
+#ifdef POSE_KERNEL_AVX2
+    const __m256 halfOne8 = _mm256_set1_ps(0.5f);
+    const __m256 two8 = _mm256_set1_ps(2.0f);
+
+    for(; i + 8 <= count ; i += 8){
+        __m256 x = _mm256_loadu_ps(&rotations[0][i]);
+        __m256 y = _mm256_loadu_ps(&rotations[1][i]);
+        __m256 z = _mm256_loadu_ps(&rotations[2][i]);
+        __m256 w = _mm256_loadu_ps(&rotations[3][i]);
+        __m256 sx = _mm256_mul_ps(two8, _mm256_loadu_ps(&scales[0][i]));
+        __m256 sy = _mm256_mul_ps(two8, _mm256_loadu_ps(&scales[1][i]));
+        __m256 sz = _mm256_mul_ps(two8, _mm256_loadu_ps(&scales[2][i]));
+
+        __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+        __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+        //The scales are premultiplied by 2, (0.5 - (a + b)) * 2s == (1 - 2(a + b)) * s
+        __m256 m[3][4] = {
+            {_mm256_mul_ps(_mm256_sub_ps(halfOne8, _mm256_add_ps(yy, zz)), sx), _mm256_mul_ps(_mm256_fmsub_ps(x, y, wz), sy), _mm256_mul_ps(_mm256_fmadd_ps(x, z, wy), sz), _mm256_loadu_ps(&translations[0][i])},
+            {_mm256_mul_ps(_mm256_fmadd_ps(x, y, wz), sx), _mm256_mul_ps(_mm256_sub_ps(halfOne8, _mm256_add_ps(xx, zz)), sy), _mm256_mul_ps(_mm256_fmsub_ps(y, z, wx), sz), _mm256_loadu_ps(&translations[1][i])},
+            {_mm256_mul_ps(_mm256_fmsub_ps(x, z, wy), sx), _mm256_mul_ps(_mm256_fmadd_ps(y, z, wx), sy), _mm256_mul_ps(_mm256_sub_ps(halfOne8, _mm256_add_ps(xx, yy)), sz), _mm256_loadu_ps(&translations[2][i])}
+        };
+
+        for(size_t row = 0 ; row < 3 ; row++){
+            storeRows(&transforms[i], row,
+                      _mm256_castps256_ps128(m[row][0]), _mm256_castps256_ps128(m[row][1]),
+                      _mm256_castps256_ps128(m[row][2]), _mm256_castps256_ps128(m[row][3]));
+            storeRows(&transforms[i + 4], row,
+                      _mm256_extractf128_ps(m[row][0], 1), _mm256_extractf128_ps(m[row][1], 1),
+                      _mm256_extractf128_ps(m[row][2], 1), _mm256_extractf128_ps(m[row][3], 1));
+        }
+    }
+#endif
+
+#ifdef POSE_KERNEL_SSE
+    const __m128 halfOne = _mm_set1_ps(0.5f);
+    const __m128 two = _mm_set1_ps(2.0f);
+
+    for(; i + 4 <= count ; i += 4){
+        __m128 x = _mm_loadu_ps(&rotations[0][i]);
+        __m128 y = _mm_loadu_ps(&rotations[1][i]);
+        __m128 z = _mm_loadu_ps(&rotations[2][i]);
+        __m128 w = _mm_loadu_ps(&rotations[3][i]);
+        __m128 sx = _mm_mul_ps(two, _mm_loadu_ps(&scales[0][i]));
+        __m128 sy = _mm_mul_ps(two, _mm_loadu_ps(&scales[1][i]));
+        __m128 sz = _mm_mul_ps(two, _mm_loadu_ps(&scales[2][i]));
+
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        storeRows(&transforms[i], 0,
+                  _mm_mul_ps(_mm_sub_ps(halfOne, _mm_add_ps(yy, zz)), sx),
+                  _mm_mul_ps(_mm_sub_ps(xy, wz), sy),
+                  _mm_mul_ps(_mm_add_ps(xz, wy), sz),
+                  _mm_loadu_ps(&translations[0][i]));
+        storeRows(&transforms[i], 1,
+                  _mm_mul_ps(_mm_add_ps(xy, wz), sx),
+                  _mm_mul_ps(_mm_sub_ps(halfOne, _mm_add_ps(xx, zz)), sy),
+                  _mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+                  _mm_loadu_ps(&translations[1][i]));
+        storeRows(&transforms[i], 2,
+                  _mm_mul_ps(_mm_sub_ps(xz, wy), sx),
+                  _mm_mul_ps(_mm_add_ps(yz, wx), sy),
+                  _mm_mul_ps(_mm_sub_ps(halfOne, _mm_add_ps(xx, yy)), sz),
+                  _mm_loadu_ps(&translations[2][i]));
+    }
+#endif
+
+    buildLocalTransformsScalar(translations, rotations, scales, transforms, i, count);
+}
+
+/**
+ * result = parent * local, result can not alias the inputs
+ */
+void concatenateTransforms(const AffineTransform &parent, const AffineTransform &local, AffineTransform &result){
+#ifdef POSE_KERNEL_SSE
+    __m128 local0 = _mm_load_ps(local.rows[0]);
+    __m128 local1 = _mm_load_ps(local.rows[1]);
+    __m128 local2 = _mm_load_ps(local.rows[2]);
+    //Keeps only the translation of the parent row, the implicit last row of local is (0, 0, 0, 1)
+    const __m128 translationMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+
+    for(size_t row = 0 ; row < 3 ; row++){
+        __m128 parentRow = _mm_load_ps(parent.rows[row]);
+        __m128 value = _mm_and_ps(parentRow, translationMask);
+        value = _mm_add_ps(value, _mm_mul_ps(_mm_shuffle_ps(parentRow, parentRow, _MM_SHUFFLE(0, 0, 0, 0)), local0));
+        value = _mm_add_ps(value, _mm_mul_ps(_mm_shuffle_ps(parentRow, parentRow, _MM_SHUFFLE(1, 1, 1, 1)), local1));
+        value = _mm_add_ps(value, _mm_mul_ps(_mm_shuffle_ps(parentRow, parentRow, _MM_SHUFFLE(2, 2, 2, 2)), local2));
+        _mm_store_ps(result.rows[row], value);
+    }
+#else
+    for(size_t row = 0 ; row < 3 ; row++){
+        for(size_t column = 0 ; column < 4 ; column++){
+            result.rows[row][column] = parent.rows[row][0] * local.rows[0][column]
+                                     + parent.rows[row][1] * local.rows[1][column]
+                                     + parent.rows[row][2] * local.rows[2][column];
+        }
+        result.rows[row][3] += parent.rows[row][3];
+    }
+#endif
+}
@@ -0,0 +1,44 @@
+//
+// Created by cleme on 2020-02-18.
+//
+
+#ifndef GAME_ENGINE_POSEKERNEL_HPP
+#define GAME_ENGINE_POSEKERNEL_HPP
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Affine transform stored as the three first rows of a 4x4 matrix.
+ */
+struct alignas(16) AffineTransform {
+    float rows[3][4];
+};
+
+/**
+ * Pairs of keyframes gathered by the animation samplers, one entry per track.
+ * Every component is stored in its own array so that the tracks are blended
+ * several at a time.
+ */
+struct PoseBlend {
+    std::vector<uint32_t> nodes;
+    std::vector<float> factors;
+    std::array<std::vector<float>, 4> from;
+    std::array<std::vector<float>, 4> to;
+
+    void clear();
+    void add(uint32_t node, float factor, const float *fromValue, const float *toValue, uint32_t components);
+};
+
+void blendVectors(const PoseBlend &blend, std::array<std::vector<float>, 3> &values);
+void blendRotations(const PoseBlend &blend, std::array<std::vector<float>, 4> &rotations);
+
+void buildLocalTransforms(const std::array<std::vector<float>, 3> &translations,
+                          const std::array<std::vector<float>, 4> &rotations,
+                          const std::array<std::vector<float>, 3> &scales,
+                          AffineTransform *transforms);
+void concatenateTransforms(const AffineTransform &parent, const AffineTransform &local, AffineTransform &result);
+
+
+#endif //GAME_ENGINE_POSEKERNEL_HPP
@@ -0,0 +1,196 @@
+//
+// Created by cleme on 2020-02-12.
+//
+
+#include <algorithm>
+#include <stdexcept>
+#include "Skeleton.hpp"
+#include "MeshCache.hpp"
+
+Skeleton::Skeleton(){
+
+}
+
+/**
+ * Flatten the node hierarchy of the scene in breadth first order and copy
+ * the bind pose of every node.
+ * @param boneMapping the bone index of every node that deforms vertices
+ * @param boneOffsets the offset matrix of every bone, indexed by bone index
+ */
+Skeleton::Skeleton(const aiScene *scene, const std::map<std::string, uint32_t> &boneMapping, const std::vector<glm::mat4> &boneOffsets){
+    for(const glm::mat4 &offset : boneOffsets){
+        AffineTransform transform;
+        for(int row = 0 ; row < 3 ; row++){
+            for(int column = 0 ; column < 4 ; column++){
+                transform.rows[row][column] = offset[column][row];
+            }
+        }
+        this->boneOffsets.push_back(transform);
+    }
+    this->boneNodes.resize(boneOffsets.size(), -1);
+
+    std::vector<const aiNode*> nodes = {scene->mRootNode};
+    this->parents.push_back(-1);
+
+    for(size_t nodeIndex = 0 ; nodeIndex < nodes.size() ; nodeIndex++){
+        const aiNode *pNode = nodes[nodeIndex];
+        std::string nodeName(pNode->mName.data);
+
+        aiVector3D scaling;
+        aiQuaternion rotation;
+        aiVector3D position;
+        pNode->mTransformation.Decompose(scaling, rotation, position);
+
+        this->names.push_back(nodeName);
+        this->bindPose.translations[0].push_back(position.x);
+        this->bindPose.translations[1].push_back(position.y);
+        this->bindPose.translations[2].push_back(position.z);
+        this->bindPose.rotations[0].push_back(rotation.x);
+        this->bindPose.rotations[1].push_back(rotation.y);
+        this->bindPose.rotations[2].push_back(rotation.z);
+        this->bindPose.rotations[3].push_back(rotation.w);
+        this->bindPose.scales[0].push_back(scaling.x);
+        this->bindPose.scales[1].push_back(scaling.y);
+        this->bindPose.scales[2].push_back(scaling.z);
+
+        auto bone = boneMapping.find(nodeName);
+        if(bone != boneMapping.end()){
+            this->boneNodes[bone->second] = static_cast<int32_t>(nodeIndex);
+        }
+
+        for(uint32_t i = 0 ; i < pNode->mNumChildren ; i++){
+            nodes.push_back(pNode->mChildren[i]);
+            this->parents.push_back(static_cast<int32_t>(nodeIndex));
+        }
+    }
+
+    //Children always come after their parent, a backward loop sees every child before its parent
+    this->heights.resize(this->parents.size(), 0);
+    for(size_t nodeIndex = this->parents.size() ; nodeIndex-- > 1 ;){
+        uint32_t &parentHeight = this->heights[this->parents[nodeIndex]];
+        parentHeight = std::max(parentHeight, this->heights[nodeIndex] + 1);
+    }
+}
+
+/**
+ * Read a skeleton written by writeCache
+ */
+Skeleton::Skeleton(CacheReader &reader){
+    uint32_t nodeCount = reader.read<uint32_t>();
+    this->names.resize(nodeCount);
+    for(std::string &name : this->names){
+        name = reader.readString();
+    }
+    reader.readArray(this->parents);
+    reader.readArray(this->heights);
+
+    bool valid = this->parents.size() == nodeCount && this->heights.size() == nodeCount;
+
+    for(std::vector<float> &component : this->bindPose.translations){
+        reader.readArray(component);
+        valid = valid && component.size() == nodeCount;
+    }
+    for(std::vector<float> &component : this->bindPose.rotations){
+        reader.readArray(component);
+        valid = valid && component.size() == nodeCount;
+    }
+    for(std::vector<float> &component : this->bindPose.scales){
+        reader.readArray(component);
+        valid = valid && component.size() == nodeCount;
+    }
+
+    reader.readArray(this->boneNodes);
+    reader.readArray(this->boneOffsets);
+    valid = valid && this->boneNodes.size() == this->boneOffsets.size();
+
+    if(!valid){
+        throw std::runtime_error("Corrupted skeleton in mesh cache.");
+    }
+}
+
+void Skeleton::writeCache(CacheWriter &writer) const {
+    writer.write(static_cast<uint32_t>(this->names.size()));
+    for(const std::string &name : this->names){
+        writer.writeString(name);
+    }
+    writer.writeArray(this->parents);
+    writer.writeArray(this->heights);
+
+    for(const std::vector<float> &component : this->bindPose.translations){
+        writer.writeArray(component);
+    }
+    for(const std::vector<float> &component : this->bindPose.rotations){
+        writer.writeArray(component);
+    }
+    for(const std::vector<float> &component : this->bindPose.scales){
+        writer.writeArray(component);
+    }
+
+    writer.writeArray(this->boneNodes);
+    writer.writeArray(this->boneOffsets);
+}
+
+uint32_t Skeleton::getNodeCount() const {
+    return static_cast<uint32_t>(this->parents.size());
+}
+
+uint32_t Skeleton::getBoneCount() const {
+    return static_cast<uint32_t>(this->boneOffsets.size());
+}
+
+/**
+ * @return the index of the node with the specified name or -1 if there is none
+ */
+int32_t Skeleton::findNode(const std::string &name) const {
+    for(size_t i = 0 ; i < this->names.size() ; i++){
+        if(this->names[i] == name){
+            return static_cast<int32_t>(i);
+        }
+    }
+
+    return -1;
+}
+
+uint32_t Skeleton::getNodeHeight(uint32_t node) const {
+    return this->heights[node];
+}
+
+/**
+ * Set the local transforms of the pose to the bind pose of the skeleton
+ */
+void Skeleton::resetPose(Pose &pose) const {
+    pose.translations = this->bindPose.translations;
+    pose.rotations = this->bindPose.rotations;
+    pose.scales = this->bindPose.scales;
+    pose.localTransforms.resize(this->parents.size());
+    pose.globalTransforms.resize(this->parents.size());
+}
+
+/**
+ * Compute the global transform of every node of the pose and write the
+ * final transformation of every bone in the palette.
+ * The local transforms are built several nodes at a time, the hierarchy is
+ * then concatenated with 3x4 matrices.
+ * @param palette array of getBoneCount() 3x4 matrices
+ */
+void Skeleton::computeBonePalette(Pose &pose, AffineTransform *palette) const {
+    buildLocalTransforms(pose.translations, pose.rotations, pose.scales, pose.localTransforms.data());
+
+    for(size_t nodeIndex = 0 ; nodeIndex < this->parents.size() ; nodeIndex++){
+        int32_t parent = this->parents[nodeIndex];
+        if(parent >= 0){
+            concatenateTransforms(pose.globalTransforms[parent], pose.localTransforms[nodeIndex], pose.globalTransforms[nodeIndex]);
+        } else {
+            pose.globalTransforms[nodeIndex] = pose.localTransforms[nodeIndex];
+        }
+    }
+
+    for(size_t boneIndex = 0 ; boneIndex < this->boneOffsets.size() ; boneIndex++){
+        int32_t node = this->boneNodes[boneIndex];
+        if(node >= 0){
+            concatenateTransforms(pose.globalTransforms[node], this->boneOffsets[boneIndex], palette[boneIndex]);
+        } else {
+            palette[boneIndex] = {{{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}}};
+        }
+    }
+}
@@ -0,0 +1,73 @@
+//
+// Created by cleme on 2020-02-12.
+//
+
+#ifndef GAME_ENGINE_SKELETON_HPP
+#define GAME_ENGINE_SKELETON_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <assimp/scene.h>
+#include "PoseKernel.hpp"
+
+class CacheReader;
+class CacheWriter;
+
+/**
+ * Local transforms of every node of a skeleton, one array per component
+ * (x, y, z and w for the rotations) so that the kernels process several nodes at once.
+ */
+struct Pose {
+    std::array<std::vector<float>, 3> translations;
+    std::array<std::vector<float>, 4> rotations;
+    std::array<std::vector<float>, 3> scales;
+    std::vector<AffineTransform> localTransforms;
+    std::vector<AffineTransform> globalTransforms;
+
+    //Keys gathered by the animation samplers before being blended
+    PoseBlend translationKeys;
+    PoseBlend rotationKeys;
+    PoseBlend scaleKeys;
+};
+
+/**
+ * Engine owned copy of the node hierarchy of a model.
+ * The nodes are sorted so that a parent always comes before its children,
+ * the global transforms are then computed with a single forward loop.
+ */
+class Skeleton {
+private:
+    std::vector<std::string> names;
+    std::vector<int32_t> parents;
+    //Number of nodes between every node and its deepest descendant, 0 for the leaves
+    std::vector<uint32_t> heights;
+
+    //Bind pose of every node
+    Pose bindPose;
+
+    //Bones, indexed by the bone ids stored in the vertices
+    std::vector<int32_t> boneNodes;
+    std::vector<AffineTransform> boneOffsets;
+
+public:
+    Skeleton();
+    Skeleton(const aiScene *scene, const std::map<std::string, uint32_t> &boneMapping, const std::vector<glm::mat4> &boneOffsets);
+    explicit Skeleton(CacheReader &reader);
+
+    void writeCache(CacheWriter &writer) const;
+
+    uint32_t getNodeCount() const;
+    uint32_t getBoneCount() const;
+    int32_t findNode(const std::string &name) const;
+    uint32_t getNodeHeight(uint32_t node) const;
+
+    void resetPose(Pose &pose) const;
+    void computeBonePalette(Pose &pose, AffineTransform *palette) const;
+};
+
+
+#endif //GAME_ENGINE_SKELETON_HPP
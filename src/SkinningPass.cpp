@@ -0,0 +1,327 @@
+//
+// Created by cleme on 2020-02-22.
+//
+
+#include "Application.hpp"
+#include "SkinningPass.hpp"
+#include "ModelAsset.hpp"
+#include "../include/helper/FileHelper.hpp"
+
+const uint32_t SKINNING_GROUP_SIZE = 64;
+
+SkinningPass::SkinningPass(){
+
+}
+
+SkinningPass::SkinningPass(Application *application, VkDevice &device){
+    this->application = application;
+    this->device = device;
+}
+
+/**
+ * Create the layouts of the batches and the skinned vertex buffer, the pipeline must be created first
+ * @param batches the instance batches, in the order of the instance data
+ * @param sourceVertexBuffer the vertex buffer of the assets, read as a storage buffer
+ */
+void SkinningPass::init(const std::vector<Model*> &models, const std::vector<InstanceBatch> &batches, VkBuffer sourceVertexBuffer){
+    this->instanceCount = static_cast<uint32_t>(models.size());
+
+    this->createBuffers(models, batches);
+    this->createDescriptorSets(sourceVertexBuffer);
+}
+
+void SkinningPass::createDescriptorSetLayout(){
+    //Source vertices, bone palettes, skinned vertices, instances, batches and the instances listed by the culling
+    std::array<VkDescriptorSetLayoutBinding, 6> bindings = {};
+    for(uint32_t i = 0 ; i < bindings.size() ; i++){
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if(vkCreateDescriptorSetLayout(this->device, &layoutInfo, nullptr, &this->descriptorSetLayout) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create skinning descriptor set layout.");
+    }
+}
+
+/**
+ * Create the descriptor set layout and the compute pipeline, they are kept when the buffers are created again.
+ * Can run on any thread, along with the creation of the other pipelines.
+ */
+void SkinningPass::createPipeline(){
+    this->createDescriptorSetLayout();
+
+    auto computeShaderCode = readFile("./shaders/build/skinning.spv");
+    VkShaderModule computeShaderModule = createShaderModule(&this->device, computeShaderCode);
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(SkinningParameters);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &this->descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if(vkCreatePipelineLayout(this->device, &pipelineLayoutInfo, nullptr, &this->pipelineLayout) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create skinning pipeline layout.");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = computeShaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = this->pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    if(vkCreateComputePipelines(this->device, this->application->getPipelineCache(), 1, &pipelineInfo, nullptr, &this->pipeline) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create skinning pipeline.");
+    }
+
+    vkDestroyShaderModule(this->device, computeShaderModule, nullptr);
+}
+
+/**
+ * Position of the attributes read by the skinning shader in a vertex of the given format
+ */
+static void setVertexLayout(SkinningBatch &batch, VertexFormat format){
+    batch.vertexFormat = static_cast<uint32_t>(format);
+    if(format == VertexFormat::Packed){
+        batch.vertexStride = sizeof(PackedVertex) / sizeof(uint32_t);
+        batch.positionOffset = offsetof(PackedVertex, pos) / sizeof(uint32_t);
+        batch.normalOffset = offsetof(PackedVertex, normal) / sizeof(uint32_t);
+        batch.boneIdsOffset = offsetof(PackedVertex, boneIds) / sizeof(uint32_t);
+        batch.boneWeightsOffset = offsetof(PackedVertex, boneWeights) / sizeof(uint32_t);
+    }else{
+        batch.vertexStride = sizeof(Vertex) / sizeof(uint32_t);
+        batch.positionOffset = offsetof(Vertex, pos) / sizeof(uint32_t);
+        batch.normalOffset = offsetof(Vertex, normal) / sizeof(uint32_t);
+        batch.boneIdsOffset = offsetof(Vertex, boneIds) / sizeof(uint32_t);
+        batch.boneWeightsOffset = offsetof(Vertex, boneWeights) / sizeof(uint32_t);
+    }
+}
+
+/**
+ * Every model gets its own range of skinned vertices, even when it shares its asset with other models.
+ * The ranges of the frames in flight follow each other, a frame writes its range while the GPU may
+ * still draw the previous frame from the other one.
+ */
+void SkinningPass::createBuffers(const std::vector<Model*> &models, const std::vector<InstanceBatch> &batches){
+    VkPhysicalDeviceProperties physicalDeviceProperties;
+    vkGetPhysicalDeviceProperties(this->application->getPhysicalDevice(), &physicalDeviceProperties);
+    if(this->instanceCount > physicalDeviceProperties.limits.maxComputeWorkGroupCount[1]){
+        throw std::runtime_error("The instances of the scene do not fit in a skinning dispatch.");
+    }
+
+    std::vector<SkinningBatch> skinningBatches(batches.size());
+    uint32_t maxVertexCount = 0;
+    for(size_t i = 0 ; i < batches.size() ; i++){
+        ModelAsset *asset = batches[i].asset;
+        setVertexLayout(skinningBatches[i], asset->getVertexFormat());
+        skinningBatches[i].firstSourceWord = static_cast<uint32_t>(asset->getVertexOffset() / sizeof(uint32_t));
+        skinningBatches[i].vertexCount = asset->getVertexCount();
+        maxVertexCount = std::max(maxVertexCount, asset->getVertexCount());
+    }
+    this->groupCount = (maxVertexCount + SKINNING_GROUP_SIZE - 1) / SKINNING_GROUP_SIZE;
+
+    this->application->createBuffer(sizeof(SkinningBatch) * std::max<size_t>(skinningBatches.size(), 1),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            this->batchBuffer,
+            this->batchBufferMemory);
+    if(!skinningBatches.empty()){
+        this->application->getUploadManager().uploadBuffer(this->batchBuffer, 0, skinningBatches.data(), sizeof(SkinningBatch) * skinningBatches.size());
+    }
+
+    this->frameVertexCount = 0;
+    this->skinnedVertexOffsets.resize(models.size());
+    for(size_t i = 0 ; i < models.size() ; i++){
+        this->skinnedVertexOffsets[i] = this->frameVertexCount;
+        this->frameVertexCount += models[i]->getAsset()->getVertexCount();
+    }
+
+    //The instances of both culling phases
+    uint32_t nbFrameBuffers = this->application->getSwapChainImagesCount();
+    this->instanceListBuffers.resize(nbFrameBuffers);
+    this->instanceListBufferMemory.resize(nbFrameBuffers);
+    this->dispatchBuffers.resize(nbFrameBuffers);
+    this->dispatchBufferMemory.resize(nbFrameBuffers);
+    for(uint32_t i = 0 ; i < nbFrameBuffers ; i++){
+        this->application->createBuffer(sizeof(uint32_t) * std::max<uint32_t>(this->instanceCount, 1) * 2,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                this->instanceListBuffers[i],
+                this->instanceListBufferMemory[i]);
+
+        this->application->createBuffer(sizeof(VkDispatchIndirectCommand) * 2,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                this->dispatchBuffers[i],
+                this->dispatchBufferMemory[i]);
+    }
+
+    VkDeviceSize bufferSize = sizeof(SkinnedVertex) * std::max<VkDeviceSize>(this->frameVertexCount, 1) * MAX_FRAMES_IN_FLIGHT;
+    if(bufferSize > physicalDeviceProperties.limits.maxStorageBufferRange){
+        throw std::runtime_error("The skinned vertices of the scene do not fit in a storage buffer.");
+    }
+    this->application->createBuffer(bufferSize,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            this->skinnedVertexBuffer,
+            this->skinnedVertexBufferMemory);
+}
+
+void SkinningPass::createDescriptorSets(VkBuffer sourceVertexBuffer){
+    uint32_t nbFrameBuffers = this->application->getSwapChainImagesCount();
+
+    VkDescriptorPoolSize poolSize = {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = nbFrameBuffers * 6;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = nbFrameBuffers;
+    poolInfo.flags = 0;
+
+    if(vkCreateDescriptorPool(this->device, &poolInfo, nullptr, &this->descriptorPool) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create skinning descriptor pool.");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(nbFrameBuffers, this->descriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = this->descriptorPool;
+    allocInfo.descriptorSetCount = nbFrameBuffers;
+    allocInfo.pSetLayouts = layouts.data();
+
+    this->descriptorSets.resize(nbFrameBuffers);
+    if(vkAllocateDescriptorSets(this->device, &allocInfo, this->descriptorSets.data()) != VK_SUCCESS){
+        throw std::runtime_error("Failed to allocate skinning descriptor sets.");
+    }
+
+    for(uint32_t frameBufferIndex = 0 ; frameBufferIndex < nbFrameBuffers ; frameBufferIndex++){
+        std::array<VkDescriptorBufferInfo, 6> bufferInfos = {};
+        bufferInfos[0].buffer = sourceVertexBuffer;
+        bufferInfos[2].buffer = this->skinnedVertexBuffer;
+        bufferInfos[4].buffer = this->batchBuffer;
+        bufferInfos[5].buffer = this->instanceListBuffers[frameBufferIndex];
+        for(VkDescriptorBufferInfo &bufferInfo : bufferInfos){
+            bufferInfo.offset = 0;
+            bufferInfo.range = VK_WHOLE_SIZE;
+        }
+        //The bone palettes and the instances are slices of the frame ring buffer
+        bufferInfos[1] = this->application->getBonePaletteBufferInfo(frameBufferIndex);
+        bufferInfos[3] = this->application->getInstanceBufferInfo(frameBufferIndex);
+
+        std::array<VkWriteDescriptorSet, 6> descriptorWrites = {};
+        for(uint32_t i = 0 ; i < descriptorWrites.size() ; i++){
+            descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[i].dstSet = this->descriptorSets[frameBufferIndex];
+            descriptorWrites[i].dstBinding = i;
+            descriptorWrites[i].dstArrayElement = 0;
+            descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[i].descriptorCount = 1;
+            descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+        }
+
+        vkUpdateDescriptorSets(this->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+}
+
+/**
+ * Record the reset of the indirect dispatches to no instance, before the first culling phase.
+ * The barrier of the culling reset makes it visible to the culling shader.
+ */
+void SkinningPass::recordReset(VkCommandBuffer commandBuffer, uint32_t imageIndex){
+    std::array<VkDispatchIndirectCommand, 2> dispatches = {};
+    for(VkDispatchIndirectCommand &dispatch : dispatches){
+        dispatch.x = this->groupCount;
+        dispatch.y = 0;
+        dispatch.z = 1;
+    }
+    vkCmdUpdateBuffer(commandBuffer, this->dispatchBuffers[imageIndex], 0, sizeof(VkDispatchIndirectCommand) * dispatches.size(), dispatches.data());
+}
+
+/**
+ * Record the skinning of the instances listed by a culling phase, followed by the barrier that
+ * makes the skinned vertices visible to the vertex shader of the graphics pipeline.
+ * Must be recorded outside of a render pass, after the culling phase.
+ */
+void SkinningPass::recordDispatch(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t phase){
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 0, 1, &this->descriptorSets[imageIndex], 0, nullptr);
+
+    SkinningParameters parameters = {};
+    parameters.instanceCount = this->instanceCount;
+    parameters.phase = phase;
+    vkCmdPushConstants(commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinningParameters), &parameters);
+    vkCmdDispatchIndirect(commandBuffer, this->dispatchBuffers[imageIndex], sizeof(VkDispatchIndirectCommand) * phase);
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = this->skinnedVertexBuffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+                         0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+VkBuffer SkinningPass::getInstanceListBuffer(uint32_t imageIndex){
+    return this->instanceListBuffers[imageIndex];
+}
+
+VkBuffer SkinningPass::getDispatchBuffer(uint32_t imageIndex){
+    return this->dispatchBuffers[imageIndex];
+}
+
+VkBuffer SkinningPass::getSkinnedVertexBuffer(){
+    return this->skinnedVertexBuffer;
+}
+
+/**
+ * First skinned vertex of the model in the range of the given frame in flight
+ */
+uint32_t SkinningPass::getSkinnedVertexOffset(uint32_t modelIndex, uint32_t frame){
+    return this->frameVertexCount * frame + this->skinnedVertexOffsets[modelIndex];
+}
+
+void SkinningPass::cleanup(){
+    for(size_t i = 0 ; i < this->instanceListBuffers.size() ; i++){
+        this->application->destroyBuffer(this->instanceListBuffers[i], this->instanceListBufferMemory[i]);
+        this->application->destroyBuffer(this->dispatchBuffers[i], this->dispatchBufferMemory[i]);
+    }
+    this->instanceListBuffers.clear();
+    this->instanceListBufferMemory.clear();
+    this->dispatchBuffers.clear();
+    this->dispatchBufferMemory.clear();
+    this->application->destroyBuffer(this->skinnedVertexBuffer, this->skinnedVertexBufferMemory);
+    this->application->destroyBuffer(this->batchBuffer, this->batchBufferMemory);
+
+    vkDestroyDescriptorPool(this->device, this->descriptorPool, nullptr);
+}
+
+void SkinningPass::cleanupPipeline(){
+    vkDestroyPipeline(this->device, this->pipeline, nullptr);
+    vkDestroyPipelineLayout(this->device, this->pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(this->device, this->descriptorSetLayout, nullptr);
+}
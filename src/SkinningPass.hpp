@@ -0,0 +1,101 @@
+//
+// Created by cleme on 2020-02-22.
+//
+
+#ifndef GAME_ENGINE_SKINNINGPASS_HPP
+#define GAME_ENGINE_SKINNINGPASS_HPP
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+#include "MemoryAllocator.hpp"
+
+class Application;
+class Model;
+struct InstanceBatch;
+
+/**
+ * Layout of the vertices of the asset of an instance batch, read by the skinning shader.
+ * The offsets inside a source vertex are in 32 bit words.
+ */
+struct SkinningBatch {
+    uint32_t firstSourceWord;
+    uint32_t vertexCount;
+    uint32_t vertexStride;
+    uint32_t positionOffset;
+    uint32_t normalOffset;
+    uint32_t boneIdsOffset;
+    uint32_t boneWeightsOffset;
+    uint32_t vertexFormat;
+};
+
+/**
+ * Parameters of the skinning dispatch, sent as push constants
+ */
+struct SkinningParameters {
+    uint32_t instanceCount;
+    uint32_t phase;
+};
+
+/**
+ * Compute pre-pass that skins the vertices of the visible instances once per frame.
+ * The culling pass lists the instances drawn by each of its phases and counts them in an indirect
+ * dispatch, the instances it rejects are never skinned. Each phase is skinned with one dispatch:
+ * the workgroups along y are the listed instances, their first bone and first skinned vertex are
+ * read from the instance data and the layout of their vertices from their batch.
+ * The skinned positions and normals are written to a device local buffer with one range per frame
+ * in flight, the graphics pipeline reads them as static geometry.
+ */
+class SkinningPass {
+private:
+    Application *application = nullptr;
+    VkDevice device = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> descriptorSets;
+
+    VkBuffer batchBuffer = VK_NULL_HANDLE;
+    MemoryAllocation batchBufferMemory;
+    //Instances listed by the culling pass and the indirect dispatch of each phase, for every swap chain image
+    std::vector<VkBuffer> instanceListBuffers;
+    std::vector<MemoryAllocation> instanceListBufferMemory;
+    std::vector<VkBuffer> dispatchBuffers;
+    std::vector<MemoryAllocation> dispatchBufferMemory;
+    VkBuffer skinnedVertexBuffer = VK_NULL_HANDLE;
+    MemoryAllocation skinnedVertexBufferMemory;
+    //First skinned vertex of every model in the range of a frame
+    std::vector<uint32_t> skinnedVertexOffsets;
+    uint32_t frameVertexCount = 0;
+
+    uint32_t instanceCount = 0;
+    //Workgroups along x, enough for the vertices of the largest asset
+    uint32_t groupCount = 0;
+
+    void createDescriptorSetLayout();
+    void createBuffers(const std::vector<Model*> &models, const std::vector<InstanceBatch> &batches);
+    void createDescriptorSets(VkBuffer sourceVertexBuffer);
+
+public:
+    SkinningPass();
+    SkinningPass(Application *application, VkDevice &device);
+
+    void createPipeline();
+    void init(const std::vector<Model*> &models, const std::vector<InstanceBatch> &batches, VkBuffer sourceVertexBuffer);
+    void recordReset(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    void recordDispatch(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t phase);
+
+    VkBuffer getInstanceListBuffer(uint32_t imageIndex);
+    VkBuffer getDispatchBuffer(uint32_t imageIndex);
+    VkBuffer getSkinnedVertexBuffer();
+    uint32_t getSkinnedVertexOffset(uint32_t modelIndex, uint32_t frame);
+
+    void cleanup();
+    void cleanupPipeline();
+};
+
+
+#endif //GAME_ENGINE_SKINNINGPASS_HPP
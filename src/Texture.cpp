@@ -11,43 +11,53 @@ Texture::Texture(Application *application, VkDevice &device){
     this->application = application;
     this->device = device;
 
-    this->createTextureImage("../textures/default.png");
+    this->createTextureImage(decodeImage(DEFAULT_TEXTURE_PATH));
 }
 
 Texture::Texture(Application *application, VkDevice &device, std::string texturePath){
     this->application = application;
     this->device = device;
-    this->createTextureImage(texturePath);
+    this->createTextureImage(decodeImage(texturePath));
 }
 
-void Texture::createTextureImage(std::string texturePath){
-    int texWidth, texHeight, texChannels;
-    stbi_uc* pixels = stbi_load(texturePath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+Texture::Texture(Application *application, VkDevice &device, const DecodedImage &image){
+    this->application = application;
+    this->device = device;
+    this->createTextureImage(image);
+}
 
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
+/**
+ * Decode an image file to RGBA pixels, only uses the CPU
+ */
+DecodedImage Texture::decodeImage(const std::string &texturePath){
+    int texChannels;
+    DecodedImage image;
+    stbi_uc* pixels = stbi_load(texturePath.c_str(), &image.width, &image.height, &texChannels, STBI_rgb_alpha);
 
     if(!pixels){
-        throw std::runtime_error("Failed to load texture image.");
+        throw std::runtime_error("Failed to load texture image " + texturePath);
     }
-    this->mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+    image.pixels = std::shared_ptr<unsigned char>(pixels, stbi_image_free);
 
+    return image;
+}
 
-    VkBuffer staginBuffer;
-    VkDeviceMemory stagingBufferMemory;
+/**
+ * Record the upload of a decoded image and the generation of its mipmaps in the current upload batch,
+ * must be called from the main thread
+ */
+void Texture::createTextureImage(const DecodedImage &image){
+    int texWidth = image.width;
+    int texHeight = image.height;
+    VkDeviceSize imageSize = static_cast<VkDeviceSize>(texWidth) * texHeight * 4;
 
-    this->application->createBuffer(imageSize,
-                       VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                       staginBuffer,
-                       stagingBufferMemory);
+    this->mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
 
-    //Write data of image into the buffer
-    void *data;
-    vkMapMemory(this->device, stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, static_cast<size_t>(imageSize));
-    vkUnmapMemory(this->device, stagingBufferMemory);
 
-    stbi_image_free(pixels);
+    //Write data of image into the staging ring, it is given back once the upload batch is done
+    UploadManager &uploadManager = this->application->getUploadManager();
+    StagingRange staging = uploadManager.stage(imageSize);
+    memcpy(staging.data, image.pixels.get(), static_cast<size_t>(imageSize));
 
     this->application->createImage(texWidth,
                       texHeight,
@@ -60,24 +70,34 @@ void Texture::createTextureImage(std::string texturePath){
                       this->textureImage,
                       this->textureImageMemory);
 
+    //Copied on the transfer queue
+    VkCommandBuffer transferCommandBuffer = uploadManager.getTransferCommandBuffer();
     this->application->transitionImageLayout(
+            transferCommandBuffer,
             this->textureImage,
             VK_FORMAT_R8G8B8A8_UNORM,
             VK_IMAGE_LAYOUT_UNDEFINED,
             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
             this->mipLevels);
 
-    this->application->copyBufferToImage(staginBuffer, this->textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-    this->generateMipmaps(this->textureImage, VK_FORMAT_R8G8B8A8_UNORM, texWidth, texHeight, this->mipLevels);
+    this->application->copyBufferToImage(transferCommandBuffer, staging.buffer, staging.offset, this->textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
 
-    vkDestroyBuffer(this->device, staginBuffer, nullptr);
-    vkFreeMemory(this->device, stagingBufferMemory, nullptr);
+    //The blits need the graphics queue
+    VkImageSubresourceRange subresourceRange = {};
+    subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresourceRange.baseMipLevel = 0;
+    subresourceRange.levelCount = this->mipLevels;
+    subresourceRange.baseArrayLayer = 0;
+    subresourceRange.layerCount = 1;
+    uploadManager.releaseImage(this->textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange,
+                               VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+    this->generateMipmaps(uploadManager.getGraphicsCommandBuffer(), this->textureImage, VK_FORMAT_R8G8B8A8_UNORM, texWidth, texHeight, this->mipLevels);
 
     this->createTextureImageView();
     this->createTextureSampler();
 }
 
-void Texture::generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels){
+void Texture::generateMipmaps(VkCommandBuffer commandBuffer, VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels){
     //Check if the device supports linear blitting
     VkFormatProperties formatProperties;
     vkGetPhysicalDeviceFormatProperties(this->application->getPhysicalDevice(), imageFormat, &formatProperties);
@@ -86,7 +106,6 @@ void Texture::generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWi
         throw std::runtime_error("Texture image format foes not support linear blitting.");
     }
 
-    VkCommandBuffer commandBuffer = this->application->beginSingleTimeCommands(this->application->getCommandPool());
 
     VkImageMemoryBarrier barrier = {};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -165,8 +184,6 @@ void Texture::generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWi
                          0, nullptr,
                          0, nullptr,
                          1, &barrier);
-
-    this->application->endSingleTimeCommands(this->application->getGraphicsQueue(), this->application->getCommandPool(), commandBuffer);
 }
 
 void Texture::createTextureImageView(){
@@ -207,6 +224,5 @@ void Texture::createTextureSampler(){
 void Texture::cleanup(){
     vkDestroySampler(this->device, this->textureSampler, nullptr);
     vkDestroyImageView(this->device, this->textureImageView, nullptr);
-    vkDestroyImage(this->device, this->textureImage, nullptr);
-    vkFreeMemory(this->device, this->textureImageMemory, nullptr);
+    this->application->destroyImage(this->textureImage, this->textureImageMemory);
 }
\ No newline at end of file
@@ -7,12 +7,25 @@
 
 
 #include <cstdint>
+#include <memory>
 #include <vulkan/vulkan.h>
 #include <string>
 #include "Application.hpp"
 
 class Application;
 
+const std::string DEFAULT_TEXTURE_PATH = "../textures/default.png";
+
+/**
+ * RGBA pixels of an image file, decoded on the CPU and waiting to be uploaded.
+ * Decoding does not touch Vulkan, images can be decoded on any thread.
+ */
+struct DecodedImage {
+    int width = 0;
+    int height = 0;
+    std::shared_ptr<unsigned char> pixels;
+};
+
 class Texture {
 private:
     Application *application;
@@ -20,18 +33,21 @@ private:
     uint32_t mipLevels;
     VkImage textureImage;
     VkImageView textureImageView;
-    VkDeviceMemory textureImageMemory;
+    MemoryAllocation textureImageMemory;
     VkSampler textureSampler;
 
     void createTextureImageView();
     void createTextureSampler();
 
-    void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
+    void generateMipmaps(VkCommandBuffer commandBuffer, VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
 
 public:
     Texture(Application *application, VkDevice &device);
     Texture(Application *application, VkDevice &device, std::string texturePath);
-    void createTextureImage(std::string texturePath);
+    Texture(Application *application, VkDevice &device, const DecodedImage &image);
+    void createTextureImage(const DecodedImage &image);
+
+    static DecodedImage decodeImage(const std::string &texturePath);
 
     VkImageView getImageView();
     VkSampler getTextureSampler();
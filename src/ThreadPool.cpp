@@ -0,0 +1,104 @@
+//
+// Created by cleme on 2020-02-16.
+//
+
+#include <algorithm>
+#include "ThreadPool.hpp"
+
+/**
+ * @param threadCount total number of threads working on a loop, including
+ * the calling thread. 0 uses one thread per hardware core.
+ */
+ThreadPool::ThreadPool(uint32_t threadCount){
+    if(threadCount == 0){
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    this->nextIndex = 0;
+    for(uint32_t i = 1 ; i < threadCount ; i++){
+        this->workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->wakeCondition.notify_all();
+
+    for(std::thread &worker : this->workers){
+        worker.join();
+    }
+}
+
+uint32_t ThreadPool::getThreadCount() const {
+    return static_cast<uint32_t>(this->workers.size()) + 1;
+}
+
+void ThreadPool::run(uint32_t count, Job job, void *context){
+    if(count == 0){
+        return;
+    }
+
+    if(this->workers.empty() || count == 1){
+        job(context, 0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->job = job;
+        this->context = context;
+        this->count = count;
+        //A few batches per thread so that uneven iterations still balance
+        this->batchSize = std::max(1u, count / (this->getThreadCount() * 4));
+        this->nextIndex = 0;
+        this->pendingWorkers = static_cast<uint32_t>(this->workers.size());
+        this->generation++;
+    }
+    this->wakeCondition.notify_all();
+
+    this->executeBatches();
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->doneCondition.wait(lock, [this]{ return this->pendingWorkers == 0; });
+    this->job = nullptr;
+}
+
+void ThreadPool::executeBatches(){
+    while(true){
+        uint32_t begin = this->nextIndex.fetch_add(this->batchSize);
+        if(begin >= this->count){
+            return;
+        }
+
+        this->job(this->context, begin, std::min(begin + this->batchSize, this->count));
+    }
+}
+
+void ThreadPool::workerLoop(){
+    uint64_t lastGeneration = 0;
+
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->wakeCondition.wait(lock, [this, lastGeneration]{
+                return this->stopping || this->generation != lastGeneration;
+            });
+
+            if(this->stopping){
+                return;
+            }
+            lastGeneration = this->generation;
+        }
+
+        this->executeBatches();
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->pendingWorkers--;
+        }
+        this->doneCondition.notify_one();
+    }
+}
@@ -0,0 +1,65 @@
+//
+// Created by cleme on 2020-02-16.
+//
+
+#ifndef GAME_ENGINE_THREADPOOL_HPP
+#define GAME_ENGINE_THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Fixed set of worker threads that split loops between them.
+ * The thread calling parallelFor works on the loop too and returns once
+ * every iteration is done. Running a loop does not allocate.
+ */
+class ThreadPool {
+private:
+    using Job = void (*)(void *context, uint32_t begin, uint32_t end);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+
+    Job job = nullptr;
+    void *context = nullptr;
+    uint32_t count = 0;
+    uint32_t batchSize = 1;
+    std::atomic<uint32_t> nextIndex;
+    uint32_t pendingWorkers = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    void run(uint32_t count, Job job, void *context);
+    void executeBatches();
+    void workerLoop();
+
+public:
+    explicit ThreadPool(uint32_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    uint32_t getThreadCount() const;
+
+    /**
+     * Call function(begin, end) on ranges covering [0, count) from every thread of the pool
+     */
+    template<typename Function>
+    void parallelFor(uint32_t count, Function &&function){
+        using FunctionType = std::remove_reference_t<Function>;
+        this->run(count, [](void *context, uint32_t begin, uint32_t end){
+            (*static_cast<FunctionType*>(context))(begin, end);
+        }, const_cast<void*>(static_cast<const void*>(&function)));
+    }
+};
+
+
+#endif //GAME_ENGINE_THREADPOOL_HPP
@@ -0,0 +1,409 @@
+//
+// Created by cleme on 2020-03-01.
+//
+
+#include "Application.hpp"
+#include "UploadManager.hpp"
+
+UploadManager::UploadManager(){
+
+}
+
+UploadManager::UploadManager(Application *application, VkDevice &device){
+    this->application = application;
+    this->device = device;
+}
+
+/**
+ * Create the staging ring and the command pools of the batches
+ * @param graphicsQueue queue acquiring the uploaded resources, the frames using them must be submitted to it too
+ * @param stagingAlignment alignment of the staging ranges, must cover the copy offset alignment of the images
+ */
+void UploadManager::init(VkQueue transferQueue, uint32_t transferFamily, VkQueue graphicsQueue, uint32_t graphicsFamily,
+                         VkDeviceSize stagingSize, VkDeviceSize stagingAlignment){
+    this->transferQueue = transferQueue;
+    this->transferFamily = transferFamily;
+    this->graphicsQueue = graphicsQueue;
+    this->graphicsFamily = graphicsFamily;
+    this->stagingSize = stagingSize;
+    this->stagingAlignment = stagingAlignment;
+
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = transferFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    if(vkCreateCommandPool(this->device, &poolInfo, nullptr, &this->transferCommandPool) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create upload transfer command pool.");
+    }
+
+    poolInfo.queueFamilyIndex = graphicsFamily;
+    if(vkCreateCommandPool(this->device, &poolInfo, nullptr, &this->graphicsCommandPool) != VK_SUCCESS){
+        throw std::runtime_error("Failed to create upload graphics command pool.");
+    }
+
+    this->application->createBuffer(this->stagingSize,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            this->stagingBuffer,
+            this->stagingBufferMemory);
+}
+
+/**
+ * Take a range after the head of the ring, or at its start when the end of the ring is too short
+ * @return false if the ranges still read by the GPU leave no room
+ */
+bool UploadManager::allocateStaging(VkDeviceSize size, VkDeviceSize &offset){
+    if(this->pendingBatches.empty() && !this->recording){
+        this->stagingHead = 0;
+        this->stagingTail = 0;
+        this->stagingWrapped = false;
+    }
+
+    VkDeviceSize alignedHead = (this->stagingHead + this->stagingAlignment - 1) / this->stagingAlignment * this->stagingAlignment;
+    if(!this->stagingWrapped){
+        if(alignedHead + size <= this->stagingSize){
+            offset = alignedHead;
+            this->stagingHead = alignedHead + size;
+            return true;
+        }
+        if(size <= this->stagingTail){
+            offset = 0;
+            this->stagingHead = size;
+            this->stagingWrapped = true;
+            return true;
+        }
+        return false;
+    }
+
+    if(alignedHead + size <= this->stagingTail){
+        offset = alignedHead;
+        this->stagingHead = alignedHead + size;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Wait for the oldest submitted batch and give back its staging ranges and its command buffer
+ */
+void UploadManager::retireOldestBatch(){
+    UploadBatch batch = this->pendingBatches.front();
+    this->pendingBatches.pop_front();
+    vkWaitForFences(this->device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+
+    //The tail only goes back when it passes the end of the ring
+    if(batch.stagingEnd < this->stagingTail){
+        this->stagingWrapped = false;
+    }
+    this->stagingTail = batch.stagingEnd;
+
+    for(size_t i = 0 ; i < batch.temporaryBuffers.size() ; i++){
+        this->application->destroyBuffer(batch.temporaryBuffers[i], batch.temporaryBufferMemory[i]);
+    }
+    batch.temporaryBuffers.clear();
+    batch.temporaryBufferMemory.clear();
+
+    vkResetFences(this->device, 1, &batch.fence);
+    vkResetCommandBuffer(batch.transferCommandBuffer, 0);
+    vkResetCommandBuffer(batch.graphicsCommandBuffer, 0);
+    this->freeBatches.push_back(batch);
+}
+
+/**
+ * Reserve a mapped staging range of the current batch, the data must be written before the batch is flushed.
+ * Must be called before getTransferCommandBuffer when recording the copy from it: staging may flush the current batch.
+ */
+StagingRange UploadManager::stage(VkDeviceSize size){
+    StagingRange range = {};
+
+    if(size > this->stagingSize){
+        VkBuffer buffer;
+        MemoryAllocation bufferMemory;
+        this->application->createStagingBuffer(size, buffer, bufferMemory);
+        this->beginBatch();
+        this->currentBatch.temporaryBuffers.push_back(buffer);
+        this->currentBatch.temporaryBufferMemory.push_back(bufferMemory);
+
+        range.data = bufferMemory.mappedData;
+        range.buffer = buffer;
+        range.offset = 0;
+        return range;
+    }
+
+    VkDeviceSize offset = 0;
+    while(!this->allocateStaging(size, offset)){
+        //The ranges of the current batch can only be given back once it is submitted
+        if(this->recording){
+            this->flush();
+        }
+        if(this->pendingBatches.empty()){
+            throw std::runtime_error("The upload staging ring is too small.");
+        }
+        this->retireOldestBatch();
+    }
+    this->beginBatch();
+
+    range.data = static_cast<char*>(this->stagingBufferMemory.mappedData) + offset;
+    range.buffer = this->stagingBuffer;
+    range.offset = offset;
+    return range;
+}
+
+/**
+ * Begin the command buffers of a new batch if none is being recorded
+ */
+void UploadManager::beginBatch(){
+    if(this->recording){
+        return;
+    }
+
+    if(this->freeBatches.empty()){
+        UploadBatch batch = {};
+
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = this->transferCommandPool;
+        allocInfo.commandBufferCount = 1;
+        if(vkAllocateCommandBuffers(this->device, &allocInfo, &batch.transferCommandBuffer) != VK_SUCCESS){
+            throw std::runtime_error("Failed to allocate upload command buffer.");
+        }
+        allocInfo.commandPool = this->graphicsCommandPool;
+        if(vkAllocateCommandBuffers(this->device, &allocInfo, &batch.graphicsCommandBuffer) != VK_SUCCESS){
+            throw std::runtime_error("Failed to allocate upload command buffer.");
+        }
+
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        if(vkCreateSemaphore(this->device, &semaphoreInfo, nullptr, &batch.transferFinishedSemaphore) != VK_SUCCESS){
+            throw std::runtime_error("Failed to create upload semaphore.");
+        }
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if(vkCreateFence(this->device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS){
+            throw std::runtime_error("Failed to create upload fence.");
+        }
+
+        this->freeBatches.push_back(batch);
+    }
+
+    this->currentBatch = this->freeBatches.back();
+    this->freeBatches.pop_back();
+    this->currentBatch.id = this->nextBatchId++;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(this->currentBatch.transferCommandBuffer, &beginInfo);
+    vkBeginCommandBuffer(this->currentBatch.graphicsCommandBuffer, &beginInfo);
+
+    this->recording = true;
+}
+
+/**
+ * Command buffer of the current batch run on the transfer queue, for the copies
+ */
+VkCommandBuffer UploadManager::getTransferCommandBuffer(){
+    this->beginBatch();
+    return this->currentBatch.transferCommandBuffer;
+}
+
+/**
+ * Command buffer of the current batch run on the graphics queue once the copies are done,
+ * the resources can only be used in it after their release
+ */
+VkCommandBuffer UploadManager::getGraphicsCommandBuffer(){
+    this->beginBatch();
+    return this->currentBatch.graphicsCommandBuffer;
+}
+
+/**
+ * Give a buffer written by the transfer command buffer to the graphics queue.
+ * A resource can be released once per batch, after all its copies.
+ * @param dstStageMask stages of the graphics queue waiting for the buffer
+ */
+void UploadManager::releaseBuffer(VkBuffer buffer, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask){
+    this->beginBatch();
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    //The semaphore makes the copies visible when the queues are of the same family
+    if(this->transferFamily == this->graphicsFamily){
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccessMask;
+        vkCmdPipelineBarrier(this->currentBatch.graphicsCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStageMask, 0,
+                             0, nullptr, 1, &barrier, 0, nullptr);
+        return;
+    }
+
+    barrier.srcQueueFamilyIndex = this->transferFamily;
+    barrier.dstQueueFamilyIndex = this->graphicsFamily;
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(this->currentBatch.transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                         0, nullptr, 1, &barrier, 0, nullptr);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dstAccessMask;
+    vkCmdPipelineBarrier(this->currentBatch.graphicsCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStageMask, 0,
+                         0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+/**
+ * Give an image written by the transfer command buffer to the graphics queue, the layout
+ * transition is done once by the release and the acquire
+ */
+void UploadManager::releaseImage(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, const VkImageSubresourceRange &subresourceRange,
+                                 VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask){
+    this->beginBatch();
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = image;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.subresourceRange = subresourceRange;
+
+    if(this->transferFamily == this->graphicsFamily){
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccessMask;
+        vkCmdPipelineBarrier(this->currentBatch.graphicsCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStageMask, 0,
+                             0, nullptr, 0, nullptr, 1, &barrier);
+        return;
+    }
+
+    barrier.srcQueueFamilyIndex = this->transferFamily;
+    barrier.dstQueueFamilyIndex = this->graphicsFamily;
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(this->currentBatch.transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dstAccessMask;
+    vkCmdPipelineBarrier(this->currentBatch.graphicsCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStageMask, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+/**
+ * Record the copy of data to a buffer and its release to the graphics queue
+ */
+void UploadManager::uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size){
+    StagingRange range = this->stage(size);
+    memcpy(range.data, data, static_cast<size_t>(size));
+
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = range.offset;
+    copyRegion.dstOffset = offset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(this->getTransferCommandBuffer(), range.buffer, buffer, 1, &copyRegion);
+
+    this->releaseBuffer(buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT);
+}
+
+/**
+ * Submit the current batch, the commands submitted to the graphics queue after it see the uploaded data.
+ * The graphics part waits for the transfer part on the GPU with a semaphore.
+ * @return the id of the last batch, to check its completion
+ */
+uint64_t UploadManager::flush(){
+    if(!this->recording){
+        return this->nextBatchId - 1;
+    }
+
+    //The transfers of the graphics command buffer, like the mipmap blits
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(this->currentBatch.graphicsCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+
+    if(vkEndCommandBuffer(this->currentBatch.transferCommandBuffer) != VK_SUCCESS
+       || vkEndCommandBuffer(this->currentBatch.graphicsCommandBuffer) != VK_SUCCESS){
+        throw std::runtime_error("Failed to record upload command buffer.");
+    }
+    this->currentBatch.stagingEnd = this->stagingHead;
+
+    VkSubmitInfo transferSubmitInfo = {};
+    transferSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    transferSubmitInfo.commandBufferCount = 1;
+    transferSubmitInfo.pCommandBuffers = &this->currentBatch.transferCommandBuffer;
+    transferSubmitInfo.signalSemaphoreCount = 1;
+    transferSubmitInfo.pSignalSemaphores = &this->currentBatch.transferFinishedSemaphore;
+
+    if(vkQueueSubmit(this->transferQueue, 1, &transferSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS){
+        throw std::runtime_error("Failed to submit upload command buffer.");
+    }
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo graphicsSubmitInfo = {};
+    graphicsSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    graphicsSubmitInfo.waitSemaphoreCount = 1;
+    graphicsSubmitInfo.pWaitSemaphores = &this->currentBatch.transferFinishedSemaphore;
+    graphicsSubmitInfo.pWaitDstStageMask = &waitStage;
+    graphicsSubmitInfo.commandBufferCount = 1;
+    graphicsSubmitInfo.pCommandBuffers = &this->currentBatch.graphicsCommandBuffer;
+
+    //The fence of the graphics part is signaled once both parts are done
+    if(vkQueueSubmit(this->graphicsQueue, 1, &graphicsSubmitInfo, this->currentBatch.fence) != VK_SUCCESS){
+        throw std::runtime_error("Failed to submit upload command buffer.");
+    }
+
+    uint64_t batchId = this->currentBatch.id;
+    this->pendingBatches.push_back(this->currentBatch);
+    this->currentBatch = UploadBatch();
+    this->recording = false;
+    return batchId;
+}
+
+/**
+ * Retire the batches done by the GPU, without waiting
+ */
+void UploadManager::poll(){
+    while(!this->pendingBatches.empty() && vkGetFenceStatus(this->device, this->pendingBatches.front().fence) == VK_SUCCESS){
+        this->retireOldestBatch();
+    }
+}
+
+bool UploadManager::isComplete(uint64_t batchId){
+    if(this->recording && batchId >= this->currentBatch.id){
+        return false;
+    }
+    this->poll();
+    return this->pendingBatches.empty() || batchId < this->pendingBatches.front().id;
+}
+
+/**
+ * Submit the current batch and wait for every batch
+ */
+void UploadManager::waitIdle(){
+    this->flush();
+    while(!this->pendingBatches.empty()){
+        this->retireOldestBatch();
+    }
+}
+
+void UploadManager::cleanup(){
+    this->waitIdle();
+    for(UploadBatch &batch : this->freeBatches){
+        vkDestroySemaphore(this->device, batch.transferFinishedSemaphore, nullptr);
+        vkDestroyFence(this->device, batch.fence, nullptr);
+    }
+    this->freeBatches.clear();
+    vkDestroyCommandPool(this->device, this->transferCommandPool, nullptr);
+    vkDestroyCommandPool(this->device, this->graphicsCommandPool, nullptr);
+    this->application->destroyBuffer(this->stagingBuffer, this->stagingBufferMemory);
+}
@@ -0,0 +1,109 @@
+//
+// Created by cleme on 2020-03-01.
+//
+
+#ifndef GAME_ENGINE_UPLOADMANAGER_HPP
+#define GAME_ENGINE_UPLOADMANAGER_HPP
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "MemoryAllocator.hpp"
+
+class Application;
+
+/**
+ * Mapped staging range to copy to a resource from
+ */
+struct StagingRange {
+    void *data = nullptr;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+};
+
+/**
+ * Uploads submitted at once: the copies run on the transfer queue, then the graphics queue
+ * acquires the resources once the semaphore is signaled. The staging ranges it reads are given
+ * back once its fence is signaled.
+ */
+struct UploadBatch {
+    VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+    VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;
+    VkSemaphore transferFinishedSemaphore = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    uint64_t id = 0;
+    VkDeviceSize stagingEnd = 0;
+    //Staging buffers of the uploads larger than the staging ring
+    std::vector<VkBuffer> temporaryBuffers;
+    std::vector<MemoryAllocation> temporaryBufferMemory;
+};
+
+/**
+ * Records the uploads of the buffers and images into batches, instead of submitting and waiting
+ * for each copy. The data is staged in a persistently mapped ring buffer.
+ *
+ * The resources are exclusive to a queue family: the copies are recorded on the transfer queue,
+ * followed by the release of the resources, and the graphics queue acquires them before using
+ * them. The work that needs the graphics queue, like the mipmap blits, is recorded after the acquire.
+ *
+ * A batch is submitted by flush, before the frame that uses it, and retired once its fence is
+ * signaled. Nothing waits for the uploads unless the staging ring is full.
+ */
+class UploadManager {
+private:
+    Application *application = nullptr;
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue transferQueue = VK_NULL_HANDLE;
+    VkQueue graphicsQueue = VK_NULL_HANDLE;
+    uint32_t transferFamily = 0;
+    uint32_t graphicsFamily = 0;
+    VkCommandPool transferCommandPool = VK_NULL_HANDLE;
+    VkCommandPool graphicsCommandPool = VK_NULL_HANDLE;
+
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    MemoryAllocation stagingBufferMemory;
+    VkDeviceSize stagingSize = 0;
+    VkDeviceSize stagingAlignment = 16;
+    //The ranges in use start at the tail, they wrap around the end of the ring when wrapped is set
+    VkDeviceSize stagingHead = 0;
+    VkDeviceSize stagingTail = 0;
+    bool stagingWrapped = false;
+
+    //Batch being recorded, then the submitted batches from the oldest
+    UploadBatch currentBatch;
+    bool recording = false;
+    std::deque<UploadBatch> pendingBatches;
+    std::vector<UploadBatch> freeBatches;
+    uint64_t nextBatchId = 1;
+
+    bool allocateStaging(VkDeviceSize size, VkDeviceSize &offset);
+    void retireOldestBatch();
+    void beginBatch();
+
+public:
+    UploadManager();
+    UploadManager(Application *application, VkDevice &device);
+
+    void init(VkQueue transferQueue, uint32_t transferFamily, VkQueue graphicsQueue, uint32_t graphicsFamily,
+              VkDeviceSize stagingSize, VkDeviceSize stagingAlignment);
+
+    StagingRange stage(VkDeviceSize size);
+    VkCommandBuffer getTransferCommandBuffer();
+    VkCommandBuffer getGraphicsCommandBuffer();
+    void releaseBuffer(VkBuffer buffer, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask);
+    void releaseImage(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, const VkImageSubresourceRange &subresourceRange,
+                      VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask);
+    void uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size);
+
+    uint64_t flush();
+    void poll();
+    bool isComplete(uint64_t batchId);
+    void waitIdle();
+
+    void cleanup();
+};
+
+
+#endif //GAME_ENGINE_UPLOADMANAGER_HPP
@@ -27,6 +27,16 @@ struct VertexBoneData {
     }
 };
 
+/**
+ * Vertex written by the skinning compute pass, positions and normals are in model space.
+ * The w of the position and of the normal hold the bone ids of the vertex for the debug colour,
+ * two 16 bit ids per word: the ids above 0xFFFF are clamped.
+ */
+struct SkinnedVertex {
+    glm::vec4 position;
+    glm::vec4 normal;
+};
+
 struct Vertex {
     glm::vec3 pos;
     glm::vec3 normal;
@@ -35,61 +45,78 @@ struct Vertex {
     glm::ivec4 boneIds;
     glm::vec4 boneWeights;
 
-    static VkVertexInputBindingDescription getBindingDescription(){
-        VkVertexInputBindingDescription bindingDescription = {};
-        bindingDescription.binding = 0;
-        bindingDescription.stride = sizeof(Vertex);
-        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    bool operator==(const Vertex &other) const{
+        return pos == other.pos && normal == other.normal && texCoord == other.texCoord && texId == other.texId
+               && boneIds == other.boneIds && boneWeights == other.boneWeights;
+    }
+
+};
+
+/**
+ * Layout of the vertices of an asset in the vertex buffer
+ */
+enum class VertexFormat {
+    Full,
+    Packed
+};
+
+const uint32_t VERTEX_FORMAT_COUNT = 2;
+
+/**
+ * Quantized vertex, 32 bytes instead of the 72 bytes of a full vertex.
+ * The normal is octahedral encoded in two snorm16, the texture coordinates
+ * are two half floats, the bone ids four uint8 and the weights four unorm8.
+ */
+struct PackedVertex {
+    glm::vec3 pos;
+    uint32_t normal;
+    uint32_t texCoord;
+    uint32_t boneIds;
+    uint32_t boneWeights;
+    uint32_t texId;
+};
 
-        return bindingDescription;
+/**
+ * Vertex input of the graphics pipeline: the texture data is read from the asset vertices,
+ * the skinned positions and normals of each instance are fetched by the vertex shader
+ */
+struct VertexInput {
+    static uint32_t getVertexSize(VertexFormat format){
+        return static_cast<uint32_t>(format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex));
     }
 
-    static std::array<VkVertexInputAttributeDescription, 6> getAttributeDescriptions(){
-        std::array<VkVertexInputAttributeDescription, 6> attributeDescriptions = {};
+    static std::array<VkVertexInputBindingDescription, 1> getBindingDescriptions(VertexFormat format){
+        std::array<VkVertexInputBindingDescription, 1> bindingDescriptions = {};
 
-        //pos data
+        bindingDescriptions[0].binding = 0;
+        bindingDescriptions[0].stride = getVertexSize(format);
+        bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescriptions;
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions(VertexFormat format){
+        std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions = {};
+
+        //Texture id data
         attributeDescriptions[0].binding = 0;
         attributeDescriptions[0].location = 0;
-        attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[0].offset = offsetof(Vertex, pos);
+        attributeDescriptions[0].format = VK_FORMAT_R32_SINT;
+        attributeDescriptions[0].offset = format == VertexFormat::Packed ? offsetof(PackedVertex, texId) : offsetof(Vertex, texId);
 
-        //Normal data
+        //Texture coord data, the half floats of the packed vertices are converted by the vertex input
         attributeDescriptions[1].binding = 0;
         attributeDescriptions[1].location = 1;
-        attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[1].offset = offsetof(Vertex, normal);
-
-        //Texture id data
-        attributeDescriptions[2].binding = 0;
-        attributeDescriptions[2].location = 2;
-        attributeDescriptions[2].format = VK_FORMAT_R32_SINT;
-        attributeDescriptions[2].offset = offsetof(Vertex, texId);
-
-        //Texture coord data
-        attributeDescriptions[3].binding = 0;
-        attributeDescriptions[3].location = 3;
-        attributeDescriptions[3].format = VK_FORMAT_R32G32_SFLOAT;
-        attributeDescriptions[3].offset = offsetof(Vertex, texCoord);
-
-        //Bone id data
-        attributeDescriptions[4].binding = 0;
-        attributeDescriptions[4].location = 4;
-        attributeDescriptions[4].format = VK_FORMAT_R32G32B32A32_SINT;
-        attributeDescriptions[4].offset = offsetof(Vertex, boneIds);
-
-        //Bone weights data
-        attributeDescriptions[5].binding = 0;
-        attributeDescriptions[5].location = 5;
-        attributeDescriptions[5].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attributeDescriptions[5].offset = offsetof(Vertex, boneWeights);
+        if(format == VertexFormat::Packed){
+            attributeDescriptions[1].format = VK_FORMAT_R16G16_SFLOAT;
+            attributeDescriptions[1].offset = offsetof(PackedVertex, texCoord);
+        }else{
+            attributeDescriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
+            attributeDescriptions[1].offset = offsetof(Vertex, texCoord);
+        }
 
         return attributeDescriptions;
     }
-
-    bool operator==(const Vertex &other) const{
-        return pos == other.pos && normal == other.normal && texCoord == other.texCoord && texId == other.texId;
-    }
-
 };
 
 namespace std {
@@ -0,0 +1,139 @@
+//
+// Created by cleme on 2020-02-25.
+//
+
+#include "VertexPacking.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static float signNotZero(float value){
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+/**
+ * Project a unit vector on the octahedron and unfold the lower half on the square [-1, 1]
+ */
+static glm::vec2 encodeOctahedral(const glm::vec3 &normal){
+    float sum = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+    if(sum == 0.0f){
+        return glm::vec2(0.0f, 0.0f);
+    }
+
+    float x = normal.x / sum;
+    float y = normal.y / sum;
+    if(normal.z < 0.0f){
+        float foldedX = (1.0f - std::fabs(y)) * signNotZero(x);
+        float foldedY = (1.0f - std::fabs(x)) * signNotZero(y);
+        x = foldedX;
+        y = foldedY;
+    }
+    return glm::vec2(x, y);
+}
+
+/**
+ * Same decoding as the skinning shader
+ */
+static glm::vec3 decodeOctahedral(const glm::vec2 &encoded){
+    glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::fabs(encoded.x) - std::fabs(encoded.y));
+    if(normal.z < 0.0f){
+        normal.x = (1.0f - std::fabs(encoded.y)) * signNotZero(encoded.x);
+        normal.y = (1.0f - std::fabs(encoded.x)) * signNotZero(encoded.y);
+    }
+    return glm::normalize(normal);
+}
+
+PackedVertex packVertex(const Vertex &vertex){
+    PackedVertex packedVertex = {};
+    packedVertex.pos = vertex.pos;
+    packedVertex.normal = glm::packSnorm2x16(encodeOctahedral(vertex.normal));
+    packedVertex.texCoord = glm::packHalf2x16(vertex.texCoord);
+    packedVertex.texId = vertex.texId;
+
+    //The weights are rounded so that their sum is kept, the rounding error goes to the largest weight
+    uint32_t quantizedWeights[4];
+    int32_t quantizedSum = 0;
+    float weightSum = 0.0f;
+    uint32_t largestWeight = 0;
+    for(uint32_t i = 0 ; i < 4 ; i++){
+        float weight = std::min(std::max(vertex.boneWeights[i], 0.0f), 1.0f);
+        quantizedWeights[i] = static_cast<uint32_t>(std::round(weight * 255.0f));
+        quantizedSum += static_cast<int32_t>(quantizedWeights[i]);
+        weightSum += weight;
+        if(vertex.boneWeights[i] > vertex.boneWeights[largestWeight]){
+            largestWeight = i;
+        }
+    }
+    int32_t targetSum = static_cast<int32_t>(std::round(std::min(weightSum, 1.0f) * 255.0f));
+    int32_t correctedWeight = static_cast<int32_t>(quantizedWeights[largestWeight]) + targetSum - quantizedSum;
+    quantizedWeights[largestWeight] = static_cast<uint32_t>(std::min(std::max(correctedWeight, 0), 255));
+
+    for(uint32_t i = 0 ; i < 4 ; i++){
+        uint32_t boneId = static_cast<uint32_t>(std::min(std::max(vertex.boneIds[i], 0), 255));
+        packedVertex.boneIds |= boneId << (8 * i);
+        packedVertex.boneWeights |= quantizedWeights[i] << (8 * i);
+    }
+
+    return packedVertex;
+}
+
+Vertex unpackVertex(const PackedVertex &vertex){
+    Vertex unpackedVertex = {};
+    unpackedVertex.pos = vertex.pos;
+    unpackedVertex.normal = decodeOctahedral(glm::unpackSnorm2x16(vertex.normal));
+    unpackedVertex.texCoord = glm::unpackHalf2x16(vertex.texCoord);
+    unpackedVertex.texId = vertex.texId;
+    unpackedVertex.boneWeights = glm::unpackUnorm4x8(vertex.boneWeights);
+    for(uint32_t i = 0 ; i < 4 ; i++){
+        unpackedVertex.boneIds[i] = static_cast<int32_t>((vertex.boneIds >> (8 * i)) & 0xFF);
+    }
+
+    return unpackedVertex;
+}
+
+VertexPackingError measurePackingError(const std::vector<Vertex> &vertices, const std::vector<PackedVertex> &packedVertices){
+    VertexPackingError error;
+
+    for(size_t i = 0 ; i < vertices.size() ; i++){
+        const Vertex &vertex = vertices[i];
+        Vertex unpackedVertex = unpackVertex(packedVertices[i]);
+
+        float normalLength = glm::length(vertex.normal);
+        if(normalLength > 0.0f){
+            float cosAngle = glm::dot(vertex.normal / normalLength, unpackedVertex.normal);
+            float angle = std::acos(std::min(std::max(cosAngle, -1.0f), 1.0f));
+            error.normalDegrees = std::max(error.normalDegrees, glm::degrees(angle));
+        }
+
+        for(uint32_t c = 0 ; c < 2 ; c++){
+            error.texCoord = std::max(error.texCoord, std::fabs(vertex.texCoord[c] - unpackedVertex.texCoord[c]));
+        }
+
+        for(uint32_t c = 0 ; c < 4 ; c++){
+            error.boneWeight = std::max(error.boneWeight, std::fabs(vertex.boneWeights[c] - unpackedVertex.boneWeights[c]));
+            if(vertex.boneIds[c] < 0 || vertex.boneIds[c] > 255){
+                error.boneIdOverflow = true;
+            }
+        }
+    }
+
+    return error;
+}
+
+/**
+ * Pack the vertices and check that the packed vertices are close enough to the original ones
+ * @return false if an error is above the tolerance of the settings, the asset should keep its full vertices
+ */
+bool packVertices(const std::vector<Vertex> &vertices, const VertexPackingSettings &settings,
+                  std::vector<PackedVertex> &packedVertices, VertexPackingError &error){
+    packedVertices.resize(vertices.size());
+    for(size_t i = 0 ; i < vertices.size() ; i++){
+        packedVertices[i] = packVertex(vertices[i]);
+    }
+
+    error = measurePackingError(vertices, packedVertices);
+    return !error.boneIdOverflow
+           && error.normalDegrees <= settings.normalToleranceDegrees
+           && error.texCoord <= settings.texCoordTolerance
+           && error.boneWeight <= settings.boneWeightTolerance;
+}
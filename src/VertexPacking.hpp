@@ -0,0 +1,42 @@
+//
+// Created by cleme on 2020-02-25.
+//
+
+#ifndef GAME_ENGINE_VERTEXPACKING_HPP
+#define GAME_ENGINE_VERTEXPACKING_HPP
+
+#include <cstdint>
+#include <vector>
+#include "Vertex.hpp"
+
+/**
+ * Largest error allowed when the vertices of an asset are packed, the asset keeps
+ * full vertices otherwise. Texture coordinates are in UV units.
+ */
+struct VertexPackingSettings {
+    float normalToleranceDegrees = 0.1f;
+    float texCoordTolerance = 1.0f / 2048.0f;
+    //The rounding error of the weights is moved to the largest weight to keep their sum
+    float boneWeightTolerance = 3.0f / 255.0f;
+};
+
+/**
+ * Largest difference between the vertices and their packed version
+ */
+struct VertexPackingError {
+    float normalDegrees = 0.0f;
+    float texCoord = 0.0f;
+    float boneWeight = 0.0f;
+    //Bone ids do not fit in 8 bits
+    bool boneIdOverflow = false;
+};
+
+PackedVertex packVertex(const Vertex &vertex);
+Vertex unpackVertex(const PackedVertex &vertex);
+
+VertexPackingError measurePackingError(const std::vector<Vertex> &vertices, const std::vector<PackedVertex> &packedVertices);
+bool packVertices(const std::vector<Vertex> &vertices, const VertexPackingSettings &settings,
+                  std::vector<PackedVertex> &packedVertices, VertexPackingError &error);
+
+
+#endif //GAME_ENGINE_VERTEXPACKING_HPP
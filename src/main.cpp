@@ -1,7 +1,50 @@
 #include "Application.hpp"
 
-int main() {
-    Application app;
+#include <cstdlib>
+
+/**
+ * Read the value of an option of the command line
+ * @return false if the option has no valid value
+ */
+bool readOption(int argc, char **argv, int &i, uint32_t &value){
+    if(i + 1 >= argc){
+        return false;
+    }
+
+    char *end;
+    unsigned long parsed = strtoul(argv[++i], &end, 10);
+    if(*end != '\0'){
+        return false;
+    }
+    value = static_cast<uint32_t>(parsed);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    ApplicationSettings settings;
+    for(int i = 1 ; i < argc ; i++){
+        bool valid = false;
+        if(strcmp(argv[i], "--instances") == 0){
+            valid = readOption(argc, argv, i, settings.instanceCount) && settings.instanceCount > 0;
+        }else if(strcmp(argv[i], "--threads") == 0){
+            valid = readOption(argc, argv, i, settings.workerThreadCount);
+        }else if(strcmp(argv[i], "--frames") == 0){
+            valid = readOption(argc, argv, i, settings.frameCount);
+        }else if(strcmp(argv[i], "--no-occlusion") == 0){
+            settings.occlusionCulling = false;
+            valid = true;
+        }else if(strcmp(argv[i], "--no-mesh-optimization") == 0){
+            settings.meshOptimization = false;
+            valid = true;
+        }
+
+        if(!valid){
+            printf("Usage: %s [--instances count] [--threads count] [--frames count] [--no-occlusion] [--no-mesh-optimization]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    Application app(settings);
 
     try {
         app.run();
@@ -11,4 +54,4 @@ int main() {
     }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
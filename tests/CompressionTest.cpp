@@ -0,0 +1,146 @@
+//
+// Created by cleme on 2020-03-04.
+//
+
+#include "Test.hpp"
+#include "../bench/LegacyAnimation.hpp"
+#include "../src/Animation.hpp"
+#include "../src/CompressedAnimation.hpp"
+#include "../src/Skeleton.hpp"
+
+#include <algorithm>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+
+//Largest error allowed on the skinned vertices with the default compression settings
+const float MAXIMUM_ROTATION_DEGREES = 2.0f;
+//Translation error relative to the largest translation of the palettes
+const float MAXIMUM_RELATIVE_TRANSLATION = 0.02f;
+
+/**
+ * @return the largest translation of the bone palettes of the clip, the size of the character
+ */
+float paletteExtent(const AnimationClip &clip, const Skeleton &skeleton){
+    Pose pose;
+    std::vector<AffineTransform> palette(skeleton.getBoneCount());
+    float extent = 0.0f;
+    for(float animationTime = 0.0f ; animationTime <= clip.getDuration() ; animationTime += std::max(1.0f, clip.getDuration() / 100.0f)){
+        skeleton.resetPose(pose);
+        clip.sample(animationTime, pose);
+        skeleton.computeBonePalette(pose, palette.data());
+        for(const AffineTransform &transform : palette){
+            for(uint32_t row = 0 ; row < 3 ; row++){
+                extent = std::max(extent, std::abs(transform.rows[row][3]));
+            }
+        }
+    }
+
+    return extent;
+}
+
+/**
+ * Channel with a single identity rotation key and a single unit scale key
+ */
+aiNodeAnim* createChannel(const aiString &nodeName, const std::vector<aiVector3D> &positions){
+    aiNodeAnim *channel = new aiNodeAnim();
+    channel->mNodeName = nodeName;
+    channel->mNumPositionKeys = static_cast<unsigned int>(positions.size());
+    channel->mPositionKeys = new aiVectorKey[positions.size()];
+    for(size_t i = 0 ; i < positions.size() ; i++){
+        channel->mPositionKeys[i] = aiVectorKey(static_cast<double>(i), positions[i]);
+    }
+    channel->mNumRotationKeys = 1;
+    channel->mRotationKeys = new aiQuatKey[1];
+    channel->mRotationKeys[0] = aiQuatKey(0.0, aiQuaternion());
+    channel->mNumScalingKeys = 1;
+    channel->mScalingKeys = new aiVectorKey[1];
+    channel->mScalingKeys[0] = aiVectorKey(0.0, aiVector3D(1.0f, 1.0f, 1.0f));
+
+    return channel;
+}
+
+/**
+ * Clip spanning 1000 units, one quantization step is then larger than the default translation tolerance.
+ * The first channel sets the range, the second one is a ramp between two keys that are not on the
+ * quantization grid and the third one has a single key.
+ */
+void testLargeExtent(const aiAnimation *sourceAnimation, const Skeleton &skeleton){
+    CHECK(sourceAnimation->mNumChannels >= 3);
+    if(sourceAnimation->mNumChannels < 3){
+        return;
+    }
+
+    const uint32_t rampKeyCount = 101;
+    std::vector<aiVector3D> ramp;
+    for(uint32_t i = 0 ; i < rampKeyCount ; i++){
+        ramp.emplace_back(100.123f + 5.0031f * i, 200.456f + 3.0017f * i, 300.789f - 2.0043f * i);
+    }
+
+    aiAnimation animation;
+    animation.mName = aiString("large extent");
+    animation.mDuration = rampKeyCount - 1;
+    animation.mTicksPerSecond = 25.0;
+    animation.mNumChannels = 3;
+    animation.mChannels = new aiNodeAnim*[3];
+    animation.mChannels[0] = createChannel(sourceAnimation->mChannels[0]->mNodeName, {aiVector3D(0.0f, 0.0f, 0.0f), aiVector3D(1000.0f, 1000.0f, 1000.0f)});
+    animation.mChannels[1] = createChannel(sourceAnimation->mChannels[1]->mNodeName, ramp);
+    animation.mChannels[2] = createChannel(sourceAnimation->mChannels[2]->mNodeName, {aiVector3D(123.456f, 654.321f, 42.4242f)});
+
+    AnimationClip clip(&animation, skeleton);
+    CompressedAnimationClip compressedClip(clip, skeleton, ClipCompressionSettings());
+
+    //Two keys for the range and the ramp, one for the single key and for every rotation and scale
+    printf("Large extent clip: %u keys\n", compressedClip.getKeyCount());
+    CHECK(compressedClip.getKeyCount() == 2 + 2 + 1 + 3 * 2);
+
+    float quantizationStep = 1000.0f / 65535.0f;
+    Pose pose;
+    Pose compressedPose;
+    float maximumError = 0.0f;
+    for(float animationTime = 0.0f ; animationTime <= clip.getDuration() ; animationTime += 0.25f){
+        skeleton.resetPose(pose);
+        skeleton.resetPose(compressedPose);
+        clip.sample(animationTime, pose);
+        compressedClip.sample(animationTime, compressedPose);
+        for(uint32_t channel = 0 ; channel < 3 ; channel++){
+            int32_t node = skeleton.findNode(animation.mChannels[channel]->mNodeName.data);
+            for(uint32_t c = 0 ; c < 3 ; c++){
+                maximumError = std::max(maximumError, std::abs(pose.translations[c][node] - compressedPose.translations[c][node]));
+            }
+        }
+    }
+    printf("Large extent clip: max error %.5f, quantization step %.5f\n", maximumError, quantizationStep);
+    CHECK(maximumError <= quantizationStep * 1.01f);
+}
+
+int main(){
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(TEST_MODEL_PATH, aiProcess_Triangulate|aiProcess_FlipUVs);
+    CHECK(scene != nullptr && scene->mRootNode != nullptr && scene->mNumAnimations > 0);
+    if(scene == nullptr || scene->mRootNode == nullptr || scene->mNumAnimations == 0){
+        return testResult();
+    }
+
+    LegacyAnimation bones(scene, 0);
+    Skeleton skeleton(scene, bones.getBoneMapping(), bones.getBoneOffsetMatrices());
+    ClipCompressionSettings compressionSettings;
+
+    for(uint32_t i = 0 ; i < scene->mNumAnimations ; i++){
+        AnimationClip clip(scene->mAnimations[i], skeleton);
+        CompressedAnimationClip compressedClip(clip, skeleton, compressionSettings);
+
+        ClipCompressionError error = measureCompressionError(clip, compressedClip, skeleton);
+        float extent = paletteExtent(clip, skeleton);
+        printf("Animation %s: %zu bytes -> %zu bytes, max error %.5f translation (extent %.2f), %.4f degrees, %.5f scale\n",
+               clip.getName().c_str(), clip.getMemorySize(), compressedClip.getMemorySize(),
+               error.translation, extent, error.rotationDegrees, error.scale);
+
+        CHECK(compressedClip.getMemorySize() < clip.getMemorySize());
+        CHECK(error.rotationDegrees <= MAXIMUM_ROTATION_DEGREES);
+        CHECK(error.translation <= MAXIMUM_RELATIVE_TRANSLATION * extent);
+    }
+
+    testLargeExtent(scene->mAnimations[0], skeleton);
+
+    return testResult();
+}
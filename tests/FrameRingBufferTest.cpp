@@ -0,0 +1,142 @@
+//
+// Created by cleme on 2020-03-06.
+//
+
+#include "Test.hpp"
+#include "../src/FrameRingBuffer.hpp"
+
+#include <map>
+#include <memory>
+#include <stdexcept>
+
+//The ring buffer and its allocator only call these functions of the device, they are replaced
+//by host memory so that the test runs without a Vulkan driver. Every memory type is host visible.
+std::map<VkDeviceMemory, std::unique_ptr<char[]>> deviceMemories;
+std::map<VkBuffer, VkDeviceSize> bufferSizes;
+uint64_t nextHandle = 1;
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice physicalDevice, VkPhysicalDeviceMemoryProperties *pMemoryProperties){
+    *pMemoryProperties = {};
+    pMemoryProperties->memoryTypeCount = 1;
+    pMemoryProperties->memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    pMemoryProperties->memoryTypes[0].heapIndex = 0;
+    pMemoryProperties->memoryHeapCount = 1;
+    pMemoryProperties->memoryHeaps[0].size = 256ull * 1024 * 1024;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice device, const VkMemoryAllocateInfo *pAllocateInfo, const VkAllocationCallbacks *pAllocator, VkDeviceMemory *pMemory){
+    *pMemory = reinterpret_cast<VkDeviceMemory>(nextHandle++);
+    deviceMemories[*pMemory] = std::unique_ptr<char[]>(new char[pAllocateInfo->allocationSize]);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice device, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size, VkMemoryMapFlags flags, void **ppData){
+    *ppData = deviceMemories.at(memory).get() + offset;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks *pAllocator){
+    CHECK(deviceMemories.erase(memory) == 1);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateBuffer(VkDevice device, const VkBufferCreateInfo *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkBuffer *pBuffer){
+    *pBuffer = reinterpret_cast<VkBuffer>(nextHandle++);
+    bufferSizes[*pBuffer] = pCreateInfo->size;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements(VkDevice device, VkBuffer buffer, VkMemoryRequirements *pMemoryRequirements){
+    *pMemoryRequirements = {};
+    pMemoryRequirements->size = bufferSizes.at(buffer);
+    pMemoryRequirements->alignment = 256;
+    pMemoryRequirements->memoryTypeBits = 0x1;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory(VkDevice device, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize memoryOffset){
+    CHECK(deviceMemories.count(memory) == 1);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyBuffer(VkDevice device, VkBuffer buffer, const VkAllocationCallbacks *pAllocator){
+    CHECK(bufferSizes.erase(buffer) == 1);
+}
+
+const VkDeviceSize SLICE_ALIGNMENT = 256;
+const VkDeviceSize STREAMING_SIZE = 1024;
+const uint32_t FRAME_COUNT = 3;
+
+/**
+ * @return true when allocating the range throws because the frame is full
+ */
+bool allocationOverflows(FrameRingBuffer &ringBuffer, VkDeviceSize size, VkDeviceSize alignment){
+    try{
+        ringBuffer.allocate(size, alignment);
+    }catch(const std::runtime_error &error){
+        return true;
+    }
+    return false;
+}
+
+int main(){
+    MemoryAllocator allocator(VK_NULL_HANDLE, VK_NULL_HANDLE);
+    VkDevice device = VK_NULL_HANDLE;
+
+    FrameRingBuffer ringBuffer(&allocator, device, SLICE_ALIGNMENT);
+    FrameSlice slice = ringBuffer.reserve(100);
+    ringBuffer.init(FRAME_COUNT, STREAMING_SIZE);
+
+    //The slices take the start of every frame, rounded to their alignment
+    const VkDeviceSize slicesSize = SLICE_ALIGNMENT;
+    const VkDeviceSize frameSize = slicesSize + STREAMING_SIZE;
+    CHECK(ringBuffer.getBufferInfo(slice, 1).offset == frameSize);
+
+    ringBuffer.beginFrame(0);
+    char *mappedData = static_cast<char*>(ringBuffer.getData(slice));
+
+    //Two passes over the frames, the allocations of a frame start again from its slices when it is reused
+    VkDeviceSize firstOffsets[FRAME_COUNT];
+    for(uint32_t frame = 0 ; frame < FRAME_COUNT * 2 ; frame++){
+        uint32_t frameIndex = frame % FRAME_COUNT;
+        VkDeviceSize frameStart = frameSize * frameIndex;
+        ringBuffer.beginFrame(frameIndex);
+
+        FrameAllocation first = ringBuffer.allocate(10, 16);
+        FrameAllocation second = ringBuffer.allocate(1, 1);
+        FrameAllocation third = ringBuffer.allocate(8, 512);
+        FrameAllocation fourth = ringBuffer.allocate(4, 4);
+
+        CHECK(first.offset == frameStart + slicesSize);
+        CHECK(second.offset == first.offset + 10);
+        CHECK(third.offset % 512 == 0);
+        CHECK(third.offset >= second.offset + 1);
+        CHECK(fourth.offset % 4 == 0);
+        CHECK(fourth.offset >= third.offset + 8);
+        CHECK(fourth.offset + 4 <= frameStart + frameSize);
+        for(const FrameAllocation &allocation : {first, second, third, fourth}){
+            CHECK(allocation.data == mappedData + allocation.offset);
+        }
+
+        if(frame < FRAME_COUNT){
+            firstOffsets[frameIndex] = first.offset;
+        }else{
+            CHECK(first.offset == firstOffsets[frameIndex]);
+        }
+    }
+
+    //A frame holds exactly its streaming size, one more byte overflows instead of writing over the next frame
+    ringBuffer.beginFrame(1);
+    CHECK(!allocationOverflows(ringBuffer, STREAMING_SIZE, 1));
+    CHECK(allocationOverflows(ringBuffer, 1, 1));
+
+    ringBuffer.beginFrame(FRAME_COUNT - 1);
+    CHECK(allocationOverflows(ringBuffer, STREAMING_SIZE + 1, 1));
+    CHECK(!allocationOverflows(ringBuffer, STREAMING_SIZE - 512, 1));
+    CHECK(allocationOverflows(ringBuffer, 1, 1024));
+
+    ringBuffer.cleanup();
+    allocator.cleanup();
+    CHECK(bufferSizes.empty());
+    CHECK(deviceMemories.empty());
+
+    return testResult();
+}
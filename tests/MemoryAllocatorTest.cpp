@@ -0,0 +1,168 @@
+//
+// Created by cleme on 2020-03-04.
+//
+
+#include "Test.hpp"
+#include "../src/MemoryAllocator.hpp"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+
+//The allocator only calls these four functions of the device, they are replaced by host memory
+//so that the test runs without a Vulkan driver. Type 0 is device local, type 1 host visible.
+const VkDeviceSize DEVICE_HEAP_SIZE = 4ull * 1024 * 1024 * 1024;
+const VkDeviceSize HOST_HEAP_SIZE = 256ull * 1024 * 1024;
+
+std::map<VkDeviceMemory, std::unique_ptr<char[]>> deviceMemories;
+uint64_t nextMemoryHandle = 1;
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice physicalDevice, VkPhysicalDeviceMemoryProperties *pMemoryProperties){
+    *pMemoryProperties = {};
+    pMemoryProperties->memoryTypeCount = 2;
+    pMemoryProperties->memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    pMemoryProperties->memoryTypes[0].heapIndex = 0;
+    pMemoryProperties->memoryTypes[1].propertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    pMemoryProperties->memoryTypes[1].heapIndex = 1;
+    pMemoryProperties->memoryHeapCount = 2;
+    pMemoryProperties->memoryHeaps[0].size = DEVICE_HEAP_SIZE;
+    pMemoryProperties->memoryHeaps[1].size = HOST_HEAP_SIZE;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice device, const VkMemoryAllocateInfo *pAllocateInfo, const VkAllocationCallbacks *pAllocator, VkDeviceMemory *pMemory){
+    *pMemory = reinterpret_cast<VkDeviceMemory>(nextMemoryHandle++);
+    //The pages are never touched, only the host visible memory is mapped
+    deviceMemories[*pMemory] = std::unique_ptr<char[]>(pAllocateInfo->memoryTypeIndex == 1 ? new char[pAllocateInfo->allocationSize] : nullptr);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice device, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size, VkMemoryMapFlags flags, void **ppData){
+    *ppData = deviceMemories.at(memory).get() + offset;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks *pAllocator){
+    CHECK(deviceMemories.erase(memory) == 1);
+}
+
+struct Resource {
+    MemoryAllocation allocation;
+    VkDeviceSize alignment;
+};
+
+std::mt19937 generator(7);
+
+uint32_t randomInteger(uint32_t minimum, uint32_t maximum){
+    return std::uniform_int_distribution<uint32_t>(minimum, maximum)(generator);
+}
+
+/**
+ * Requirements of a texture with its mip chain, a vertex buffer or a uniform buffer, sometimes larger than a block
+ */
+VkMemoryRequirements randomRequirements(bool &linear){
+    VkMemoryRequirements requirements = {};
+    requirements.memoryTypeBits = 0x3;
+    uint32_t kind = randomInteger(0, 99);
+    if(kind < 60){
+        VkDeviceSize width = 16ull << randomInteger(0, 7);
+        VkDeviceSize height = 16ull << randomInteger(0, 7);
+        requirements.size = width * height * 4 * 4 / 3;
+        requirements.alignment = randomInteger(0, 1) ? 1024 : 65536;
+        linear = false;
+    }else if(kind < 98){
+        requirements.size = randomInteger(1, 4 * 1024 * 1024);
+        requirements.alignment = 256;
+        linear = true;
+    }else{
+        requirements.size = 80ull * 1024 * 1024 + randomInteger(0, 1024 * 1024);
+        requirements.alignment = 4096;
+        linear = randomInteger(0, 1) == 1;
+    }
+    return requirements;
+}
+
+/**
+ * The live ranges of a memory object never overlap, and every range is aligned for its resource
+ */
+void checkRanges(const std::vector<Resource> &resources){
+    std::map<VkDeviceMemory, std::vector<std::pair<VkDeviceSize, VkDeviceSize>>> ranges;
+    for(const Resource &resource : resources){
+        CHECK(resource.allocation.offset % resource.alignment == 0);
+        ranges[resource.allocation.memory].emplace_back(resource.allocation.offset, resource.allocation.offset + resource.allocation.size);
+    }
+    for(auto &memoryRanges : ranges){
+        std::sort(memoryRanges.second.begin(), memoryRanges.second.end());
+        for(size_t i = 1 ; i < memoryRanges.second.size() ; i++){
+            CHECK(memoryRanges.second[i - 1].second <= memoryRanges.second[i].first);
+        }
+    }
+}
+
+int main(){
+    MemoryAllocator allocator(VK_NULL_HANDLE, VK_NULL_HANDLE);
+    std::vector<Resource> resources;
+    std::set<uint32_t> pools;
+    uint32_t allocationCount = 0;
+    uint32_t peakBlockCount = 0;
+
+    //Rounds of loading and unloading levels, the resources of the previous rounds are freed in a random order
+    for(uint32_t round = 0 ; round < 20 ; round++){
+        uint32_t count = randomInteger(100, 400);
+        for(uint32_t i = 0 ; i < count ; i++){
+            bool linear;
+            VkMemoryRequirements requirements = randomRequirements(linear);
+            bool hostVisible = randomInteger(0, 3) == 0;
+            VkMemoryPropertyFlags properties = hostVisible ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+            Resource resource;
+            resource.allocation = allocator.allocate(requirements, properties, linear);
+            resource.alignment = requirements.alignment;
+            CHECK(resource.allocation.memory != VK_NULL_HANDLE);
+            CHECK(!hostVisible || resource.allocation.mappedData != nullptr);
+            if(resource.allocation.kind == AllocationKind::Block){
+                pools.insert(resource.allocation.pool);
+            }
+            resources.push_back(resource);
+            allocationCount++;
+        }
+        checkRanges(resources);
+
+        MemoryStats stats = allocator.getStats();
+        CHECK(stats.fragmentation >= 0.0f && stats.fragmentation <= 1.0f);
+        CHECK(stats.usedBytes <= stats.allocatedBytes);
+        peakBlockCount = std::max(peakBlockCount, stats.blockCount);
+
+        std::shuffle(resources.begin(), resources.end(), generator);
+        size_t keptCount = resources.size() / 3;
+        for(size_t i = keptCount ; i < resources.size() ; i++){
+            allocator.free(resources[i].allocation);
+        }
+        resources.resize(keptCount);
+    }
+
+    for(Resource &resource : resources){
+        allocator.free(resource.allocation);
+    }
+
+    //Every range merged back with its buddies, and only the last block of each pool kept
+    MemoryStats stats = allocator.getStats();
+    allocator.printStats();
+    printf("%u allocations, %zu pools used, at most %u blocks\n", allocationCount, pools.size(), peakBlockCount);
+    CHECK(stats.allocationCount == 0);
+    CHECK(stats.usedBytes == 0);
+    CHECK(stats.allocatedBytes == 0);
+    CHECK(stats.dedicatedCount == 0);
+    CHECK(stats.dedicatedBytes == 0);
+    CHECK(stats.fragmentation == 0.0f);
+    CHECK(stats.blockCount == pools.size());
+    CHECK(peakBlockCount > stats.blockCount);
+    CHECK(stats.freeRangeCount == stats.blockCount);
+    CHECK(deviceMemories.size() == stats.blockCount);
+
+    allocator.cleanup();
+    CHECK(deviceMemories.empty());
+
+    return testResult();
+}
@@ -0,0 +1,230 @@
+//
+// Created by cleme on 2020-03-04.
+//
+
+#include "Test.hpp"
+#include "../bench/LegacyAnimation.hpp"
+#include "../src/Animation.hpp"
+#include "../src/PoseKernel.hpp"
+#include "../src/Skeleton.hpp"
+
+#include <cmath>
+#include <random>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+
+//The legacy evaluation interpolates the rotations with a slerp and the kernels with a nlerp.
+//Between two keys of a few degrees the nlerp stays within 1e-4 radians of the slerp, the error
+//grows along the chains of bones, 5e-3 of the largest value of the palette keeps a margin for the longest chains.
+const float PALETTE_TOLERANCE = 5e-3f;
+//The kernels against the same formulas computed in double precision
+const float KERNEL_TOLERANCE = 1e-5f;
+//Every track count up to 19 so that the remainders of the 4 and 8 wide loops are covered
+const uint32_t KERNEL_MAXIMUM_COUNT = 19;
+
+std::mt19937 generator(42);
+
+float randomFloat(float minimum, float maximum){
+    return std::uniform_real_distribution<float>(minimum, maximum)(generator);
+}
+
+void randomRotation(float *rotation){
+    double length = 0.0;
+    for(uint32_t c = 0 ; c < 4 ; c++){
+        rotation[c] = randomFloat(-1.0f, 1.0f);
+        length += rotation[c] * rotation[c];
+    }
+    for(uint32_t c = 0 ; c < 4 ; c++){
+        rotation[c] = static_cast<float>(rotation[c] / std::sqrt(length));
+    }
+}
+
+/**
+ * Blend count tracks into count nodes stored in reverse order, to check that every result lands on its node
+ */
+void testBlend(uint32_t count){
+    PoseBlend vectorBlend;
+    PoseBlend rotationBlend;
+    for(uint32_t i = 0 ; i < count ; i++){
+        float factor = randomFloat(0.0f, 1.0f);
+        float from[4], to[4];
+        for(uint32_t c = 0 ; c < 3 ; c++){
+            from[c] = randomFloat(-100.0f, 100.0f);
+            to[c] = randomFloat(-100.0f, 100.0f);
+        }
+        vectorBlend.add(count - 1 - i, factor, from, to, 3);
+        randomRotation(from);
+        randomRotation(to);
+        rotationBlend.add(count - 1 - i, factor, from, to, 4);
+    }
+
+    std::array<std::vector<float>, 3> vectors;
+    std::array<std::vector<float>, 4> rotations;
+    for(std::vector<float> &component : vectors){
+        component.assign(count, 0.0f);
+    }
+    for(std::vector<float> &component : rotations){
+        component.assign(count, 0.0f);
+    }
+    blendVectors(vectorBlend, vectors);
+    blendRotations(rotationBlend, rotations);
+
+    for(uint32_t i = 0 ; i < count ; i++){
+        uint32_t node = count - 1 - i;
+        double factor = vectorBlend.factors[i];
+        for(uint32_t c = 0 ; c < 3 ; c++){
+            double expected = vectorBlend.from[c][i] + (static_cast<double>(vectorBlend.to[c][i]) - vectorBlend.from[c][i]) * factor;
+            CHECK_NEAR(vectors[c][node], expected, KERNEL_TOLERANCE * 100.0f);
+        }
+
+        factor = rotationBlend.factors[i];
+        double cosTheta = 0.0;
+        for(uint32_t c = 0 ; c < 4 ; c++){
+            cosTheta += static_cast<double>(rotationBlend.from[c][i]) * rotationBlend.to[c][i];
+        }
+        double sign = cosTheta < 0.0 ? -1.0 : 1.0;
+        double expected[4];
+        double length = 0.0;
+        for(uint32_t c = 0 ; c < 4 ; c++){
+            expected[c] = rotationBlend.from[c][i] + (rotationBlend.to[c][i] * sign - rotationBlend.from[c][i]) * factor;
+            length += expected[c] * expected[c];
+        }
+        for(uint32_t c = 0 ; c < 4 ; c++){
+            CHECK_NEAR(rotations[c][node], expected[c] / std::sqrt(length), KERNEL_TOLERANCE * 10.0f);
+        }
+    }
+}
+
+void testLocalTransforms(uint32_t count){
+    std::array<std::vector<float>, 3> translations;
+    std::array<std::vector<float>, 4> rotations;
+    std::array<std::vector<float>, 3> scales;
+    for(uint32_t i = 0 ; i < count ; i++){
+        float rotation[4];
+        randomRotation(rotation);
+        for(uint32_t c = 0 ; c < 4 ; c++){
+            rotations[c].push_back(rotation[c]);
+        }
+        for(uint32_t c = 0 ; c < 3 ; c++){
+            translations[c].push_back(randomFloat(-100.0f, 100.0f));
+            scales[c].push_back(randomFloat(0.5f, 2.0f));
+        }
+    }
+
+    std::vector<AffineTransform> transforms(count);
+    buildLocalTransforms(translations, rotations, scales, transforms.data());
+
+    for(uint32_t i = 0 ; i < count ; i++){
+        double x = rotations[0][i], y = rotations[1][i], z = rotations[2][i], w = rotations[3][i];
+        double rotation[3][3] = {
+            {1.0 - 2.0 * (y * y + z * z), 2.0 * (x * y - w * z), 2.0 * (x * z + w * y)},
+            {2.0 * (x * y + w * z), 1.0 - 2.0 * (x * x + z * z), 2.0 * (y * z - w * x)},
+            {2.0 * (x * z - w * y), 2.0 * (y * z + w * x), 1.0 - 2.0 * (x * x + y * y)}
+        };
+        for(uint32_t row = 0 ; row < 3 ; row++){
+            for(uint32_t column = 0 ; column < 3 ; column++){
+                CHECK_NEAR(transforms[i].rows[row][column], rotation[row][column] * scales[column][i], KERNEL_TOLERANCE * 10.0f);
+            }
+            CHECK_NEAR(transforms[i].rows[row][3], translations[row][i], 0.0);
+        }
+    }
+}
+
+void testConcatenation(){
+    AffineTransform parent, local, result;
+    for(uint32_t row = 0 ; row < 3 ; row++){
+        for(uint32_t column = 0 ; column < 4 ; column++){
+            parent.rows[row][column] = randomFloat(-2.0f, 2.0f);
+            local.rows[row][column] = randomFloat(-2.0f, 2.0f);
+        }
+    }
+    concatenateTransforms(parent, local, result);
+
+    for(uint32_t row = 0 ; row < 3 ; row++){
+        for(uint32_t column = 0 ; column < 4 ; column++){
+            double expected = column == 3 ? parent.rows[row][3] : 0.0;
+            for(uint32_t k = 0 ; k < 3 ; k++){
+                expected += static_cast<double>(parent.rows[row][k]) * local.rows[k][column];
+            }
+            CHECK_NEAR(result.rows[row][column], expected, KERNEL_TOLERANCE);
+        }
+    }
+}
+
+/**
+ * Bone palettes of the character over ten seconds of playback, against the recursive slerp evaluation
+ */
+void testPalette(){
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(TEST_MODEL_PATH, aiProcess_Triangulate|aiProcess_FlipUVs);
+    CHECK(scene != nullptr && scene->mRootNode != nullptr && scene->mNumAnimations > 0);
+    if(scene == nullptr || scene->mRootNode == nullptr || scene->mNumAnimations == 0){
+        return;
+    }
+
+    for(uint32_t animationIndex = 0 ; animationIndex < scene->mNumAnimations ; animationIndex++){
+        LegacyAnimation legacy(scene, animationIndex);
+        Skeleton skeleton(scene, legacy.getBoneMapping(), legacy.getBoneOffsetMatrices());
+        AnimationClip clip(scene->mAnimations[animationIndex], skeleton);
+
+        Pose pose;
+        AnimationCursor cursor;
+        std::vector<AffineTransform> palette(skeleton.getBoneCount());
+        float rotationError = 0.0f;
+        float translationError = 0.0f;
+
+        for(uint32_t frame = 0 ; frame < 600 ; frame++){
+            float time = frame / 60.0f;
+            const std::vector<aiMatrix4x4> &reference = legacy.getBoneTransforms(legacy.getAnimationTime(time));
+            skeleton.resetPose(pose);
+            clip.sample(clip.getAnimationTime(time), pose, cursor);
+            skeleton.computeBonePalette(pose, palette.data());
+
+            //The errors are relative to the largest value of the reference palette
+            float rotationScale = 1e-6f;
+            float translationScale = 1e-6f;
+            for(const aiMatrix4x4 &transform : reference){
+                for(uint32_t row = 0 ; row < 3 ; row++){
+                    for(uint32_t column = 0 ; column < 3 ; column++){
+                        rotationScale = std::max(rotationScale, std::abs(transform[row][column]));
+                    }
+                    translationScale = std::max(translationScale, std::abs(transform[row][3]));
+                }
+            }
+
+            for(size_t bone = 0 ; bone < reference.size() ; bone++){
+                for(uint32_t row = 0 ; row < 3 ; row++){
+                    for(uint32_t column = 0 ; column < 3 ; column++){
+                        rotationError = std::max(rotationError, std::abs(palette[bone].rows[row][column] - reference[bone][row][column]) / rotationScale);
+                    }
+                    translationError = std::max(translationError, std::abs(palette[bone].rows[row][3] - reference[bone][row][3]) / translationScale);
+                }
+            }
+        }
+
+        printf("Clip %s: largest relative error %.6f rotation, %.6f translation\n", clip.getName().c_str(), rotationError, translationError);
+        CHECK(rotationError <= PALETTE_TOLERANCE);
+        CHECK(translationError <= PALETTE_TOLERANCE);
+    }
+}
+
+int main(){
+#if defined(__AVX2__) && defined(__GNUC__)
+    if(!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma")){
+        printf("AVX2 and FMA are not supported by this processor\n");
+        return TEST_SKIPPED;
+    }
+#endif
+    printf("Pose kernels: %s\n", POSE_KERNEL_VARIANT);
+
+    for(uint32_t count = 0 ; count <= KERNEL_MAXIMUM_COUNT ; count++){
+        testBlend(count);
+        testLocalTransforms(count);
+    }
+    for(uint32_t i = 0 ; i < 100 ; i++){
+        testConcatenation();
+    }
+    testPalette();
+
+    return testResult();
+}
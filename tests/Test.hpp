@@ -0,0 +1,49 @@
+//
+// Created by cleme on 2020-03-04.
+//
+
+#ifndef GAME_ENGINE_TEST_HPP
+#define GAME_ENGINE_TEST_HPP
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+//Model loaded by the application, used by the tests of a single character
+const std::string TEST_MODEL_PATH = std::string(MODELS_PATH) + "man/BaseMesh_Anim.fbx";
+
+//Exit code of a test that cannot run on this machine, reported as skipped by ctest
+const int TEST_SKIPPED = 77;
+
+inline uint32_t testFailureCount = 0;
+
+/**
+ * Report a failed check, the test keeps running so that every failure is listed
+ */
+inline void testFailure(const char *file, int line, const char *expression){
+    printf("%s:%d: check failed: %s\n", file, line, expression);
+    testFailureCount++;
+}
+
+#define CHECK(expression) \
+    do { if(!(expression)) testFailure(__FILE__, __LINE__, #expression); } while(false)
+
+#define CHECK_NEAR(value, expected, tolerance) \
+    do { if(!(std::abs(static_cast<double>(value) - static_cast<double>(expected)) <= (tolerance))) testFailure(__FILE__, __LINE__, #value " near " #expected); } while(false)
+
+/**
+ * @return the exit code of the test
+ */
+inline int testResult(){
+    if(testFailureCount > 0){
+        printf("%u checks failed\n", testFailureCount);
+        return EXIT_FAILURE;
+    }
+
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
+
+
+#endif //GAME_ENGINE_TEST_HPP